@@ -0,0 +1,412 @@
+#include "benchmarks.h"
+#include "fixtures.h"
+#include "timing.h"
+
+#include "animationcache.h"
+#include "animationcompression.h"
+#include "compiledanimation.h"
+#include "crowd.h"
+#include "framearena.h"
+#include "matrix_rotations.h"
+#include "mappedfile.h" // unique_temporary_path(), make_directory()
+#include "threadpool.h"
+
+#include <algorithm> // min()
+#include <cmath> // fmod()
+#include <cstdio> // remove()
+#include <cstdlib> // atoi(), atof()
+#include <cstring> // memcmp()
+#include <iostream>
+#include <memory> // unique_ptr
+#include <thread> // hardware_concurrency()
+
+namespace graphics101 {
+namespace bench {
+
+namespace {
+// The benchmarks of load_animation() keep its cache here, in the working directory.
+const std::string kCacheDirectory = "pipeline_bench_cache";
+
+// Makes kCacheDirectory and stores the BVH file in `args` in `path`, or without one,
+// writes a random 120-joint, 3600-frame file there. The caller should remove it.
+// Writing it changes its modification time, so the first load of it always misses the cache.
+bool cached_animation_path( const std::vector< std::string >& args, std::string& path ) {
+    if( !make_directory( kCacheDirectory ) ) {
+        std::cerr << "ERROR: Could not create the cache directory: " << kCacheDirectory << '\n';
+        return false;
+    }
+    
+    if( !args.empty() ) {
+        path = args.front();
+        return true;
+    }
+    path = kCacheDirectory + "/random.bvh";
+    std::mt19937 random( 101 );
+    return write_random_bvh( path, 120, 3600, random );
+}
+
+template< typename Key >
+bool same_channel( const CompressedChannel< Key >& a, const CompressedChannel< Key >& b ) {
+    return a.begin == b.begin && a.frames == b.frames && a.keys == b.keys && a.block_keys == b.block_keys;
+}
+}
+
+bool animation_sampling( const std::vector< std::string >& args ) {
+    Skeleton skeleton;
+    BoneAnimation animation;
+    if( !animation_from_args( args, skeleton, animation ) ) return false;
+    if( animation.frames.empty() ) {
+        std::cerr << "ERROR: The animation has no frames.\n";
+        return false;
+    }
+    
+    const auto compile_start = Clock::now();
+    const CompiledAnimation compiled = compile_animation( animation );
+    const double compile_milliseconds = milliseconds_since( compile_start );
+    if( compiled.empty() || compiled.num_bones == 0 ) {
+        std::cerr << "ERROR: The animation didn't compile.\n";
+        return false;
+    }
+    
+    // Step by a fraction of a frame, so that most samples fall between frames.
+    const int count = 2000;
+    const real step = 0.37*animation.seconds_per_frame;
+    
+    const double interpolated = calls_per_second( count, [&]( int i ) {
+        const TRSPose pose = interpolate( animation, i*step );
+        checksum = checksum + pose.back().translation.x;
+    } );
+    
+    // interpolate() may only pick the nearest frame, so also time blending two frames
+    // the way it would with the axis*radians slerp().
+    const TRSPose& first = animation.frames.front();
+    const TRSPose& second = animation.frames.at( std::min( 1, compiled.num_frames - 1 ) );
+    const double axis_angle = calls_per_second( count, [&]( int i ) {
+        const real alpha = std::fmod( i*0.37, 1.0 );
+        TRSPose pose( first.size() );
+        for( int bone = 0; bone < pose.size(); ++bone ) {
+            pose[bone].translation = first[bone].translation + ( second[bone].translation - first[bone].translation )*alpha;
+            pose[bone].rotation = slerp( first[bone].rotation, second[bone].rotation, alpha );
+            pose[bone].scale = first[bone].scale + ( second[bone].scale - first[bone].scale )*alpha;
+        }
+        checksum = checksum + pose.back().rotation.x;
+    } );
+    
+    std::vector< QuatTRS > pose( compiled.num_bones );
+    const double nlerped = calls_per_second( count, [&]( int i ) {
+        sample_animation( compiled, i*step, pose.data(), RotationInterpolation::Nlerp );
+        checksum = checksum + pose.back().rotation.w;
+    } );
+    const double slerped = calls_per_second( count, [&]( int i ) {
+        sample_animation( compiled, i*step, pose.data(), RotationInterpolation::Slerp );
+        checksum = checksum + pose.back().rotation.w;
+    } );
+    
+    std::cout << "Compiled a " << compiled.num_bones << "-bone, " << compiled.num_frames << "-frame animation in "
+              << compile_milliseconds << " ms.\n"
+              << "    Poses per second: " << interpolated << " with interpolate(), "
+              << axis_angle << " blending axis*radians frames with slerp(), "
+              << nlerped << " with nlerp, " << slerped << " with slerp.\n";
+    return true;
+}
+
+bool crowd( const std::vector< std::string >& args ) {
+    const int num_instances = args.empty() ? 1000 : std::atoi( args.front().c_str() );
+    if( num_instances <= 0 ) {
+        std::cerr << "ERROR: The number of instances must be positive: " << args.front() << '\n';
+        return false;
+    }
+    
+    Skeleton skeleton;
+    BoneAnimation animation;
+    if( !animation_from_args( std::vector< std::string >( args.begin() + std::min< std::size_t >( 1, args.size() ), args.end() ), skeleton, animation ) ) return false;
+    const CompiledAnimation compiled = compile_animation( animation );
+    if( compiled.empty() || compiled.num_bones != skeleton.size() ) {
+        std::cerr << "ERROR: The animation didn't compile.\n";
+        return false;
+    }
+    
+    // Spread the instances through the clip.
+    const real duration = compiled.num_frames*compiled.seconds_per_frame;
+    std::vector< CrowdInstance > instances( num_instances );
+    for( int i = 0; i < num_instances; ++i ) {
+        instances[i].animation = &compiled;
+        instances[i].time = duration*i/num_instances;
+    }
+    
+    CrowdEvaluator crowd( skeleton );
+    std::vector< mat4 > bone2world( std::size_t( num_instances )*crowd.numBones() );
+    
+    std::cout << "Posing " << num_instances << " instances of a " << crowd.numBones() << "-bone skeleton ("
+              << std::thread::hardware_concurrency() << " hardware threads):\n";
+    for( const int num_threads : { 1, 8, 32 } ) {
+        // The calling thread works too.
+        std::unique_ptr< ThreadPool > pool;
+        if( num_threads > 1 ) pool.reset( new ThreadPool( num_threads - 1 ) );
+        
+        // Once to allocate the scratch space, then for real.
+        crowd.evaluate( instances, bone2world.data(), pool.get() );
+        const double milliseconds = average_milliseconds( 5, [&]() {
+            for( auto& instance : instances ) instance.time += 1./60.;
+            crowd.evaluate( instances, bone2world.data(), pool.get() );
+            checksum = checksum + bone2world.back()[3][0];
+        } );
+        
+        std::cout << "    " << per_second( num_instances, milliseconds ) << " instances/s with " << num_threads << ( num_threads == 1 ? " thread\n" : " threads\n" );
+    }
+    return true;
+}
+
+bool bvh_loading( const std::vector< std::string >& args ) {
+    // Without a file, write a big one and remove it afterwards.
+    std::string path;
+    if( args.empty() ) {
+        path = unique_temporary_path( "bvh_loading.bvh" );
+        std::mt19937 random( 101 );
+        if( !write_random_bvh( path, 120, 7200, random ) ) return false;
+    }
+    else path = args.front();
+    
+    bool passed = true;
+    const int repetitions = 3;
+    Skeleton skeleton;
+    BoneAnimation serial;
+    double serial_milliseconds = 0;
+    {
+        QuietErrors quiet;
+        serial_milliseconds = average_milliseconds( repetitions, [&]() { passed = loadBVH( path, skeleton, serial ) && passed; } );
+    }
+    if( !passed ) {
+        std::cerr << "ERROR: Could not load the BVH file: " << path << '\n';
+    }
+    else {
+        std::cout << "Loading " << serial.frames.size() << " frames of " << skeleton.size() << " bones ("
+                  << std::thread::hardware_concurrency() << " hardware threads):\n";
+        std::cout << "    " << serial_milliseconds << " ms with 1 thread\n";
+    }
+    
+    for( const int num_threads : { 2, 4, 8 } ) {
+        if( !passed ) break;
+        
+        // The calling thread works too.
+        ThreadPool pool( num_threads - 1 );
+        BoneAnimation parallel;
+        double milliseconds = 0;
+        {
+            QuietErrors quiet;
+            milliseconds = average_milliseconds( repetitions, [&]() { passed = loadBVH( path, skeleton, parallel, &pool ) && passed; } );
+        }
+        
+        bool identical = passed && parallel.seconds_per_frame == serial.seconds_per_frame && parallel.frames.size() == serial.frames.size();
+        for( std::size_t frame = 0; identical && frame < serial.frames.size(); ++frame ) {
+            identical = parallel.frames[ frame ].size() == serial.frames[ frame ].size()
+                && std::memcmp( parallel.frames[ frame ].data(), serial.frames[ frame ].data(), serial.frames[ frame ].size()*sizeof( TRS ) ) == 0;
+        }
+        if( !identical ) {
+            std::cerr << "ERROR: Decoding with " << num_threads << " threads gave different frames than decoding serially.\n";
+            passed = false;
+        }
+        std::cout << "    " << milliseconds << " ms with " << num_threads << " threads\n";
+    }
+    
+    if( args.empty() ) std::remove( path.c_str() );
+    return passed;
+}
+
+bool animation_cache( const std::vector< std::string >& args ) {
+    std::string path;
+    if( !cached_animation_path( args, path ) ) return false;
+    
+    const int repetitions = 5;
+    bool passed = true;
+    Skeleton skeleton;
+    BoneAnimation animation;
+    CompiledAnimation parsed, cached;
+    double parse_milliseconds = 0, first_milliseconds = 0, compiled_milliseconds = 0, animation_milliseconds = 0;
+    {
+        QuietErrors quiet;
+        auto start = Clock::now();
+        passed = load_animation( path, "", skeleton, nullptr, &parsed ) && passed;
+        parse_milliseconds = milliseconds_since( start );
+        
+        start = Clock::now();
+        passed = load_animation( path, kCacheDirectory, skeleton, nullptr, &cached ) && passed;
+        first_milliseconds = milliseconds_since( start );
+        
+        compiled_milliseconds = average_milliseconds( repetitions, [&]() { passed = load_animation( path, kCacheDirectory, skeleton, nullptr, &cached ) && passed; } );
+        animation_milliseconds = average_milliseconds( repetitions, [&]() { passed = load_animation( path, kCacheDirectory, skeleton, &animation, nullptr ) && passed; } );
+    }
+    if( args.empty() ) std::remove( path.c_str() );
+    if( !passed ) {
+        std::cerr << "ERROR: Could not load the animation: " << path << '\n';
+        return false;
+    }
+    
+    // The mapped tracks must be the ones compile_animation() made.
+    const std::size_t num_values = parsed.numValues();
+    const bool identical = cached.num_bones == parsed.num_bones && cached.num_frames == parsed.num_frames
+        && cached.seconds_per_frame == parsed.seconds_per_frame
+        && std::memcmp( cached.translations, parsed.translations, num_values*sizeof( vec3 ) ) == 0
+        && std::memcmp( cached.rotations, parsed.rotations, num_values*sizeof( quat ) ) == 0
+        && std::memcmp( cached.scales, parsed.scales, num_values*sizeof( vec3 ) ) == 0
+        && animation.frames.size() == std::size_t( parsed.num_frames );
+    if( !identical ) {
+        std::cerr << "ERROR: The cached animation differs from the parsed one.\n";
+        return false;
+    }
+    
+    std::cout << "Loading " << parsed.num_frames << " frames of " << parsed.num_bones << " bones:\n"
+              << "    " << parse_milliseconds << " ms parsing and compiling\n"
+              << "    " << first_milliseconds << " ms the first time with the cache, which saves it if it is out of date\n"
+              << "    " << compiled_milliseconds << " ms from the cache, compiled\n"
+              << "    " << animation_milliseconds << " ms from the cache, as a BoneAnimation\n";
+    return true;
+}
+bool animation_compression( const std::vector< std::string >& args ) {
+    CompressionSettings settings;
+    if( !args.empty() ) settings.tolerance = std::atof( args.front().c_str() );
+    if( !( settings.tolerance > 0 ) ) {
+        std::cerr << "ERROR: The tolerance must be positive: " << args.front() << '\n';
+        return false;
+    }
+    
+    std::string path;
+    if( !cached_animation_path( std::vector< std::string >( args.begin() + std::min< std::size_t >( 1, args.size() ), args.end() ), path ) ) return false;
+    
+    bool passed = true;
+    Skeleton skeleton;
+    CompiledAnimation compiled;
+    CompressedAnimation compressed, cold, warm;
+    real max_error = 0, warm_max_error = 0;
+    double compress_milliseconds = 0, cold_milliseconds = 0, warm_milliseconds = 0;
+    {
+        QuietErrors quiet;
+        passed = load_animation( path, "", skeleton, nullptr, &compiled );
+        if( passed ) {
+            const auto start = Clock::now();
+            compressed = compress_animation( skeleton, compiled, settings, &max_error );
+            compress_milliseconds = milliseconds_since( start );
+            
+            Skeleton cached_skeleton;
+            auto cached_start = Clock::now();
+            passed = load_compressed_animation( path, kCacheDirectory, settings, cached_skeleton, cold );
+            cold_milliseconds = milliseconds_since( cached_start );
+            cached_start = Clock::now();
+            passed = load_compressed_animation( path, kCacheDirectory, settings, cached_skeleton, warm, &warm_max_error ) && passed;
+            warm_milliseconds = milliseconds_since( cached_start );
+        }
+    }
+    if( args.size() < 2 ) std::remove( path.c_str() );
+    if( !passed || compressed.empty() ) {
+        std::cerr << "ERROR: Could not load and compress the animation: " << path << '\n';
+        return false;
+    }
+    
+    // Both the freshly compressed and the cached copy must match compressing it here.
+    for( const CompressedAnimation* loaded : { &cold, &warm } ) {
+        const bool identical = loaded->num_bones == compressed.num_bones && loaded->num_frames == compressed.num_frames
+            && loaded->seconds_per_frame == compressed.seconds_per_frame
+            && same_channel( loaded->translations, compressed.translations )
+            && same_channel( loaded->rotations, compressed.rotations )
+            && same_channel( loaded->scales, compressed.scales );
+        if( !identical ) {
+            std::cerr << "ERROR: load_compressed_animation() differs from compress_animation().\n";
+            return false;
+        }
+    }
+    if( warm_max_error != max_error ) {
+        std::cerr << "ERROR: The cached compressed animation has the wrong error: " << warm_max_error << " instead of " << max_error << '\n';
+        passed = false;
+    }
+    if( max_error > settings.tolerance ) {
+        std::cerr << "ERROR: The compressed animation is off by up to " << max_error << ", more than the tolerance.\n";
+        passed = false;
+    }
+    
+    // Scatter the samples through the clip, like a crowd at different times.
+    const int count = 20000;
+    const real duration = compiled.num_frames*compiled.seconds_per_frame;
+    const auto time = [&]( int i ) { return duration*std::fmod( i*real(0.618034), real(1) ); };
+    std::vector< QuatTRS > pose( compiled.num_bones );
+    const double compiled_per_second = calls_per_second( count, [&]( int i ) {
+        sample_animation( compiled, time( i ), pose.data() );
+        checksum = checksum + pose.back().rotation.w;
+    } );
+    const double compressed_per_second = calls_per_second( count, [&]( int i ) {
+        sample_animation( compressed, time( i ), pose.data() );
+        checksum = checksum + pose.back().rotation.w;
+    } );
+    
+    const std::size_t original_bytes = compiled.numValues()*( 2*sizeof( vec3 ) + sizeof( quat ) );
+    const std::size_t compressed_bytes = compressed.sizeInBytes();
+    std::cout << "Compressed a " << compiled.num_bones << "-bone, " << compiled.num_frames << "-frame animation from "
+              << original_bytes/1024. << " KB to " << compressed_bytes/1024. << " KB ("
+              << double( original_bytes )/compressed_bytes << ":1) in " << compress_milliseconds << " ms.\n"
+              << "    Keys kept: " << compressed.translations.keys.size() << " translations, "
+              << compressed.rotations.keys.size() << " rotations, "
+              << compressed.scales.keys.size() << " scales of " << compiled.numValues() << " each.\n"
+              << "    Max world-space error: " << max_error << " (tolerance " << settings.tolerance << ", shell distance " << settings.shell_distance << ").\n"
+              << "    Poses per second: " << compiled_per_second << " compiled, " << compressed_per_second << " compressed.\n"
+              << "    Loading with load_compressed_animation(): " << cold_milliseconds << " ms compressing and saving, "
+              << warm_milliseconds << " ms from the cache.\n";
+    return passed;
+}
+bool rotation_blending( const std::vector< std::string >& args ) {
+    Skeleton skeleton;
+    BoneAnimation animation;
+    if( !animation_from_args( args, skeleton, animation ) ) return false;
+    if( animation.frames.size() < 4 || animation.frames.front().empty() ) {
+        std::cerr << "ERROR: The animation needs at least 4 frames.\n";
+        return false;
+    }
+    
+    const int num_bones = int( animation.frames.front().size() );
+    // Blend frames a little apart, like two clips playing at once.
+    const int num_poses = 4;
+    const int frame_step = std::max( 1, int( animation.frames.size() )/8 );
+    std::vector< vec3 > poses( num_poses*num_bones );
+    for( int pose = 0; pose < num_poses; ++pose ) {
+        const TRSPose& frame = animation.frames[ ( pose*frame_step ) % animation.frames.size() ];
+        for( int bone = 0; bone < num_bones; ++bone ) poses[ pose*num_bones + bone ] = frame[bone].rotation;
+    }
+    const std::vector< real > weights = { 0.4, 0.3, 0.2, 0.1 };
+    const vec3* a = poses.data();
+    const vec3* b = poses.data() + num_bones;
+    
+    // Blend whole poses.
+    const int count = 500;
+    std::vector< vec3 > result( num_bones );
+    std::vector< vec3 > rotations( num_poses );
+    
+    const double slerp_matrices = calls_per_second( count, [&]( int i ) {
+        const real t = std::fmod( i*0.37, 1.0 );
+        for( int bone = 0; bone < num_bones; ++bone ) result[bone] = slerp_with_matrices( a[bone], b[bone], t );
+        checksum = checksum + result.back().x;
+    } );
+    const double slerp_quaternions = calls_per_second( count, [&]( int i ) {
+        slerp( a, b, std::fmod( i*0.37, 1.0 ), num_bones, result.data() );
+        checksum = checksum + result.back().x;
+    } );
+    const double average_matrices = calls_per_second( count, [&]( int ) {
+        for( int bone = 0; bone < num_bones; ++bone ) {
+            for( int pose = 0; pose < num_poses; ++pose ) rotations[pose] = poses[ pose*num_bones + bone ];
+            result[bone] = average_rotation_with_matrices( rotations, weights );
+        }
+        checksum = checksum + result.back().x;
+    } );
+    FrameArena arena;
+    const double average_quaternions = calls_per_second( count, [&]( int ) {
+        arena.reset();
+        average_rotations( poses.data(), weights, num_bones, arena, result.data() );
+        checksum = checksum + result.back().x;
+    } );
+    
+    std::cout << "Blending " << num_bones << "-bone poses per second:\n"
+              << "    slerp(): " << slerp_matrices << " through matrices, " << slerp_quaternions << " with quaternions\n"
+              << "    averaging " << num_poses << " poses: " << average_matrices << " through matrices, "
+              << average_quaternions << " with average_rotations() on quaternions\n";
+    return true;
+}
+
+}
+}
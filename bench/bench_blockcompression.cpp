@@ -0,0 +1,58 @@
+#include "benchmarks.h"
+#include "timing.h"
+
+#include "blockcompression.h"
+#include "image.h"
+#include "threadpool.h"
+
+#include <iostream>
+
+namespace graphics101 {
+namespace bench {
+
+bool block_compression( const std::vector< std::string >& args ) {
+    std::vector< std::string > paths = args;
+    if( paths.empty() ) {
+        paths.push_back( GRAPHICS101_EXAMPLES_DIR "/earth.png" );
+        paths.push_back( GRAPHICS101_EXAMPLES_DIR "/bricks-normal-map.jpg" );
+    }
+    
+    const int repetitions = 3;
+    ThreadPool pool;
+    const ImageEncoding encodings[3] = { ImageEncoding::BC1, ImageEncoding::BC3, ImageEncoding::BC5 };
+    const char* names[3] = { "BC1", "BC3", "BC5" };
+    
+    bool passed = true;
+    for( const auto& path : paths ) {
+        const Image image = decode_image( path, false, 0 );
+        if( !image.valid() || image.is_float ) {
+            std::cerr << "ERROR: Could not load an 8-bit image: " << path << '\n';
+            passed = false;
+            continue;
+        }
+        const double texels = double( image.width() )*image.height();
+        std::cout << path << " (" << image.width() << 'x' << image.height() << ", " << image.channels << " channels)\n";
+        
+        for( int i = 0; i < 3; ++i ) {
+            Image compressed;
+            double serial = 0, parallel = 0;
+            {
+                QuietErrors quiet;
+                serial = average_milliseconds( repetitions, [&]() { compressed = compress_image( image, encodings[i] ); } );
+                parallel = average_milliseconds( repetitions, [&]() { compressed = compress_image( image, encodings[i], &pool ); } );
+            }
+            const double psnr = compression_psnr( image, compressed );
+            checksum = checksum + psnr;
+            
+            std::cout << "    " << names[i]
+                      << ": " << per_second( texels, serial )/1e6 << " Mtexels/s on 1 thread, "
+                      << per_second( texels, parallel )/1e6 << " Mtexels/s on " << pool.size() + 1 << " threads"
+                      << ", PSNR " << psnr << " dB"
+                      << ", " << image.levels.front().size/1024 << " KB -> " << compressed.levels.front().size/1024 << " KB\n";
+        }
+    }
+    return passed;
+}
+
+}
+}
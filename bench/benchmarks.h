@@ -0,0 +1,65 @@
+#ifndef __benchmarks_h__
+#define __benchmarks_h__
+
+#include <string>
+#include <vector>
+
+namespace graphics101 {
+namespace bench {
+
+// Each benchmark prints its results to std::cout and returns false if something
+// it checks went wrong. `args` are the command line arguments after its name.
+
+// Loads an animation with load_animation() with and without a cache, reports how long each
+// takes, and checks that the compiled animation mapped from the cache matches the parsed one.
+// It keeps the cache in pipeline_bench_cache/ in the working directory.
+// args: a BVH file (default: a random 120-joint, 3600-frame file it writes there and removes)
+bool animation_cache( const std::vector< std::string >& args );
+
+// Compresses an animation with compress_animation(), reports how small and accurate it is and how many
+// poses per second sample_animation() produces compared to the compiled animation, and checks that
+// load_compressed_animation() gives the same result with and without its cache in pipeline_bench_cache/.
+// args: a tolerance (default: 0.01), then a BVH file (default: as animation_cache)
+bool animation_compression( const std::vector< std::string >& args );
+
+// Compiles an animation and reports how many poses per second interpolate(),
+// blending frames with slerp(), and sample_animation() produce.
+// args: a BVH file (default: a random 120-bone, 600-frame animation)
+bool animation_sampling( const std::vector< std::string >& args );
+
+// Loads a BVH file with 1, 2, 4, and 8 threads, reports how long each takes,
+// and checks that they all decode the same frames.
+// args: a BVH file (default: a random 120-joint, 7200-frame file it writes and removes)
+bool bvh_loading( const std::vector< std::string >& args );
+
+// Block compresses images with each encoding and reports throughput and PSNR.
+// args: image paths (default: examples/earth.png and examples/bricks-normal-map.jpg)
+bool block_compression( const std::vector< std::string >& args );
+
+// Poses a crowd of instances of an animation with CrowdEvaluator on 1, 8, and 32 threads
+// and reports instances per second.
+// args: a number of instances (default: 1000), then a BVH file (default: as animation_sampling)
+bool crowd( const std::vector< std::string >& args );
+
+// Poses random 30, 150, and 1000-bone skeletons with a chain of mat4 products (the reference
+// in tests/matrix_kinematics.cpp), a chain of Affine3x4 products, and CompiledSkeleton's
+// level-by-level sweep, and reports how long each takes.
+// tests/test_kinematics.cpp checks that they agree.
+// args: none
+bool compiled_skeleton( const std::vector< std::string >& args );
+
+// Moves one hand of a 150-bone humanoid with IncrementalKinematics and reports how long
+// updating takes compared to posing every bone with CompiledSkeleton.
+// args: none
+bool incremental_kinematics( const std::vector< std::string >& args );
+
+// Reports how many poses per second slerp() and average_rotations() blend from an animation's
+// rotations, compared to blending them by converting to and from matrices the way they used to.
+// tests/test_rotations.cpp checks that the two ways agree.
+// args: a BVH file (default: as animation_sampling)
+bool rotation_blending( const std::vector< std::string >& args );
+
+}
+}
+
+#endif /* __benchmarks_h__ */
@@ -0,0 +1,153 @@
+#include "fixtures.h"
+
+#include <cassert>
+#include <cmath> // sin()
+#include <cstdio> // fopen(), fprintf()
+#include <iostream>
+
+namespace {
+using namespace graphics101;
+
+// Appends a chain of `length` bones below `parent` and returns the last one.
+int add_chain( Skeleton& skeleton, int parent, int length ) {
+    for( int i = 0; i < length; ++i ) {
+        Bone bone;
+        bone.parent_index = parent;
+        bone.end = ( parent < 0 ? vec3(0,0,0) : skeleton[parent].end ) + vec3( 0, 0.1, 0 );
+        skeleton.push_back( bone );
+        parent = int( skeleton.size() ) - 1;
+    }
+    return parent;
+}
+
+// Writes bone `bone` and its descendants in BVH's HIERARCHY syntax.
+void write_bvh_joint( std::FILE* file, const Skeleton& skeleton, const std::vector< std::vector< int > >& children, int bone, int depth ) {
+    const std::string indent( 4*depth, ' ' );
+    const int parent = skeleton[bone].parent_index;
+    const vec3 offset = parent < 0 ? vec3(0,0,0) : skeleton[bone].end - skeleton[parent].end;
+    std::fprintf( file, "%s%s j%d\n%s{\n", indent.c_str(), parent < 0 ? "ROOT" : "JOINT", bone, indent.c_str() );
+    std::fprintf( file, "%s    OFFSET %f %f %f\n", indent.c_str(), offset.x, offset.y, offset.z );
+    if( parent < 0 ) std::fprintf( file, "%s    CHANNELS 6 Xposition Yposition Zposition Zrotation Xrotation Yrotation\n", indent.c_str() );
+    else std::fprintf( file, "%s    CHANNELS 3 Zrotation Xrotation Yrotation\n", indent.c_str() );
+    for( const int child : children[bone] ) write_bvh_joint( file, skeleton, children, child, depth + 1 );
+    if( children[bone].empty() ) {
+        std::fprintf( file, "%s    End Site\n%s    {\n%s        OFFSET 0 0.1 0\n%s    }\n", indent.c_str(), indent.c_str(), indent.c_str(), indent.c_str() );
+    }
+    std::fprintf( file, "%s}\n", indent.c_str() );
+}
+}
+
+namespace graphics101 {
+namespace bench {
+
+Skeleton random_skeleton( int num_bones, std::mt19937& random ) {
+    std::uniform_real_distribution< real > uniform( -1, 1 );
+    Skeleton skeleton( num_bones );
+    for( int i = 1; i < num_bones; ++i ) {
+        skeleton[i].parent_index = i % 4 == 0 ? int( random() % i ) : i - 1;
+        skeleton[i].end = skeleton[ skeleton[i].parent_index ].end + 0.1f*vec3( uniform( random ), 1, uniform( random ) );
+    }
+    return skeleton;
+}
+
+Skeleton humanoid_skeleton( int& hand ) {
+    Skeleton skeleton;
+    const int hips = add_chain( skeleton, -1, 1 );
+    const int chest = add_chain( skeleton, hips, 4 );
+    const int head = add_chain( skeleton, chest, 2 );
+    for( int i = 0; i < 97; ++i ) add_chain( skeleton, head, 1 );
+    for( int side = 0; side < 2; ++side ) {
+        const int wrist = add_chain( skeleton, chest, 3 );
+        const int palm = add_chain( skeleton, wrist, 1 );
+        if( side == 0 ) hand = palm;
+        for( int finger = 0; finger < 5; ++finger ) add_chain( skeleton, palm, 3 );
+    }
+    for( int side = 0; side < 2; ++side ) add_chain( skeleton, hips, 4 );
+    assert( skeleton.size() == 150 );
+    return skeleton;
+}
+
+BoneAnimation swaying_animation( const Skeleton& skeleton, int num_frames, std::mt19937& random ) {
+    std::uniform_real_distribution< real > uniform( -1, 1 );
+    const int num_bones = int( skeleton.size() );
+    
+    // Each bone's axis, how far it sways in radians, how fast, and where in the sway it starts.
+    std::vector< vec3 > axes( num_bones );
+    std::vector< vec3 > sways( num_bones );
+    for( int bone = 0; bone < num_bones; ++bone ) {
+        axes[bone] = glm::normalize( vec3( uniform( random ), uniform( random ), 1 ) );
+        sways[bone] = vec3( 0.6 + 0.4*uniform( random ), 2 + uniform( random ), 3*uniform( random ) );
+    }
+    
+    BoneAnimation animation;
+    animation.frames.assign( num_frames, TRSPose( num_bones ) );
+    for( int frame = 0; frame < num_frames; ++frame ) {
+        const real t = frame*animation.seconds_per_frame;
+        TRSPose& pose = animation.frames[frame];
+        for( int bone = 0; bone < num_bones; ++bone ) {
+            const int parent = skeleton[bone].parent_index;
+            pose[bone].translation = parent < 0 ? vec3( 0.1*std::sin( 3*t ), 1, t ) : skeleton[bone].end - skeleton[parent].end;
+            pose[bone].rotation = axes[bone]*( sways[bone].x*std::sin( sways[bone].y*t + sways[bone].z ) );
+        }
+    }
+    return animation;
+}
+
+bool write_random_bvh( const std::string& path, int num_bones, int num_frames, std::mt19937& random ) {
+    const Skeleton skeleton = random_skeleton( num_bones, random );
+    std::vector< std::vector< int > > children( num_bones );
+    for( int bone = 1; bone < num_bones; ++bone ) children[ skeleton[bone].parent_index ].push_back( bone );
+    
+    std::FILE* file = std::fopen( path.c_str(), "w" );
+    if( !file ) {
+        std::cerr << "ERROR: Could not write a BVH file: " << path << '\n';
+        return false;
+    }
+    
+    std::fprintf( file, "HIERARCHY\n" );
+    write_bvh_joint( file, skeleton, children, 0, 0 );
+    
+    // Each channel sways in degrees with its own amplitude, speed, and phase.
+    // The root also walks forward.
+    const int num_channels = 6 + 3*( num_bones - 1 );
+    std::uniform_real_distribution< real > uniform( 0, 1 );
+    std::vector< vec3 > sways( num_channels );
+    for( auto& sway : sways ) sway = vec3( 5 + 55*uniform( random ), 0.1 + 1.4*uniform( random ), 6.28*uniform( random ) );
+    
+    const real seconds_per_frame = 1./120.;
+    std::fprintf( file, "MOTION\nFrames: %d\nFrame Time: %f\n", num_frames, seconds_per_frame );
+    for( int frame = 0; frame < num_frames; ++frame ) {
+        const real t = frame*seconds_per_frame;
+        for( int channel = 0; channel < num_channels; ++channel ) {
+            real value = sways[channel].x*std::sin( 6.28*sways[channel].y*t + sways[channel].z );
+            if( channel == 2 ) value = 0.2*value + 50*t;
+            std::fprintf( file, channel == 0 ? "%.4f" : " %.4f", value );
+        }
+        std::fprintf( file, "\n" );
+    }
+    
+    const bool written = !std::ferror( file );
+    if( std::fclose( file ) != 0 || !written ) {
+        std::cerr << "ERROR: Could not write a BVH file: " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool animation_from_args( const std::vector< std::string >& args, Skeleton& skeleton_out, BoneAnimation& animation_out ) {
+    if( !args.empty() ) {
+        if( !loadBVH( args.front(), skeleton_out, animation_out ) ) {
+            std::cerr << "ERROR: Could not load the BVH file: " << args.front() << '\n';
+            return false;
+        }
+        return true;
+    }
+    
+    std::mt19937 random( 101 );
+    skeleton_out = random_skeleton( 120, random );
+    animation_out = swaying_animation( skeleton_out, 600, random );
+    return true;
+}
+
+}
+}
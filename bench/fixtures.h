@@ -0,0 +1,41 @@
+#ifndef __fixtures_h__
+#define __fixtures_h__
+
+#include "animation.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace graphics101 {
+namespace bench {
+
+// Synthetic skeletons and animations, so that the benchmarks don't need data files.
+
+// A random skeleton made of chains of 4 bones (like limbs and fingers),
+// each hanging off a random bone of an earlier chain.
+Skeleton random_skeleton( int num_bones, std::mt19937& random );
+
+// A 150-bone humanoid in depth-first order, like loadBVH() makes:
+// a spine, a head with 97 face bones, two legs, and two arms with three-joint fingers.
+// Sets `hand` to the left hand.
+Skeleton humanoid_skeleton( int& hand );
+
+// A `num_frames`-frame animation of `skeleton` at 60 frames/second.
+// Every bone sways back and forth around its own random axis, and the root also walks forward,
+// so neighboring frames are close, like motion capture.
+BoneAnimation swaying_animation( const Skeleton& skeleton, int num_frames, std::mt19937& random );
+
+// Writes a BVH file with a random_skeleton() of `num_bones` joints swaying for `num_frames` frames,
+// with every channel printed to 4 decimal places, like motion capture exports.
+// Returns false if the file can't be written.
+bool write_random_bvh( const std::string& path, int num_bones, int num_frames, std::mt19937& random );
+
+// Loads the BVH file args[0] if there is one. Otherwise, makes a 120-bone random_skeleton()
+// and a 600-frame swaying_animation() of it. Returns false if the file doesn't load.
+bool animation_from_args( const std::vector< std::string >& args, Skeleton& skeleton_out, BoneAnimation& animation_out );
+
+}
+}
+
+#endif /* __fixtures_h__ */
@@ -0,0 +1,64 @@
+#include "benchmarks.h"
+#include "timing.h"
+
+#include <cstring> // strcmp()
+#include <iostream>
+
+namespace graphics101 {
+namespace bench {
+volatile double checksum = 0;
+}
+}
+
+namespace {
+using namespace graphics101::bench;
+
+struct Benchmark {
+    const char* name;
+    bool (*run)( const std::vector< std::string >& args );
+};
+const Benchmark kBenchmarks[] = {
+    { "animation_cache", animation_cache },
+    { "animation_compression", animation_compression },
+    { "animation_sampling", animation_sampling },
+    { "block_compression", block_compression },
+    { "bvh_loading", bvh_loading },
+    { "compiled_skeleton", compiled_skeleton },
+    { "crowd", crowd },
+    { "incremental_kinematics", incremental_kinematics },
+    { "rotation_blending", rotation_blending },
+};
+
+void usage( const char* program ) {
+    std::cerr << "Usage: " << program << " [benchmark [arguments...]]\n";
+    std::cerr << "With no benchmark, runs them all with their default arguments.\n";
+    std::cerr << "See bench/benchmarks.h for the arguments. The benchmarks are:\n";
+    for( const auto& benchmark : kBenchmarks ) std::cerr << "    " << benchmark.name << '\n';
+}
+}
+
+int main( int argc, char* argv[] ) {
+    bool passed = true;
+    
+    if( argc < 2 ) {
+        for( const auto& benchmark : kBenchmarks ) {
+            std::cout << "== " << benchmark.name << '\n';
+            if( !benchmark.run( std::vector< std::string >() ) ) passed = false;
+        }
+    }
+    else {
+        const Benchmark* found = nullptr;
+        for( const auto& benchmark : kBenchmarks ) {
+            if( std::strcmp( benchmark.name, argv[1] ) == 0 ) found = &benchmark;
+        }
+        if( !found ) {
+            usage( argv[0] );
+            return 2;
+        }
+        passed = found->run( std::vector< std::string >( argv + 2, argv + argc ) );
+    }
+    
+    std::cout << "(checksum " << checksum << ")\n";
+    if( !passed ) std::cerr << "ERROR: A benchmark failed its checks.\n";
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,3 @@
+// The pipeline gets this from texture.cpp, which needs OpenGL.
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
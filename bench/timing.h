@@ -0,0 +1,60 @@
+#ifndef __timing_h__
+#define __timing_h__
+
+#include <chrono>
+#include <iostream>
+
+namespace graphics101 {
+namespace bench {
+
+typedef std::chrono::steady_clock Clock;
+
+// The milliseconds since `start`.
+inline double milliseconds_since( const Clock::time_point& start ) {
+    return std::chrono::duration< double, std::milli >( Clock::now() - start ).count();
+}
+
+// Calls `run()` `repetitions` times and returns the average milliseconds per call.
+template< typename Function >
+double average_milliseconds( int repetitions, Function run ) {
+    const auto start = Clock::now();
+    for( int i = 0; i < repetitions; ++i ) run();
+    return milliseconds_since( start )/repetitions;
+}
+
+// How many times per second something happens `count` times in `milliseconds`.
+inline double per_second( double count, double milliseconds ) {
+    return milliseconds > 0 ? count*1000/milliseconds : 0;
+}
+
+// Calls `run( i )` for i in [0,count) and returns how many calls per second that was.
+template< typename Function >
+double calls_per_second( int count, Function run ) {
+    const auto start = Clock::now();
+    for( int i = 0; i < count; ++i ) run( i );
+    return per_second( count, milliseconds_since( start ) );
+}
+
+// Benchmarks add the results they compute to this, so that the optimizer
+// can't throw the work away. main() prints it.
+extern volatile double checksum;
+
+// Throws away what the code under test logs to std::cerr while this is alive,
+// so that it doesn't bury the results.
+class QuietErrors {
+public:
+    QuietErrors() : m_buffer( std::cerr.rdbuf( nullptr ) ) {}
+    ~QuietErrors() { std::cerr.rdbuf( m_buffer ); std::cerr.clear(); }
+    
+    // This class cannot be copied.
+    QuietErrors( const QuietErrors& ) = delete;
+    void operator=( const QuietErrors& ) = delete;
+
+private:
+    std::streambuf* m_buffer;
+};
+
+}
+}
+
+#endif /* __timing_h__ */
@@ -0,0 +1,45 @@
+#version 330
+
+// Splits the surface into a 4x4 grid of tiles, each with its own texture, like a mesh
+// with 16 materials drawn at once. Used by atlas_tiles.json to compare binding 16
+// textures against binding one texture atlas page.
+
+in vec2 fTexCoord;
+
+const int NUM_TILES = 16;
+uniform sampler2D tiles[ NUM_TILES ];
+// Where each tile's texture is within its atlas page (see parseUniforms()).
+// Textures that aren't atlased use the whole texture.
+#define WHOLE vec4( 1.0, 1.0, 0.0, 0.0 )
+uniform vec4 tiles_uv_transform[ NUM_TILES ] = vec4[ NUM_TILES ](
+    WHOLE, WHOLE, WHOLE, WHOLE,
+    WHOLE, WHOLE, WHOLE, WHOLE,
+    WHOLE, WHOLE, WHOLE, WHOLE,
+    WHOLE, WHOLE, WHOLE, WHOLE
+    );
+
+// gl_FragColor is old-fashioned, but it's what WebGL 1 uses.
+// From: https://stackoverflow.com/questions/9222217/how-does-the-fragment-shader-know-what-variable-to-use-for-the-color-of-a-pixel
+layout(location = 0) out vec4 FragColor;
+
+void main()
+{
+    vec2 grid = fTexCoord * 4.0;
+    int tile = clamp( int( floor( grid.x ) ), 0, 3 ) + 4 * clamp( int( floor( grid.y ) ), 0, 3 );
+    vec2 uv = fract( grid );
+    
+    // GLSL 3.30 only indexes sampler arrays with constants, and implicit derivatives
+    // aren't defined inside the branches, so take them from the continuous `grid` first.
+    vec2 dx = dFdx( grid );
+    vec2 dy = dFdy( grid );
+    
+    vec4 color = vec4( 1.0, 0.0, 1.0, 1.0 );
+    // One branch per tile, each indexing with a constant.
+#define SAMPLE_TILE( i ) if( tile == i ) color = textureGrad( tiles[i], uv * tiles_uv_transform[i].xy + tiles_uv_transform[i].zw, dx * tiles_uv_transform[i].xy, dy * tiles_uv_transform[i].xy );
+    SAMPLE_TILE( 0 )  SAMPLE_TILE( 1 )  SAMPLE_TILE( 2 )  SAMPLE_TILE( 3 )
+    SAMPLE_TILE( 4 )  SAMPLE_TILE( 5 )  SAMPLE_TILE( 6 )  SAMPLE_TILE( 7 )
+    SAMPLE_TILE( 8 )  SAMPLE_TILE( 9 )  SAMPLE_TILE( 10 ) SAMPLE_TILE( 11 )
+    SAMPLE_TILE( 12 ) SAMPLE_TILE( 13 ) SAMPLE_TILE( 14 ) SAMPLE_TILE( 15 )
+    
+    FragColor = color;
+}
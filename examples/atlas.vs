@@ -0,0 +1,15 @@
+#version 330
+
+uniform mat4 uProjectionMatrix;
+uniform mat4 uViewMatrix;
+
+in vec3 vPos;
+in vec2 vTexCoord;
+
+out vec2 fTexCoord;
+
+void main()
+{
+    fTexCoord = vTexCoord;
+    gl_Position = uProjectionMatrix * ( uViewMatrix * vec4(vPos, 1.0) );
+}
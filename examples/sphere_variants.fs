@@ -0,0 +1,26 @@
+#version 330
+
+// Two variants of one shader. Define ENVIRONMENT_MAP (in the scene's "defines")
+// to color the sphere with the cube map instead of the 2D texture.
+
+in vec3 fNormal;
+in vec2 fTexCoord;
+
+#ifdef ENVIRONMENT_MAP
+uniform samplerCube uTexCube;
+#else
+uniform sampler2D uTex;
+#endif
+
+layout(location = 0) out vec4 FragColor;
+
+void main()
+{
+#ifdef ENVIRONMENT_MAP
+    // Color is the cube map.
+    FragColor = texture( uTexCube, normalize(fNormal) ).rgba;
+#else
+    // Color is the 2D texture.
+    FragColor = texture( uTex, fTexCoord.xy ).rgba;
+#endif
+}
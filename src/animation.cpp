@@ -1,7 +1,8 @@
 #include "animation.h"
+#include "framearena.h"
+#include "quaternion.h"
 
 #include <glm/ext/matrix_transform.hpp> // translate, rotate, scale
-#include <glm/gtx/matrix_interpolation.hpp> // axisAngleMatrix
 
 using namespace glm;
 using namespace graphics101;
@@ -24,74 +25,114 @@ TRS::operator mat4() const {
 MatrixPose MatrixPoseFromTRSPose( const TRSPose& pose ) {
     return MatrixPose( pose.begin(), pose.end() );
 }
+void matrices_from_pose( const TRS* pose, int num_bones, mat4* matrices_out ) {
+    for( int bone = 0; bone < num_bones; ++bone ) matrices_out[bone] = mat4( pose[bone] );
+}
 
 namespace {
-// Returns the axis*radians rotation that results from applying the axis*radians rotation
-// `first` followed by the axis*radians rotation `second`.
-vec3 compose_rotations( const vec3& second, const vec3& first ) {
-    // This could be done more efficiently by avoid the matrix conversion.
-    // See: https://math.stackexchange.com/questions/382760/composition-of-two-axis-angle-rotations
-    const mat4 Mfirst = glm::axisAngleMatrix( first, length(first) );
-    const mat4 Msecond = glm::axisAngleMatrix( second, length(second) );
-    const mat4 composed = Msecond*Mfirst;
-    vec3 result_axis;
-    real result_angle;
-    glm::axisAngle( composed, result_axis, result_angle );
-    return result_angle*result_axis;
-}
-}
+// Give up on average_rotation() converging after this many iterations.
+// A good initial guess usually converges in two or three.
+const int kMaxAverageIterations = 16;
 
-vec3 slerp( const vec3& a, const vec3& b, real t ) {
+// Returns the unit quaternion that rotates by `rotation` and then by `d`*`t`,
+// where `d` is the rotation from `a` to `b`, taking the short way around.
+quat slerp_quats( const quat& a, const quat& b, real t ) {
     // Find the rotation `d` from `a` to `b`: da = b <=> d = b a^(-1).
-    // In words, invert the `a` rotation and apply the `b` rotation to get `d`.
-    const vec3 d = compose_rotations( b, -a );
-    // Constant linear speed interpolation from `a` to `b` is obtained by composing
+    // A unit quaternion's inverse is its conjugate.
+    quat d = b*glm::conjugate( a );
+    // q and -q are the same rotation. Pick the one that turns by at most pi.
+    if( d.w < 0 ) d = -d;
+    // Constant speed interpolation from `a` to `b` is obtained by composing
     // varying amounts of `d` with `a`: (td) a.
-    // When the interpolation parameter `t` is 0, we get `a`: (0d) a = a.
-    // When the interpolation parameter `t` is 1, we get `b`: 1d a = b a^(-1) a = b.
-    return compose_rotations( t*d, a );
+    return quat_from_axis_angle( t*axis_angle_from_quat( d ) )*a;
 }
-vec3 average_rotation( const std::vector< vec3 >& rotations, const std::vector< real >& weights ) {
-    assert( rotations.size() == weights.size() );
-    assert( !rotations.empty() );
-    
-    const real eps = 1e-5;
-    
-    // We are following Setion 8.5 in Ethan Eade's: http://www.ethaneade.org/lie.pdf
-    
+
+/*
+Given:
+    rotations: `count` unit quaternions
+    weights: Their weights
+    count: How many there are
+Returns:
+    Their weighted average.
+
+We are following Section 8.5 in Ethan Eade's: http://www.ethaneade.org/lie.pdf
+The initial guess is the chordal L2 mean: the normalized weighted sum of the quaternions
+on the same side of the hypersphere. It's very close for rotations that aren't far apart,
+so the iterations rarely need to run more than a couple of times.
+*/
+quat average_quats( const quat* rotations, const real* weights, int count ) {
     // We need the denominator for our weighted average.
-    real denom = 0.;
-    for( auto w : weights ) denom += w;
-    assert( denom > eps );
-    denom = 1./denom;
+    real weight_sum = 0;
+    for( int i = 0; i < count; ++i ) weight_sum += weights[i];
+    assert( weight_sum > 1e-5 );
+    const real inverse_weight_sum = 1/weight_sum;
     
-    // Our initial guess is any rotation.
-    vec3 mean = rotations.front();
-    vec3 mean_last;
-    do {
-        // Store the previous mean so we know if we've stopped changing.
-        mean_last = mean;
-        
+    quat mean( 0, 0, 0, 0 );
+    for( int i = 0; i < count; ++i ) {
+        mean = mean + ( glm::dot( rotations[i], rotations[0] ) < 0 ? -weights[i] : weights[i] )*rotations[i];
+    }
+    const real length = glm::length( mean );
+    // The rotations cancel out. Start from any of them.
+    mean = length > 1e-7 ? mean/length : rotations[0];
+    
+    const real eps = 1e-5;
+    for( int iteration = 0; iteration < kMaxAverageIterations; ++iteration ) {
         // We compute the weighted average in the space around our current estimate
         // for the mean. That means, convert each rotation so that if we were at the mean
         // it would then apply the rotation.
-        // (1/denom) sum w_i ( rotation_i * mean_last^(-1) )
-        mean = vec3(0);
-        for( int i = 0; i < rotations.size(); ++i ) {
-            mean += weights.at(i) * compose_rotations( rotations.at(i), -mean_last );
+        // (1/weight_sum) sum w_i ( rotation_i * mean^(-1) )
+        const quat inverse_mean = glm::conjugate( mean );
+        vec3 step( 0, 0, 0 );
+        for( int i = 0; i < count; ++i ) {
+            step += weights[i]*axis_angle_from_quat( rotations[i]*inverse_mean );
         }
-        mean /= denom;
+        step *= inverse_weight_sum;
         
         // Convert the average in mean-space back to global space.
         // It's our new estimate.
-        mean = compose_rotations( mean, mean_last );
-    } while( distance( mean, mean_last ) > eps );
+        mean = glm::normalize( quat_from_axis_angle( step )*mean );
+        if( glm::length( step ) <= eps ) break;
+    }
     
     return mean;
 }
+}
+
+vec3 slerp( const vec3& a, const vec3& b, real t ) {
+    return axis_angle_from_quat( slerp_quats( quat_from_axis_angle( a ), quat_from_axis_angle( b ), t ) );
+}
+void slerp( const vec3* a, const vec3* b, real t, int count, vec3* result_out ) {
+    for( int i = 0; i < count; ++i ) result_out[i] = slerp( a[i], b[i], t );
+}
+vec3 average_rotation( const std::vector< vec3 >& rotations, const std::vector< real >& weights ) {
+    assert( rotations.size() == weights.size() );
+    assert( !rotations.empty() );
+    
+    std::vector< quat > quats( rotations.size() );
+    for( int i = 0; i < rotations.size(); ++i ) quats[i] = quat_from_axis_angle( rotations[i] );
+    return axis_angle_from_quat( average_quats( quats.data(), weights.data(), int( quats.size() ) ) );
+}
+void average_rotations( const vec3* rotations, const std::vector< real >& weights, int count, FrameArena& arena, vec3* result_out ) {
+    assert( !weights.empty() );
+    
+    // One set at a time.
+    const int num_weights = int( weights.size() );
+    quat* quats = arena.allocate< quat >( num_weights );
+    for( int set = 0; set < count; ++set ) {
+        for( int i = 0; i < num_weights; ++i ) quats[i] = quat_from_axis_angle( rotations[ i*count + set ] );
+        result_out[ set ] = axis_angle_from_quat( average_quats( quats, weights.data(), num_weights ) );
+    }
+}
 
 TRSPose interpolate( const BoneAnimation& animation, real t ) {
     assert( !animation.frames.empty() );
+    
+    TRSPose result( animation.frames.front().size() );
+    interpolate( animation, t, result.data() );
+    return result;
+}
+void interpolate( const BoneAnimation& animation, real t, TRS* pose_out ) {
+    assert( !animation.frames.empty() );
     assert( animation.seconds_per_frame > 0 );
     
     // Convert t, whose units are seconds, into u, whose units are the fraction
@@ -101,12 +142,11 @@ TRSPose interpolate( const BoneAnimation& animation, real t ) {
     const real u = std::fmod( t/total_duration_seconds, 1.0 );
     
     // Your code goes here.
-    TRSPose result;
+    // Write the pose into pose_out. It has room for one TRS per bone.
     
-    // The simplest possible thing: just return the closest pose.
-    result = animation.frames.at( max( 0, min( int(animation.frames.size())-1, int(lround( u*(animation.frames.size()-1) )) ) ) );
-    
-    return result;
+    // The simplest possible thing: just copy the closest pose.
+    const TRSPose& closest = animation.frames.at( max( 0, min( int(animation.frames.size())-1, int(lround( u*(animation.frames.size()-1) )) ) ) );
+    std::copy( closest.begin(), closest.end(), pose_out );
 }
 
 }
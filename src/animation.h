@@ -6,6 +6,9 @@
 
 namespace graphics101 {
 
+class ThreadPool;
+class FrameArena;
+
 /*
 We can express a transformation matrix as translation*rotation*scale.
 Interpolating transformation matrices is tricky.
@@ -27,6 +30,8 @@ struct TRS {
 typedef std::vector< TRS > TRSPose;
 // Convert from a TRSPose to a MatrixPose.
 MatrixPose MatrixPoseFromTRSPose( const TRSPose& pose );
+// The same for `num_bones` transformations, without allocating.
+void matrices_from_pose( const TRS* pose, int num_bones, mat4* matrices_out );
 
 struct BoneAnimation {
     // A bone animation stores a sequence of frames. Each frame is a pose.
@@ -52,25 +57,36 @@ Returns:
     `forward_kinematics( skeleton, MatrixPoseFromTRSPose( interpolate( animation, t ) ) )`
 */
 TRSPose interpolate( const BoneAnimation& animation, real t );
+// The same, storing the pose in `pose_out`, which has room for as many transformations
+// as each frame has, instead of allocating it.
+void interpolate( const BoneAnimation& animation, real t, TRS* pose_out );
 
 /// These two functions can be helpful when interpolating rotations.
 // Interpolate from axis*radians rotation `a` to `b` according to `t` in [0,1].
 vec3 slerp( const vec3& a, const vec3& b, real t );
 // Weighted average of axis*radians rotations.
 vec3 average_rotation( const std::vector< vec3 >& rotations, const std::vector< real >& weights );
+// The same for `count` rotations at a time, as when blending whole poses.
+// slerp() from a[i] to b[i] for each i.
+void slerp( const vec3* a, const vec3* b, real t, int count, vec3* result_out );
+// average_rotation() of each of `count` sets of weights.size() rotations, all with the same weights.
+// The i-th rotation of set j is rotations[ i*count + j ], as with j bones in each of i poses.
+// Its scratch memory comes from `arena`, so it doesn't allocate once the arena has grown.
+void average_rotations( const vec3* rotations, const std::vector< real >& weights, int count, FrameArena& arena, vec3* result_out );
 
 /*
 Given:
     path: A path to a BVH file
     skeleton_out: An output parameter skeleton_out in which to store the loaded Skeleton.
     animation_out: An output parameter animation_out in which to store the loaded BoneAnimation.
+    pool: An optional ThreadPool. If given, frames are decoded in parallel on its threads and this one.
 Returns:
     success: A boolean that is true if parsing completed successfully and false otherwise.
 
 The Skeleton will always store parents with smaller indices than children.
 This is suitable for passing to `forward_kinematics()`.
 */
-bool loadBVH( const std::string& path, Skeleton& skeleton_out, BoneAnimation& animation_out );
+bool loadBVH( const std::string& path, Skeleton& skeleton_out, BoneAnimation& animation_out, ThreadPool* pool = nullptr );
 
 }
 
@@ -1,12 +1,19 @@
 #include "animation.h"
+#include "quaternion.h"
+#include "mappedfile.h"
+#include "threadpool.h"
 
 #include <iostream>
-#include <fstream>
 #include <sstream>
 #include <set>
 
-#include <glm/ext/matrix_transform.hpp> // translate, rotate, scale
-#include <glm/gtx/matrix_interpolation.hpp> // axisAngle
+#include <algorithm> // search()
+#include <atomic>
+#include <chrono> // Measuring load times.
+#include <cstdint>
+#include <cstdlib> // strtod()
+#include <cstring> // memchr()
+#include <limits> // numeric_limits
 
 using namespace graphics101;
 
@@ -160,122 +167,292 @@ bool parseBVHHierarchy( std::istream& in, Skeleton& skeleton, std::vector< std::
     return true;
 }
 
+/// Scanning the MOTION block, which is almost all of a BVH file, straight from memory.
+
+bool is_space( char c ) { return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\v'; }
+bool is_digit( char c ) { return c >= '0' && c <= '9'; }
+
+const char* skip_space( const char* p, const char* end ) {
+    while( p != end && is_space( *p ) ) ++p;
+    return p;
+}
+
+// Returns the next whitespace-separated word and moves `p` past it.
+std::string next_word( const char*& p, const char* end ) {
+    p = skip_space( p, end );
+    const char* start = p;
+    while( p != end && !is_space( *p ) ) ++p;
+    return std::string( start, p );
+}
+
+/*
+Parses a decimal number like -12.5e-3 at `p`, moving `p` past it.
+Returns false if there isn't one.
+This is much faster than `istream >> real`, since it doesn't deal with locales or
+stream state. Numbers with up to 19 significant digits are converted with one
+multiplication or division by an exact power of ten. Longer ones go to strtod().
+*/
+bool parse_real( const char*& p, const char* end, real& value_out ) {
+    // Powers of ten that a double represents exactly.
+    static const double kPowersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    
+    const char* q = p;
+    bool negative = false;
+    if( q != end && ( *q == '-' || *q == '+' ) ) negative = ( *q++ == '-' );
+    
+    // Collect the significant digits as an integer, remembering where the decimal point goes.
+    std::uint64_t mantissa = 0;
+    int num_digits = 0;
+    int exponent = 0;
+    bool any_digits = false;
+    for( ; q != end && is_digit( *q ); ++q ) {
+        any_digits = true;
+        if( mantissa == 0 && *q == '0' ) continue;
+        if( num_digits < 19 ) mantissa = mantissa*10 + ( *q - '0' );
+        else ++exponent;
+        ++num_digits;
+    }
+    if( q != end && *q == '.' ) {
+        for( ++q; q != end && is_digit( *q ); ++q ) {
+            any_digits = true;
+            if( mantissa == 0 && *q == '0' ) { --exponent; continue; }
+            if( num_digits < 19 ) {
+                mantissa = mantissa*10 + ( *q - '0' );
+                --exponent;
+            }
+            ++num_digits;
+        }
+    }
+    if( !any_digits ) return false;
+    
+    if( q != end && ( *q == 'e' || *q == 'E' ) ) {
+        const char* e = q + 1;
+        bool negative_exponent = false;
+        if( e != end && ( *e == '-' || *e == '+' ) ) negative_exponent = ( *e++ == '-' );
+        if( e != end && is_digit( *e ) ) {
+            int written = 0;
+            for( ; e != end && is_digit( *e ); ++e ) written = std::min( written*10 + ( *e - '0' ), 100000 );
+            exponent += negative_exponent ? -written : written;
+            q = e;
+        }
+    }
+    
+    double value;
+    if( num_digits > 19 || exponent < -22 || exponent > 22 ) {
+        // Rare enough that it needn't be fast.
+        // strtod() wants a terminated string, and a number can't be that long in a BVH anyway.
+        const std::string text( p, std::min< std::size_t >( q - p, 512 ) );
+        value = std::strtod( text.c_str(), nullptr );
+        p = q;
+        value_out = real( value );
+        return true;
+    }
+    value = double( mantissa );
+    value = exponent < 0 ? value/kPowersOfTen[ -exponent ] : value*kPowersOfTen[ exponent ];
+    
+    p = q;
+    value_out = real( negative ? -value : value );
+    return true;
+}
+
 /*
     Given:
-        in: An istream
+        p, end: The characters of a MOTION block's frame data
+        num_values: How many numbers to read
+        values_out: Room for `num_values` numbers
+    Returns:
+        True if there were that many numbers and false otherwise.
+    
+    Moves `p` past the numbers.
+*/
+bool scan_reals( const char*& p, const char* end, std::size_t num_values, real* values_out ) {
+    for( std::size_t i = 0; i < num_values; ++i ) {
+        p = skip_space( p, end );
+        if( !parse_real( p, end, values_out[i] ) ) return false;
+        // A number has to end at whitespace or the end of the file.
+        if( p != end && !is_space( *p ) ) return false;
+    }
+    return true;
+}
+
+/*
+    Given:
+        skeleton: A Skeleton.
+        channels: The description of the channels.
+        values: One frame's channel values.
+        rotations: Scratch space for one quaternion per bone.
+        pose_out: Room for one TRS per bone.
+    
+    Each bone starts at its offset from its parent's endpoint.
+    Its channels are then applied in order, each one on the right of the
+    transformation so far. The rotation is kept as a quaternion throughout,
+    and only converted to axis*radians at the end.
+*/
+void pose_from_channels( const Skeleton& skeleton, const std::vector< std::pair< int, ChannelType > >& channels, const real* values, quat* rotations, TRS* pose_out ) {
+    const int num_bones = int( skeleton.size() );
+    for( int i = 0; i < num_bones; ++i ) {
+        const int parent_index = skeleton[i].parent_index;
+        rotations[i] = quat( 1, 0, 0, 0 );
+        pose_out[i] = TRS();
+        if( parent_index != -1 ) pose_out[i].translation = skeleton[i].end - skeleton[ parent_index ].end;
+    }
+    
+    for( std::size_t c = 0; c < channels.size(); ++c ) {
+        const int bone = channels[c].first;
+        const real param = values[c];
+        
+        // A translation on the right is rotated by the rotation so far.
+        // A rotation on the right composes with it.
+        vec3& translation = pose_out[bone].translation;
+        quat& rotation = rotations[bone];
+        const real half = glm::radians( param )/2;
+        switch( channels[c].second ) {
+            case Xposition: translation += rotation*vec3( param, 0, 0 ); break;
+            case Yposition: translation += rotation*vec3( 0, param, 0 ); break;
+            case Zposition: translation += rotation*vec3( 0, 0, param ); break;
+            case Xrotation: rotation = rotation*quat( std::cos( half ), std::sin( half ), 0, 0 ); break;
+            case Yrotation: rotation = rotation*quat( std::cos( half ), 0, std::sin( half ), 0 ); break;
+            case Zrotation: rotation = rotation*quat( std::cos( half ), 0, 0, std::sin( half ) ); break;
+            default: std::cerr << "ERROR: Unknown channel type.\n"; break;
+        }
+    }
+    
+    for( int i = 0; i < num_bones; ++i ) pose_out[i].rotation = axis_angle_from_quat( rotations[i] );
+}
+
+/*
+    Given:
+        p, end: The characters after the Frame Time: line to the end of the file.
+        skeleton: A Skeleton.
+        channels: The description of the channels.
+        num_frames: The number of frames.
+        pool: A ThreadPool.
+        animation: An output parameter for the animation's frames.
+    Returns:
+        True if every frame is on a line by itself and was read successfully, and false otherwise.
+    
+    Every frame is independent once we know where its line starts, so we find
+    the line starts with one quick pass and then decode chunks of frames on
+    `pool`'s threads (and this one), each straight into its slot in `animation.frames`.
+    The frames are the same, bit for bit, as parseBVHAnimation() decoding serially.
+    It doesn't print errors, since the caller falls back to the serial parser, which does.
+*/
+bool parseBVHFramesParallel( const char* p, const char* end, const Skeleton& skeleton, const std::vector< std::pair< int, ChannelType > >& channels, int num_frames, ThreadPool& pool, BoneAnimation& animation ) {
+    // The start of each non-blank line, followed by where the next one starts or the end.
+    std::vector< const char* > lines;
+    lines.reserve( std::size_t( num_frames ) + 1 );
+    for( const char* line = p; line != end && int( lines.size() ) < num_frames; ) {
+        const char* newline = static_cast< const char* >( std::memchr( line, '\n', end - line ) );
+        const char* line_end = newline ? newline : end;
+        if( skip_space( line, line_end ) != line_end ) lines.push_back( line );
+        line = newline ? newline + 1 : end;
+    }
+    // Frames may wrap across lines. Leave that to the serial parser.
+    if( int( lines.size() ) < num_frames ) return false;
+    lines.push_back( end );
+    
+    // Enough frames per chunk that taking the next one is rare.
+    const int kFramesPerChunk = 256;
+    const int num_chunks = ( num_frames + kFramesPerChunk - 1 )/kFramesPerChunk;
+    const int num_bones = int( skeleton.size() );
+    const std::size_t num_channels = channels.size();
+    std::atomic< bool > success( true );
+    
+    animation.frames.resize( num_frames );
+    pool.parallelFor( num_chunks, [&]( int chunk ) {
+        std::vector< real > values( num_channels );
+        std::vector< quat > rotations( num_bones );
+        const int frame_end = std::min( ( chunk + 1 )*kFramesPerChunk, num_frames );
+        for( int frame = chunk*kFramesPerChunk; frame < frame_end && success; ++frame ) {
+            // The line must hold exactly one frame's numbers.
+            const char* q = lines[ frame ];
+            const char* line_end = lines[ frame + 1 ];
+            if( !scan_reals( q, line_end, num_channels, values.data() ) || skip_space( q, line_end ) != line_end ) {
+                success = false;
+                return;
+            }
+            
+            // Allocating here spreads the allocations across threads, too.
+            animation.frames[ frame ].resize( num_bones );
+            pose_from_channels( skeleton, channels, values.data(), rotations.data(), animation.frames[ frame ].data() );
+        }
+    } );
+    
+    return success;
+}
+
+/*
+    Given:
+        p, end: The characters from the MOTION keyword to the end of the file.
         skeleton: A Skeleton.
         channels: The description of the channels.
+        pool: A ThreadPool to decode frames in parallel, or nullptr to decode them on this thread.
         animation: An output parameter for the animation.
     Returns:
         True if the parse was successful and false otherwise.
     
     This function calls `.clear()` on the animation.
 */
-bool parseBVHAnimation( std::istream& in, const Skeleton& skeleton, const std::vector< std::pair< int, ChannelType > >& channels, BoneAnimation& animation ) {
+bool parseBVHAnimation( const char* p, const char* end, const Skeleton& skeleton, const std::vector< std::pair< int, ChannelType > >& channels, ThreadPool* pool, BoneAnimation& animation ) {
     using namespace std;
     
     animation.clear();
     
-    if( !( next( in ) == "MOTION" ) ) {
+    if( !( next_word( p, end ) == "MOTION" ) ) {
         cerr << "ERROR: Expected keyword MOTION.\n";
         return false;
     }
     
-    if( !( next( in ) == "Frames:" ) ) {
+    if( !( next_word( p, end ) == "Frames:" ) ) {
         cerr << "ERROR: Expected keyword Frames:.\n";
         return false;
     }
-    int num_frames(-1);
-    in >> num_frames;
-    if( !in || num_frames < 0 ) {
+    real frames_value = -1;
+    p = skip_space( p, end );
+    if( !parse_real( p, end, frames_value ) || frames_value < 0 || frames_value >= real( numeric_limits< int >::max() ) || frames_value != int( frames_value ) ) {
         cerr << "ERROR: Could not read number of frames.\n";
         return false;
     }
-    animation.frames.reserve( num_frames );
+    const int num_frames = int( frames_value );
     
-    if( !( next( in ) == "Frame" && next( in ) == "Time:" ) ) {
+    if( !( next_word( p, end ) == "Frame" && next_word( p, end ) == "Time:" ) ) {
         cerr << "ERROR: Expected keyword Frame Time:.\n";
         return false;
     }
-    in >> animation.seconds_per_frame;
-    if( !in ) {
+    p = skip_space( p, end );
+    if( !parse_real( p, end, animation.seconds_per_frame ) ) {
         cerr << "ERROR: Could not read seconds per frame.\n";
         return false;
     }
     
-    for( int i = 0; i < num_frames; ++i ) {
-        // Initialize each transform in the pose as the identity matrix.
-        MatrixPose pose( skeleton.size(), mat4(1) );
-        // Set the translation to its offset from its parent's endpoint.
-        for( int i = 0; i < pose.size(); ++i ) {
-            const int parent_index = skeleton.at(i).parent_index;
-            if( parent_index != -1 ) {
-                const vec3 off = skeleton.at(i).end - skeleton.at( parent_index ).end;
-                pose.at(i)[3] = vec4( off, 1 );
-            }
-        }
-        
-        for( const auto& ch : channels ) {
-            real param;
-            in >> param;
-            if( !in ) {
-                cerr << "ERROR: Could not read channel parameter.\n";
-                return false;
-            }
-            
-            // A reference, because we will modify it.
-            mat4& xform = pose.at(ch.first);
-            switch( ch.second ) {
-                case Xposition:
-                    /// Build the new operation `op`. Then multiply it on the right
-                    /// of the operation so-far:
-                    // pose.at(ch.first) = pose.at(ch.first)*op;
-                    
-                    /// Use glm functions.
-                    // pose.at(ch.first) = translate( pose.at(ch.first), vec3(param,0,0) );
-                    xform = glm::translate( xform, vec3(param,0,0) );
-                    break;
-                case Yposition:
-                    xform = glm::translate( xform, vec3(0,param,0) );
-                    break;
-                case Zposition:
-                    xform = glm::translate( xform, vec3(0,0,param) );
-                    break;
-                case Xrotation:
-                    xform = glm::rotate( xform, glm::radians(param), vec3(1,0,0) );
-                    break;
-                case Yrotation:
-                    xform = glm::rotate( xform, glm::radians(param), vec3(0,1,0) );
-                    break;
-                case Zrotation:
-                    xform = glm::rotate( xform, glm::radians(param), vec3(0,0,1) );
-                    break;
-                default:
-                    cerr << "ERROR: Unknown channel type.\n";
-                    break;
-            }
-        }
-        
-        // Convert the MatrixPose to a TRSPose.
-        TRSPose decomposed( skeleton.size() );
-        assert( decomposed.size() == pose.size() );
-        for( int i = 0; i < decomposed.size(); ++i ) {
-            const mat4& M = pose.at(i);
-            // Extract the translation.
-            decomposed.at(i).translation = vec3(M[3]);
-            // There is no scale. That means the first three columns of M should be normalized.
-            assert( fabs( length(M[0]) - 1 ) < 1e-5 );
-            assert( fabs( length(M[1]) - 1 ) < 1e-5 );
-            assert( fabs( length(M[2]) - 1 ) < 1e-5 );
-            // Extract the rotation as radians*axis.
-            vec3 axis;
-            real angle;
-            // "If a larger matrix is constructed from a smaller matrix, the additional
-            // rows and columns are set to the values they would have in an identity matrix."
-            glm::axisAngle( mat4(mat3(M)), axis, angle );
-            decomposed.at(i).rotation = angle*axis;
-        }
-        animation.frames.push_back( decomposed );
+    // Every value takes at least one character, so a file can't hold more frames than this.
+    // Checking first keeps a bad Frames: line from making us allocate for them.
+    const std::size_t num_channels = channels.size();
+    const std::size_t max_frames = std::size_t( end - p )/std::max< std::size_t >( num_channels, 1 );
+    if( std::size_t( num_frames ) > max_frames ) {
+        cerr << "ERROR: The file is too short for its " << num_frames << " frames.\n";
+        return false;
+    }
+    
+    if( pool ) {
+        if( parseBVHFramesParallel( p, end, skeleton, channels, num_frames, *pool, animation ) ) return true;
+        animation.frames.clear();
+    }
+    
+    // Read every channel of every frame into one big matrix, then convert each frame.
+    std::vector< real > values( std::size_t( num_frames )*num_channels );
+    if( !scan_reals( p, end, values.size(), values.data() ) ) {
+        cerr << "ERROR: Could not read channel parameter.\n";
+        return false;
+    }
+    
+    animation.frames.assign( num_frames, TRSPose( skeleton.size() ) );
+    std::vector< quat > rotations( skeleton.size() );
+    for( int frame = 0; frame < num_frames; ++frame ) {
+        pose_from_channels( skeleton, channels, values.data() + frame*num_channels, rotations.data(), animation.frames[frame].data() );
     }
     
     return true;
@@ -284,39 +461,54 @@ bool parseBVHAnimation( std::istream& in, const Skeleton& skeleton, const std::v
 
 namespace graphics101 {
 // BVH format: https://research.cs.wisc.edu/graphics/Courses/cs-838-1999/Jeff/BVH.html
-bool loadBVH( const std::string& path, Skeleton& skeleton, BoneAnimation& animation ) {
+bool loadBVH( const std::string& path, Skeleton& skeleton, BoneAnimation& animation, ThreadPool* pool ) {
     using namespace std;
     
+    const auto start = chrono::steady_clock::now();
+    
     // Clear the input.
     skeleton.clear();
     animation.clear();
     
-    // Open the file.
-    ifstream bvh( path );
-    if( !bvh ) {
+    // Map the file.
+    std::size_t size = 0;
+    const std::shared_ptr< const unsigned char > data = map_file( path, size );
+    if( !data ) {
         cerr << "ERROR: loadBVH() is unable to access path: " << path << '\n';
         return false;
     }
+    const char* begin = reinterpret_cast< const char* >( data.get() );
+    const char* end = begin + size;
     
-    // We're not going to do a line-oriented parser this time:
-    /*
-    int lineno = 1;
-    string line;
-    // getline() does not include the newline.
-    do { getline( bvh >> ws, line ); lineno+=1; } while( line.empty() );
-    */
+    // The HIERARCHY is short, so stream it. The MOTION keyword ends it.
+    const char* motion = begin;
+    while( true ) {
+        motion = std::search( motion, end, "MOTION", "MOTION" + 6 );
+        if( motion == end ) break;
+        // It must be a word by itself.
+        if( ( motion == begin || is_space( motion[-1] ) ) && ( motion + 6 == end || is_space( motion[6] ) ) ) break;
+        ++motion;
+    }
     
     std::vector< std::pair< int, ChannelType > > channels;
-    if( !parseBVHHierarchy( bvh, skeleton, channels ) ) {
+    istringstream hierarchy( string( begin, motion ) );
+    if( !parseBVHHierarchy( hierarchy, skeleton, channels ) ) {
         cerr << "ERROR: Could not parse BVH hierarchy in file: " << path << '\n';
         return false;
     }
     
-    if( !parseBVHAnimation( bvh, skeleton, channels, animation ) ) {
+    if( !parseBVHAnimation( motion, end, skeleton, channels, pool, animation ) ) {
         cerr << "ERROR: Could not parse BVH animation in file: " << path << '\n';
         return false;
     }
     
+    const double seconds = chrono::duration< double >( chrono::steady_clock::now() - start ).count();
+    const int num_threads = pool ? pool->size() + 1 : 1;
+    cerr << "Loaded " << animation.frames.size() << " frames of " << skeleton.size() << " bones from " << path
+         << " in " << 1000*seconds << " ms (" << size/( 1024.*1024. )/seconds << " MB/s, "
+         << animation.frames.size()/seconds << " frames/s) with " << num_threads << ( num_threads == 1 ? " thread.\n" : " threads.\n" );
+    
     return true;
 }
+
 }
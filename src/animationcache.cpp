@@ -0,0 +1,536 @@
+#include "animationcache.h"
+
+#include "hashing.h"
+#include "mappedfile.h"
+
+#include <algorithm> // equal()
+#include <chrono> // Measuring load times.
+#include <cstdint>
+#include <cstdio> // rename(), remove()
+#include <cstring> // memcpy()
+#include <fstream>
+#include <iomanip> // setw(), setfill()
+#include <limits> // numeric_limits
+#include <sstream>
+#include <iostream>
+using std::cerr;
+
+namespace {
+using namespace graphics101;
+
+/*
+The compiled animation cache file is:
+    AnimationFileHeader
+    the source path (header.path_length bytes)
+    header.num_bones BoneRecords
+    the bone names, one after the other
+    the tracks, each header.num_frames*header.num_bones long and starting on a multiple of kTrackAlignment:
+        translations (3 reals each)
+        rotations as quaternions (4 reals each, in glm's order)
+        rotations as axis*radians, as loadBVH() returned them (3 reals each)
+        scales (3 reals each)
+The tracks are laid out like CompiledAnimation's, so a CompiledAnimation can point right into the mapped file.
+Change the last character of kMagic when the layout changes.
+*/
+const char kMagic[8] = { 'G','1','0','1','A','N','M','2' };
+struct AnimationFileHeader {
+    char magic[8];
+    // The source file this was compiled from.
+    std::uint64_t source_size;
+    std::int64_t source_mtime;
+    std::uint32_t path_length;
+    // So that float and double builds don't read each other's files.
+    std::uint32_t real_size;
+    // Which of a quaternion's reals is w, since glm can be configured to store it first or last.
+    std::uint32_t quat_w_index;
+    std::uint32_t num_bones;
+    std::uint32_t num_frames;
+    std::uint32_t unused;
+    double seconds_per_frame;
+};
+struct BoneRecord {
+    real end[3];
+    std::int32_t parent_index;
+    std::uint32_t name_length;
+};
+/*
+The compressed animation cache file is:
+    CompressedFileHeader
+    the source path (header.path_length bytes)
+    header.num_bones BoneRecords
+    the bone names, one after the other
+    the translation, rotation, and scale CompressedChannels, each:
+        the sizes of its begin, frames, and block_keys arrays (3 uint64s)
+        begin, frames, keys (as many as frames), and block_keys, one after the other
+It's read into vectors rather than sampled in place, since it's small.
+Change the last character of kCompressedMagic when the layout changes.
+*/
+const char kCompressedMagic[8] = { 'G','1','0','1','A','N','Z','1' };
+struct CompressedFileHeader {
+    char magic[8];
+    std::uint64_t source_size;
+    std::int64_t source_mtime;
+    std::uint32_t path_length;
+    std::uint32_t real_size;
+    std::uint32_t num_bones;
+    std::uint32_t num_frames;
+    double seconds_per_frame;
+    // The CompressionSettings it was compressed with. A file compressed with others is stale.
+    double tolerance;
+    double shell_distance;
+    // What compress_animation() reported.
+    double max_error;
+};
+// Tracks start on a multiple of this.
+const std::uint64_t kTrackAlignment = 16;
+
+static_assert( sizeof( vec3 ) == 3*sizeof( real ), "vec3 tracks are mapped as arrays of reals." );
+static_assert( sizeof( quat ) == 4*sizeof( real ), "quat tracks are mapped as arrays of reals." );
+
+std::uint32_t quat_w_index() {
+    const quat identity( 1, 0, 0, 0 );
+    const real* reals = reinterpret_cast< const real* >( &identity );
+    return reals[0] == 1 ? 0 : 3;
+}
+
+std::uint64_t align_track( std::uint64_t offset ) {
+    return ( offset + kTrackAlignment - 1 ) / kTrackAlignment * kTrackAlignment;
+}
+
+// Where each track starts, given where the bone names end.
+// Check that the tracks can fit in the file before computing these, so they can't overflow.
+struct TrackOffsets {
+    std::uint64_t translations;
+    std::uint64_t rotations;
+    std::uint64_t axis_angles;
+    std::uint64_t scales;
+    std::uint64_t end;
+    
+    TrackOffsets( std::uint64_t names_end, std::uint64_t num_values ) {
+        translations = align_track( names_end );
+        rotations = align_track( translations + num_values*3*sizeof( real ) );
+        axis_angles = align_track( rotations + num_values*4*sizeof( real ) );
+        scales = align_track( axis_angles + num_values*3*sizeof( real ) );
+        end = scales + num_values*3*sizeof( real );
+    }
+};
+// All four tracks take this many bytes per value.
+const std::uint64_t kTrackBytesPerValue = ( 3 + 4 + 3 + 3 )*sizeof( real );
+
+double milliseconds_since( const std::chrono::steady_clock::time_point& start ) {
+    return std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+}
+
+std::string cache_path( const std::string& cache_directory, const std::string& path, const char* extension ) {
+    const std::uint64_t hash = fnv1a( path.data(), path.size() );
+    
+    std::ostringstream name;
+    name << std::hex << std::setw( 16 ) << std::setfill( '0' ) << hash;
+    return cache_directory + '/' + name.str() + extension;
+}
+
+// Reads `num_bones` BoneRecords at `offset` and the names after them, and moves `offset` past them.
+// Returns false if they don't fit in the file or the parents aren't in order.
+bool read_skeleton( const unsigned char* bytes, std::uint64_t size, std::uint64_t& offset, std::uint32_t num_bones, Skeleton& skeleton ) {
+    if( num_bones > ( size - offset )/sizeof( BoneRecord ) ) return false;
+    
+    skeleton.resize( num_bones );
+    std::uint64_t names_offset = offset + std::uint64_t( num_bones )*sizeof( BoneRecord );
+    for( int i = 0; i < int( num_bones ); ++i ) {
+        BoneRecord record;
+        std::memcpy( &record, bytes + offset, sizeof( record ) );
+        offset += sizeof( record );
+        
+        // forward_kinematics() and friends rely on parents coming before their children.
+        if( record.parent_index < -1 || record.parent_index >= i ) return false;
+        if( size - names_offset < record.name_length ) return false;
+        Bone& bone = skeleton[i];
+        bone.end = vec3( record.end[0], record.end[1], record.end[2] );
+        bone.parent_index = record.parent_index;
+        bone.name.assign( reinterpret_cast< const char* >( bytes ) + names_offset, record.name_length );
+        names_offset += record.name_length;
+    }
+    offset = names_offset;
+    return true;
+}
+
+// Returns false if there is no up-to-date cache file.
+// `animation` and `compiled` may be null if they aren't wanted.
+// The compiled animation keeps the file mapped and samples it in place.
+bool load_cached( const std::string& file, const std::string& path, std::uint64_t source_size, std::int64_t source_mtime, Skeleton& skeleton, BoneAnimation* animation, CompiledAnimation* compiled ) {
+    std::size_t size = 0;
+    std::shared_ptr< const unsigned char > data = map_file( file, size );
+    // Not an error. It just hasn't been saved yet.
+    if( !data ) return false;
+    const unsigned char* bytes = data.get();
+    
+    AnimationFileHeader header;
+    if( size < sizeof( header ) ) return false;
+    std::memcpy( &header, bytes, sizeof( header ) );
+    if( !std::equal( kMagic, kMagic + sizeof( kMagic ), header.magic ) ) return false;
+    if( header.real_size != sizeof( real ) || header.quat_w_index != quat_w_index() ) return false;
+    // Out-of-date?
+    if( header.source_size != source_size || header.source_mtime != source_mtime ) return false;
+    // A different file with the same hash?
+    std::uint64_t offset = sizeof( header );
+    if( size - offset < header.path_length ) return false;
+    if( std::string( reinterpret_cast< const char* >( bytes ) + offset, header.path_length ) != path ) return false;
+    offset += header.path_length;
+    
+    // Everything after this is damage, not staleness, so say so.
+    const auto damaged = [&]() {
+        cerr << "ERROR: Ignoring damaged compiled animation cache file: " << file << '\n';
+        return false;
+    };
+    if( header.num_frames > std::uint32_t( std::numeric_limits< int >::max() ) ) return damaged();
+    if( !( header.seconds_per_frame > 0 ) ) return damaged();
+    
+    Skeleton loaded_skeleton;
+    if( !read_skeleton( bytes, size, offset, header.num_bones, loaded_skeleton ) ) return damaged();
+    const int num_bones = header.num_bones;
+    const int num_frames = header.num_frames;
+    
+    // Make sure the tracks can fit before computing where they are, so nothing overflows.
+    const std::uint64_t num_values = std::uint64_t( num_frames )*num_bones;
+    if( num_values > ( size - offset )/kTrackBytesPerValue ) return damaged();
+    const TrackOffsets tracks( offset, num_values );
+    if( size < tracks.end ) return damaged();
+    
+    const real seconds_per_frame = real( header.seconds_per_frame );
+    const vec3* translations = reinterpret_cast< const vec3* >( bytes + tracks.translations );
+    const vec3* scales = reinterpret_cast< const vec3* >( bytes + tracks.scales );
+    
+    if( compiled ) {
+        compiled->num_bones = num_bones;
+        compiled->num_frames = num_frames;
+        compiled->seconds_per_frame = seconds_per_frame;
+        compiled->translations = translations;
+        compiled->rotations = reinterpret_cast< const quat* >( bytes + tracks.rotations );
+        compiled->scales = scales;
+        compiled->storage = data;
+    }
+    
+    if( animation ) {
+        const vec3* axis_angles = reinterpret_cast< const vec3* >( bytes + tracks.axis_angles );
+        animation->clear();
+        animation->seconds_per_frame = seconds_per_frame;
+        animation->frames.resize( num_frames );
+        for( int frame = 0; frame < num_frames; ++frame ) {
+            TRSPose& pose = animation->frames[ frame ];
+            pose.resize( num_bones );
+            for( int bone = 0; bone < num_bones; ++bone ) {
+                const std::uint64_t i = std::uint64_t( frame )*num_bones + bone;
+                pose[ bone ].translation = translations[i];
+                pose[ bone ].rotation = axis_angles[i];
+                pose[ bone ].scale = scales[i];
+            }
+        }
+    }
+    
+    skeleton.swap( loaded_skeleton );
+    return true;
+}
+
+template< typename T >
+void write_pod( std::ostream& out, const T& value ) {
+    out.write( reinterpret_cast< const char* >( &value ), sizeof( T ) );
+}
+
+// Writes what read_skeleton() reads.
+void write_skeleton( std::ostream& out, const Skeleton& skeleton ) {
+    for( const auto& bone : skeleton ) {
+        BoneRecord record;
+        record.end[0] = bone.end.x;
+        record.end[1] = bone.end.y;
+        record.end[2] = bone.end.z;
+        record.parent_index = bone.parent_index;
+        record.name_length = bone.name.size();
+        write_pod( out, record );
+    }
+    for( const auto& bone : skeleton ) out.write( bone.name.data(), bone.name.size() );
+}
+
+// Calls write( out ) to write `file`.
+template< typename Write >
+void save_file( const std::string& file, Write write ) {
+    // Write to a temporary file and rename it, so that nobody maps a half-written file.
+    // Another instance may be saving the same file at the same time, so each writes its own.
+    const std::string temporary = unique_temporary_path( file );
+    {
+        std::ofstream out( temporary, std::ios::binary );
+        if( !out ) {
+            cerr << "ERROR: Could not open file for writing: " << temporary << '\n';
+            return;
+        }
+        
+        write( out );
+        
+        if( !out ) {
+            cerr << "ERROR: Could not write animation cache file: " << temporary << '\n';
+            out.close();
+            std::remove( temporary.c_str() );
+            return;
+        }
+    }
+    
+    // rename() won't replace an existing file on Windows.
+    std::remove( file.c_str() );
+    if( std::rename( temporary.c_str(), file.c_str() ) != 0 ) {
+        cerr << "ERROR: Could not rename " << temporary << " to " << file << '\n';
+        std::remove( temporary.c_str() );
+    }
+}
+
+void save_cached( const std::string& file, const std::string& path, std::uint64_t source_size, std::int64_t source_mtime, const Skeleton& skeleton, const BoneAnimation& animation, const CompiledAnimation& compiled ) {
+    save_file( file, [&]( std::ostream& out ) {
+        AnimationFileHeader header;
+        std::copy( kMagic, kMagic + sizeof( kMagic ), header.magic );
+        header.source_size = source_size;
+        header.source_mtime = source_mtime;
+        header.path_length = path.size();
+        header.real_size = sizeof( real );
+        header.quat_w_index = quat_w_index();
+        header.num_bones = compiled.num_bones;
+        header.num_frames = compiled.num_frames;
+        header.unused = 0;
+        header.seconds_per_frame = compiled.seconds_per_frame;
+        write_pod( out, header );
+        out.write( path.data(), path.size() );
+        
+        write_skeleton( out, skeleton );
+        
+        const std::uint64_t num_values = compiled.numValues();
+        const TrackOffsets tracks( std::uint64_t( out.tellp() ), num_values );
+        const auto pad_to = [&]( std::uint64_t offset ) { while( std::uint64_t( out.tellp() ) < offset ) out.put( 0 ); };
+        
+        pad_to( tracks.translations );
+        out.write( reinterpret_cast< const char* >( compiled.translations ), num_values*sizeof( vec3 ) );
+        pad_to( tracks.rotations );
+        out.write( reinterpret_cast< const char* >( compiled.rotations ), num_values*sizeof( quat ) );
+        pad_to( tracks.axis_angles );
+        for( const auto& pose : animation.frames ) {
+            for( const auto& trs : pose ) write_pod( out, trs.rotation );
+        }
+        pad_to( tracks.scales );
+        out.write( reinterpret_cast< const char* >( compiled.scales ), num_values*sizeof( vec3 ) );
+    } );
+}
+
+template< typename T >
+void write_array( std::ostream& out, const std::vector< T >& values ) {
+    out.write( reinterpret_cast< const char* >( values.data() ), values.size()*sizeof( T ) );
+}
+
+// Reads `count` Ts at `offset` into `values` and moves `offset` past them.
+// Returns false if they don't fit in the file.
+template< typename T >
+bool read_array( const unsigned char* bytes, std::uint64_t size, std::uint64_t& offset, std::uint64_t count, std::vector< T >& values ) {
+    if( count > ( size - offset )/sizeof( T ) ) return false;
+    values.resize( count );
+    if( count > 0 ) std::memcpy( values.data(), bytes + offset, count*sizeof( T ) );
+    offset += count*sizeof( T );
+    return true;
+}
+
+template< typename Key >
+void write_channel( std::ostream& out, const CompressedChannel< Key >& channel ) {
+    write_pod( out, std::uint64_t( channel.begin.size() ) );
+    write_pod( out, std::uint64_t( channel.frames.size() ) );
+    write_pod( out, std::uint64_t( channel.block_keys.size() ) );
+    write_array( out, channel.begin );
+    write_array( out, channel.frames );
+    write_array( out, channel.keys );
+    write_array( out, channel.block_keys );
+}
+
+// Reads what write_channel() wrote at `offset` and moves `offset` past it.
+// Returns false unless it fits in the file and sample_animation() can safely use it.
+template< typename Key >
+bool read_channel( const unsigned char* bytes, std::uint64_t size, std::uint64_t& offset, std::uint32_t num_bones, std::uint32_t num_frames, CompressedChannel< Key >& channel ) {
+    std::uint64_t counts[3];
+    if( size - offset < sizeof( counts ) ) return false;
+    std::memcpy( counts, bytes + offset, sizeof( counts ) );
+    offset += sizeof( counts );
+    
+    if( !read_array( bytes, size, offset, counts[0], channel.begin ) ) return false;
+    if( !read_array( bytes, size, offset, counts[1], channel.frames ) ) return false;
+    if( !read_array( bytes, size, offset, counts[1], channel.keys ) ) return false;
+    if( !read_array( bytes, size, offset, counts[2], channel.block_keys ) ) return false;
+    
+    // Every bone has keys at the first and last frame, in order.
+    if( channel.begin.size() != std::uint64_t( num_bones ) + 1 ) return false;
+    if( channel.begin.front() != 0 || channel.begin.back() != channel.frames.size() ) return false;
+    for( std::uint32_t bone = 0; bone < num_bones; ++bone ) {
+        const std::uint32_t first = channel.begin[ bone ];
+        const std::uint32_t end = channel.begin[ bone + 1 ];
+        if( end <= first || end > channel.frames.size() ) return false;
+        if( channel.frames[ first ] != 0 || channel.frames[ end - 1 ] != num_frames - 1 ) return false;
+        for( std::uint32_t key = first + 1; key < end; ++key ) {
+            if( channel.frames[ key ] <= channel.frames[ key - 1 ] ) return false;
+        }
+    }
+    
+    // Each block's keys belong to their bone and don't go backwards.
+    const std::uint64_t frames_per_block = CompressedChannel< Key >::kFramesPerBlock;
+    const std::uint64_t num_blocks = ( std::uint64_t( num_frames ) + frames_per_block - 1 )/frames_per_block;
+    if( channel.block_keys.size() != num_blocks*num_bones ) return false;
+    for( std::uint64_t block = 0; block < num_blocks; ++block ) {
+        for( std::uint32_t bone = 0; bone < num_bones; ++bone ) {
+            const std::uint32_t key = channel.block_keys[ block*num_bones + bone ];
+            const std::uint32_t first = block == 0 ? channel.begin[ bone ] : channel.block_keys[ ( block - 1 )*num_bones + bone ];
+            if( key < first || key >= channel.begin[ bone + 1 ] ) return false;
+        }
+    }
+    
+    return true;
+}
+
+// Like load_cached(), but for a compressed animation compressed with `settings`.
+bool load_compressed_cached( const std::string& file, const std::string& path, std::uint64_t source_size, std::int64_t source_mtime, const CompressionSettings& settings, Skeleton& skeleton, CompressedAnimation& compressed, real* max_error ) {
+    std::size_t size = 0;
+    std::shared_ptr< const unsigned char > data = map_file( file, size );
+    // Not an error. It just hasn't been saved yet.
+    if( !data ) return false;
+    const unsigned char* bytes = data.get();
+    
+    CompressedFileHeader header;
+    if( size < sizeof( header ) ) return false;
+    std::memcpy( &header, bytes, sizeof( header ) );
+    if( !std::equal( kCompressedMagic, kCompressedMagic + sizeof( kCompressedMagic ), header.magic ) ) return false;
+    if( header.real_size != sizeof( real ) ) return false;
+    // Out-of-date?
+    if( header.source_size != source_size || header.source_mtime != source_mtime ) return false;
+    if( header.tolerance != double( settings.tolerance ) || header.shell_distance != double( settings.shell_distance ) ) return false;
+    // A different file with the same hash?
+    std::uint64_t offset = sizeof( header );
+    if( size - offset < header.path_length ) return false;
+    if( std::string( reinterpret_cast< const char* >( bytes ) + offset, header.path_length ) != path ) return false;
+    offset += header.path_length;
+    
+    // Everything after this is damage, not staleness, so say so.
+    const auto damaged = [&]() {
+        cerr << "ERROR: Ignoring damaged compressed animation cache file: " << file << '\n';
+        return false;
+    };
+    if( header.num_frames == 0 || header.num_frames > std::uint32_t( std::numeric_limits< int >::max() ) ) return damaged();
+    if( !( header.seconds_per_frame > 0 ) ) return damaged();
+    
+    Skeleton loaded_skeleton;
+    if( !read_skeleton( bytes, size, offset, header.num_bones, loaded_skeleton ) ) return damaged();
+    
+    CompressedAnimation loaded;
+    loaded.num_bones = header.num_bones;
+    loaded.num_frames = header.num_frames;
+    loaded.seconds_per_frame = real( header.seconds_per_frame );
+    if( !read_channel( bytes, size, offset, header.num_bones, header.num_frames, loaded.translations ) ) return damaged();
+    if( !read_channel( bytes, size, offset, header.num_bones, header.num_frames, loaded.rotations ) ) return damaged();
+    if( !read_channel( bytes, size, offset, header.num_bones, header.num_frames, loaded.scales ) ) return damaged();
+    
+    skeleton.swap( loaded_skeleton );
+    compressed = std::move( loaded );
+    if( max_error ) *max_error = real( header.max_error );
+    return true;
+}
+
+void save_compressed_cached( const std::string& file, const std::string& path, std::uint64_t source_size, std::int64_t source_mtime, const CompressionSettings& settings, const Skeleton& skeleton, const CompressedAnimation& compressed, real max_error ) {
+    save_file( file, [&]( std::ostream& out ) {
+        CompressedFileHeader header;
+        std::copy( kCompressedMagic, kCompressedMagic + sizeof( kCompressedMagic ), header.magic );
+        header.source_size = source_size;
+        header.source_mtime = source_mtime;
+        header.path_length = path.size();
+        header.real_size = sizeof( real );
+        header.num_bones = compressed.num_bones;
+        header.num_frames = compressed.num_frames;
+        header.seconds_per_frame = compressed.seconds_per_frame;
+        header.tolerance = settings.tolerance;
+        header.shell_distance = settings.shell_distance;
+        header.max_error = max_error;
+        write_pod( out, header );
+        out.write( path.data(), path.size() );
+        
+        write_skeleton( out, skeleton );
+        
+        write_channel( out, compressed.translations );
+        write_channel( out, compressed.rotations );
+        write_channel( out, compressed.scales );
+    } );
+}
+}
+
+namespace graphics101 {
+
+bool load_animation( const std::string& path, const std::string& cache_directory, Skeleton& skeleton_out, BoneAnimation* animation_out, CompiledAnimation* compiled_out, ThreadPool* pool ) {
+    const auto start = std::chrono::steady_clock::now();
+    
+    skeleton_out.clear();
+    if( animation_out ) animation_out->clear();
+    if( compiled_out ) compiled_out->clear();
+    
+    // loadBVH() always makes a BoneAnimation, even if the caller only wants it compiled.
+    BoneAnimation parsed;
+    BoneAnimation& animation = animation_out ? *animation_out : parsed;
+    const auto load = [&]() {
+        if( !loadBVH( path, skeleton_out, animation, pool ) ) return false;
+        if( compiled_out ) *compiled_out = compile_animation( animation );
+        return true;
+    };
+    
+    if( cache_directory.empty() ) return load();
+    
+    std::uint64_t source_size = 0;
+    std::int64_t source_mtime = 0;
+    // loadBVH() will report the problem.
+    if( !stat_path( path, source_size, source_mtime ) ) return load();
+    
+    const std::string file = cache_path( cache_directory, path, ".glanim" );
+    if( load_cached( file, path, source_size, source_mtime, skeleton_out, animation_out, compiled_out ) ) {
+        cerr << "Loaded compiled animation " << file << " for " << path << " in " << milliseconds_since( start ) << " ms.\n";
+        return true;
+    }
+    
+    if( !load() ) return false;
+    // The file always holds the compiled tracks, whichever the caller wanted.
+    save_cached( file, path, source_size, source_mtime, skeleton_out, animation, compiled_out ? *compiled_out : compile_animation( animation ) );
+    cerr << "Loaded " << path << " and saved its compiled animation in " << milliseconds_since( start ) << " ms.\n";
+    return true;
+}
+
+bool load_compressed_animation( const std::string& path, const std::string& cache_directory, const CompressionSettings& settings, Skeleton& skeleton_out, CompressedAnimation& compressed_out, real* max_error_out, ThreadPool* pool ) {
+    const auto start = std::chrono::steady_clock::now();
+    
+    skeleton_out.clear();
+    compressed_out.clear();
+    
+    std::uint64_t source_size = 0;
+    std::int64_t source_mtime = 0;
+    // If there's no cache or no file, load_animation() will handle it.
+    const bool cached = !cache_directory.empty() && stat_path( path, source_size, source_mtime );
+    const std::string file = cached ? cache_path( cache_directory, path, ".glanimz" ) : std::string();
+    if( cached && load_compressed_cached( file, path, source_size, source_mtime, settings, skeleton_out, compressed_out, max_error_out ) ) {
+        cerr << "Loaded compressed animation " << file << " for " << path << " in " << milliseconds_since( start ) << " ms.\n";
+        return true;
+    }
+    
+    // The compiled animation is only needed until it's compressed.
+    real max_error = 0;
+    {
+        CompiledAnimation compiled;
+        if( !load_animation( path, cache_directory, skeleton_out, nullptr, &compiled, pool ) ) return false;
+        compressed_out = compress_animation( skeleton_out, compiled, settings, &max_error );
+    }
+    if( compressed_out.empty() ) {
+        cerr << "ERROR: Could not compress the animation in " << path << '\n';
+        skeleton_out.clear();
+        return false;
+    }
+    if( max_error_out ) *max_error_out = max_error;
+    
+    if( cached ) {
+        save_compressed_cached( file, path, source_size, source_mtime, settings, skeleton_out, compressed_out, max_error );
+        cerr << "Compressed " << path << " and saved it in " << milliseconds_since( start ) << " ms.\n";
+    }
+    return true;
+}
+
+}
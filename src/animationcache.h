@@ -0,0 +1,46 @@
+#ifndef __animationcache_h__
+#define __animationcache_h__
+
+#include "animationcompression.h"
+#include "compiledanimation.h"
+
+namespace graphics101 {
+
+class ThreadPool;
+
+/*
+Given:
+    path: A path to a BVH file
+    cache_directory: A directory for compiled copies of BVH files, or "" for none
+    skeleton_out: An output parameter in which to store the loaded Skeleton.
+    animation_out: An optional output parameter in which to store the loaded BoneAnimation.
+    compiled_out: An optional output parameter in which to store the animation compiled with compile_animation().
+    pool: As for loadBVH().
+Returns:
+    success: A boolean that is true if loading completed successfully and false otherwise.
+
+If `cache_directory` isn't empty, reuses the compiled copy saved there if the BVH's size
+and modification time haven't changed since it was saved, and otherwise calls loadBVH()
+and saves a compiled copy there for next time. Saved copies are memory-mapped rather than parsed,
+and a compiled animation loaded from one samples the mapped file directly.
+The outputs are the same either way. Pass null for the animation you don't need, so that it isn't made.
+*/
+bool load_animation( const std::string& path, const std::string& cache_directory, Skeleton& skeleton_out, BoneAnimation* animation_out, CompiledAnimation* compiled_out, ThreadPool* pool = nullptr );
+
+/*
+Given:
+    path, cache_directory, skeleton_out, pool: As for load_animation().
+    settings: As for compress_animation().
+    compressed_out: An output parameter in which to store the compressed animation.
+    max_error_out: As for compress_animation().
+Returns:
+    success: A boolean that is true if loading and compressing completed successfully and false otherwise.
+
+Like load_animation(), but also caches the result of compress_animation(), so that it only
+compresses a BVH file once for each `settings`. The dense animation is freed once it is compressed.
+*/
+bool load_compressed_animation( const std::string& path, const std::string& cache_directory, const CompressionSettings& settings, Skeleton& skeleton_out, CompressedAnimation& compressed_out, real* max_error_out = nullptr, ThreadPool* pool = nullptr );
+
+}
+
+#endif /* __animationcache_h__ */
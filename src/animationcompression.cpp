@@ -0,0 +1,367 @@
+#include "animationcompression.h"
+
+#include "compiledskeleton.h"
+
+#include <algorithm> // upper_bound(), min(), max()
+#include <cassert>
+#include <cmath>
+#include <iostream>
+using std::cerr;
+
+using namespace graphics101;
+
+namespace {
+// pack_quat() stores three components with this many bits each.
+const int kComponentBits = 20;
+const std::uint64_t kComponentMask = ( std::uint64_t(1) << kComponentBits ) - 1;
+// The components that aren't the largest are at most this big.
+const real kComponentRange = 0.70710678118654752440;
+
+// Give up on meeting the tolerance after this many attempts.
+const int kMaxAttempts = 8;
+
+// Interpolates from `a` to whichever of `b` and -`b` is closer.
+inline quat nlerp_shortest( const quat& a, const quat& b, real alpha ) {
+    const quat near_b = glm::dot( a, b ) < 0 ? -b : b;
+    return glm::normalize( a*( 1 - alpha ) + near_b*alpha );
+}
+
+// Unpacks like unpack_quat(), without normalizing, for callers that normalize anyway.
+inline quat unpack_quat_unnormalized( std::uint64_t packed ) {
+    // Converting from 32 rather than 64 bits is cheaper.
+    const real scale = 2*kComponentRange/kComponentMask;
+    const real a = real( std::uint32_t( ( packed >> 2 ) & kComponentMask ) )*scale - kComponentRange;
+    const real b = real( std::uint32_t( ( packed >> ( 2 + kComponentBits ) ) & kComponentMask ) )*scale - kComponentRange;
+    const real c = real( std::uint32_t( ( packed >> ( 2 + 2*kComponentBits ) ) & kComponentMask ) )*scale - kComponentRange;
+    const real largest = std::sqrt( std::max( 1 - a*a - b*b - c*c, real(0) ) );
+    
+    // a, b, and c are the other components in x, y, z, w order. glm::quat takes w, x, y, z.
+    switch( packed & 3 ) {
+        case 0: return quat( c, largest, a, b );
+        case 1: return quat( c, a, largest, b );
+        case 2: return quat( c, a, b, largest );
+        default: return quat( largest, a, b, c );
+    }
+}
+
+/*
+Given:
+    channel: A CompressedChannel
+    bone: A bone
+    num_bones: The number of bones
+    position: A frame position, possibly between frames
+    key0, key1: Output parameters for the indices of the keys on either side of `position`
+Returns:
+    How far `position` is from key0 to key1.
+*/
+template< typename Key >
+real find_keys( const CompressedChannel< Key >& channel, int bone, int num_bones, real position, std::uint32_t& key0, std::uint32_t& key1 ) {
+    // Search between the keys at the start of this block and the next.
+    const std::uint32_t frame = std::uint32_t( position );
+    const std::uint32_t last = channel.begin[ bone + 1 ] - 1;
+    const std::size_t block = frame/CompressedChannel< Key >::kFramesPerBlock;
+    const std::uint32_t first = channel.block_keys[ block*num_bones + bone ];
+    const std::size_t next_block = ( block + 1 )*num_bones + bone;
+    const std::uint32_t end = next_block < channel.block_keys.size() ? channel.block_keys[ next_block ] + 1 : last + 1;
+    key0 = std::uint32_t( std::upper_bound( channel.frames.data() + first + 1, channel.frames.data() + end, frame ) - channel.frames.data() ) - 1;
+    key1 = std::min( key0 + 1, last );
+    if( key1 == key0 ) return 0;
+    return ( position - channel.frames[ key0 ] )/real( channel.frames[ key1 ] - channel.frames[ key0 ] );
+}
+
+// Like sample_animation(), but at a frame position rather than a time.
+void sample_position( const CompressedAnimation& animation, real position, QuatTRS* pose_out ) {
+    const int num_bones = animation.num_bones;
+    std::uint32_t key0, key1;
+    
+    for( int bone = 0; bone < num_bones; ++bone ) {
+        const auto& translations = animation.translations;
+        const real alpha = find_keys( translations, bone, num_bones, position, key0, key1 );
+        const vec3& t0 = translations.keys[ key0 ];
+        const vec3& t1 = translations.keys[ key1 ];
+        pose_out[ bone ].translation = t0 + ( t1 - t0 )*alpha;
+    }
+    
+    for( int bone = 0; bone < num_bones; ++bone ) {
+        const auto& scales = animation.scales;
+        const real alpha = find_keys( scales, bone, num_bones, position, key0, key1 );
+        const vec3& s0 = scales.keys[ key0 ];
+        const vec3& s1 = scales.keys[ key1 ];
+        pose_out[ bone ].scale = s0 + ( s1 - s0 )*alpha;
+    }
+    
+    for( int bone = 0; bone < num_bones; ++bone ) {
+        const auto& rotations = animation.rotations;
+        const real alpha = find_keys( rotations, bone, num_bones, position, key0, key1 );
+        pose_out[ bone ].rotation = nlerp_shortest( unpack_quat_unnormalized( rotations.keys[ key0 ] ), unpack_quat_unnormalized( rotations.keys[ key1 ] ), alpha );
+    }
+}
+
+/*
+Given:
+    num_frames: The number of frames in a track
+    fits: A function such that fits( start, end ) is true if every frame strictly between
+          `start` and `end` is close enough to the interpolation of keys at `start` and `end`
+Returns:
+    Key frames, from 0 to the last frame, such that `fits` is true between neighbors.
+
+Each key is followed by the furthest one we can find, by doubling the distance
+until it doesn't fit and then searching between the last two distances.
+That checks O( log n ) candidates per key rather than every one.
+*/
+template< typename Fits >
+std::vector< std::uint32_t > reduce_keys( int num_frames, const Fits& fits ) {
+    std::vector< std::uint32_t > keys( 1, 0 );
+    int start = 0;
+    while( start < num_frames - 1 ) {
+        // The next frame always fits, since there's nothing in between.
+        int good = start + 1;
+        int bad = num_frames;
+        for( int step = 2; good < num_frames - 1; step *= 2 ) {
+            const int end = std::min( start + step, num_frames - 1 );
+            if( !fits( start, end ) ) {
+                bad = end;
+                break;
+            }
+            good = end;
+        }
+        while( bad - good > 1 ) {
+            const int middle = ( good + bad )/2;
+            if( fits( start, middle ) ) good = middle;
+            else bad = middle;
+        }
+        
+        keys.push_back( good );
+        start = good;
+    }
+    return keys;
+}
+
+// Adds bone `bone`'s keys, at `frames` of `track`, to `channel`.
+// Call it for each bone in order, after sizing channel.block_keys.
+template< typename Key >
+void append_track( CompressedChannel< Key >& channel, int bone, int num_bones, const std::vector< std::uint32_t >& frames, const std::vector< Key >& track ) {
+    const std::uint32_t first = std::uint32_t( channel.frames.size() );
+    std::uint32_t key = first;
+    const int num_blocks = int( channel.block_keys.size()/num_bones );
+    for( int block = 0; block < num_blocks; ++block ) {
+        const std::uint32_t block_frame = std::uint32_t( block )*CompressedChannel< Key >::kFramesPerBlock;
+        while( key - first + 1 < frames.size() && frames[ key - first + 1 ] <= block_frame ) ++key;
+        channel.block_keys[ std::size_t( block )*num_bones + bone ] = key;
+    }
+    
+    for( const std::uint32_t frame : frames ) {
+        channel.frames.push_back( frame );
+        channel.keys.push_back( track[ frame ] );
+    }
+    channel.begin.push_back( std::uint32_t( channel.frames.size() ) );
+}
+
+/*
+Removes keys from every track of `animation`. Each bone's tracks are allowed to
+move its joint, and any point within `reach[bone]` of it, by `tolerance`:
+    a translation error moves them all by as much,
+    an angle error moves them by up to angle*reach,
+    and a scale error moves them by up to error*reach.
+*/
+CompressedAnimation compress_tracks( const CompiledAnimation& animation, const std::vector< real >& reach, real tolerance ) {
+    const int num_bones = animation.num_bones;
+    const int num_frames = animation.num_frames;
+    
+    CompressedAnimation result;
+    result.num_bones = num_bones;
+    result.num_frames = num_frames;
+    result.seconds_per_frame = animation.seconds_per_frame;
+    result.translations.begin.assign( 1, 0 );
+    result.rotations.begin.assign( 1, 0 );
+    result.scales.begin.assign( 1, 0 );
+    const int num_blocks = ( num_frames + CompressedChannel< vec3 >::kFramesPerBlock - 1 )/CompressedChannel< vec3 >::kFramesPerBlock;
+    result.translations.block_keys.resize( std::size_t( num_blocks )*num_bones );
+    result.rotations.block_keys.resize( std::size_t( num_blocks )*num_bones );
+    result.scales.block_keys.resize( std::size_t( num_blocks )*num_bones );
+    
+    // One bone's tracks, gathered from across the frames.
+    std::vector< vec3 > translations( num_frames );
+    std::vector< vec3 > scales( num_frames );
+    std::vector< quat > rotations( num_frames );
+    std::vector< std::uint64_t > packed( num_frames );
+    std::vector< quat > unpacked( num_frames );
+    
+    for( int bone = 0; bone < num_bones; ++bone ) {
+        for( int frame = 0; frame < num_frames; ++frame ) {
+            const std::size_t i = std::size_t( frame )*num_bones + bone;
+            translations[ frame ] = animation.translations[i];
+            scales[ frame ] = animation.scales[i];
+            rotations[ frame ] = animation.rotations[i];
+            packed[ frame ] = pack_quat( animation.rotations[i] );
+            unpacked[ frame ] = unpack_quat( packed[ frame ] );
+        }
+        
+        const auto vec3_fits = []( const std::vector< vec3 >& track, real track_tolerance ) {
+            return [&track, track_tolerance]( int start, int end ) {
+                for( int frame = start + 1; frame < end; ++frame ) {
+                    const real alpha = real( frame - start )/( end - start );
+                    const vec3 interpolated = track[ start ] + ( track[ end ] - track[ start ] )*alpha;
+                    if( glm::length( interpolated - track[ frame ] ) > track_tolerance ) return false;
+                }
+                return true;
+            };
+        };
+        append_track( result.translations, bone, num_bones, reduce_keys( num_frames, vec3_fits( translations, tolerance ) ), translations );
+        append_track( result.scales, bone, num_bones, reduce_keys( num_frames, vec3_fits( scales, tolerance/reach[ bone ] ) ), scales );
+        
+        // Compare the distance between quaternions rather than the angle between rotations,
+        // since the cosine of a small angle is indistinguishable from 1 in single precision.
+        // Unit quaternions an angle `a` apart are 2*sin( a/4 ) apart.
+        const real angle_tolerance = std::min( tolerance/reach[ bone ], pi );
+        const real quat_tolerance = 2*std::sin( angle_tolerance/4 );
+        const auto rotation_fits = [&]( int start, int end ) {
+            for( int frame = start + 1; frame < end; ++frame ) {
+                const real alpha = real( frame - start )/( end - start );
+                const quat interpolated = nlerp_shortest( unpacked[ start ], unpacked[ end ], alpha );
+                const quat& original = rotations[ frame ];
+                const real distance = std::min( glm::length( interpolated - original ), glm::length( interpolated + original ) );
+                if( distance > quat_tolerance ) return false;
+            }
+            return true;
+        };
+        append_track( result.rotations, bone, num_bones, reduce_keys( num_frames, rotation_fits ), packed );
+    }
+    
+    return result;
+}
+
+// Returns the largest distance between the original and compressed world-space positions
+// of every joint, and of the points `shell_distance` along each of its axes, at every frame.
+real max_world_error( const Skeleton& skeleton, const CompiledAnimation& original, const CompressedAnimation& compressed, real shell_distance ) {
+    const int num_bones = original.num_bones;
+    const CompiledSkeleton compiled_skeleton( skeleton );
+    std::vector< QuatTRS > pose( num_bones );
+    std::vector< Affine3x4 > original_bone2world( num_bones );
+    std::vector< Affine3x4 > compressed_bone2world( num_bones );
+    
+    real max_error = 0;
+    for( int frame = 0; frame < original.num_frames; ++frame ) {
+        for( int bone = 0; bone < num_bones; ++bone ) {
+            const std::size_t i = std::size_t( frame )*num_bones + bone;
+            QuatTRS trs;
+            trs.translation = original.translations[i];
+            trs.rotation = original.rotations[i];
+            trs.scale = original.scales[i];
+            original_bone2world[ bone ] = Affine3x4( trs );
+        }
+        sample_position( compressed, real( frame ), pose.data() );
+        for( int bone = 0; bone < num_bones; ++bone ) compressed_bone2world[ bone ] = Affine3x4( pose[ bone ] );
+        
+        // bone2parent becomes bone2world in place.
+        compiled_skeleton.forwardKinematics( original_bone2world.data(), original_bone2world.data() );
+        compiled_skeleton.forwardKinematics( compressed_bone2world.data(), compressed_bone2world.data() );
+        
+        for( int bone = 0; bone < num_bones; ++bone ) {
+            const Affine3x4& a = original_bone2world[ bone ];
+            const Affine3x4& b = compressed_bone2world[ bone ];
+            const vec3 joint( a.rows[0].w - b.rows[0].w, a.rows[1].w - b.rows[1].w, a.rows[2].w - b.rows[2].w );
+            max_error = std::max( max_error, glm::length( joint ) );
+            for( int axis = 0; axis < 3; ++axis ) {
+                const vec3 shell( a.rows[0][ axis ] - b.rows[0][ axis ], a.rows[1][ axis ] - b.rows[1][ axis ], a.rows[2][ axis ] - b.rows[2][ axis ] );
+                max_error = std::max( max_error, glm::length( joint + shell*shell_distance ) );
+            }
+        }
+    }
+    return max_error;
+}
+}
+
+namespace graphics101 {
+
+std::size_t CompressedAnimation::sizeInBytes() const {
+    std::size_t result = 0;
+    result += ( translations.begin.size() + translations.frames.size() )*sizeof( std::uint32_t ) + translations.keys.size()*sizeof( vec3 );
+    result += ( rotations.begin.size() + rotations.frames.size() )*sizeof( std::uint32_t ) + rotations.keys.size()*sizeof( std::uint64_t );
+    result += ( scales.begin.size() + scales.frames.size() )*sizeof( std::uint32_t ) + scales.keys.size()*sizeof( vec3 );
+    result += ( translations.block_keys.size() + rotations.block_keys.size() + scales.block_keys.size() )*sizeof( std::uint32_t );
+    return result;
+}
+
+std::uint64_t pack_quat( const quat& rotation ) {
+    const real components[4] = { rotation.x, rotation.y, rotation.z, rotation.w };
+    int largest = 0;
+    for( int i = 1; i < 4; ++i ) {
+        if( std::abs( components[i] ) > std::abs( components[ largest ] ) ) largest = i;
+    }
+    // Flip to the side of the hypersphere where the dropped component is positive.
+    const real sign = components[ largest ] < 0 ? -1 : 1;
+    
+    std::uint64_t packed = std::uint64_t( largest );
+    int shift = 2;
+    for( int i = 0; i < 4; ++i ) {
+        if( i == largest ) continue;
+        // Map [ -kComponentRange, kComponentRange ] to [ 0, kComponentMask ].
+        const real unit = ( sign*components[i]/kComponentRange + 1 )/2;
+        const std::uint64_t quantized = std::uint64_t( std::min( std::max( unit, real(0) ), real(1) )*kComponentMask + real(0.5) );
+        packed |= quantized << shift;
+        shift += kComponentBits;
+    }
+    return packed;
+}
+
+quat unpack_quat( std::uint64_t packed ) {
+    // Quantization makes it slightly non-unit.
+    return glm::normalize( unpack_quat_unnormalized( packed ) );
+}
+
+CompressedAnimation compress_animation( const Skeleton& skeleton, const CompiledAnimation& animation, const CompressionSettings& settings, real* max_error_out ) {
+    if( animation.empty() ) return CompressedAnimation();
+    if( animation.num_bones != int( skeleton.size() ) ) {
+        cerr << "ERROR: Can't compress an animation with a different number of bones than its skeleton.\n";
+        return CompressedAnimation();
+    }
+    
+    const int num_bones = animation.num_bones;
+    
+    // How far each bone's descendants reach from its joint, at least the shell distance.
+    // Parents have smaller indices than their children, so go backwards.
+    std::vector< real > longest_translation( num_bones, 0 );
+    for( std::size_t i = 0; i < animation.numValues(); ++i ) {
+        real& longest = longest_translation[ i % num_bones ];
+        longest = std::max( longest, glm::length( animation.translations[i] ) );
+    }
+    std::vector< real > reach( num_bones, std::max( settings.shell_distance, real(1e-6) ) );
+    for( int bone = num_bones - 1; bone >= 0; --bone ) {
+        const int parent = skeleton[ bone ].parent_index;
+        if( parent >= 0 ) reach[ parent ] = std::max( reach[ parent ], longest_translation[ bone ] + reach[ bone ] );
+    }
+    
+    // Errors along a chain of bones add up, so tighten the per-track tolerance until
+    // the world-space error is within the tolerance.
+    real tolerance = settings.tolerance;
+    CompressedAnimation result;
+    real max_error = 0;
+    for( int attempt = 0; attempt < kMaxAttempts; ++attempt ) {
+        result = compress_tracks( animation, reach, tolerance );
+        max_error = max_world_error( skeleton, animation, result, settings.shell_distance );
+        if( max_error <= settings.tolerance ) break;
+        tolerance *= std::max( real(0.1), real(0.9)*settings.tolerance/max_error );
+    }
+    if( max_error > settings.tolerance ) {
+        cerr << "ERROR: compress_animation() couldn't get within the tolerance of " << settings.tolerance
+             << ". The world-space error is up to " << max_error << ".\n";
+    }
+    
+    if( max_error_out ) *max_error_out = max_error;
+    return result;
+}
+
+void sample_animation( const CompressedAnimation& animation, real t, QuatTRS* pose_out ) {
+    assert( !animation.empty() );
+    assert( animation.seconds_per_frame > 0 );
+    
+    // Time maps to frames just like the CompiledAnimation sample_animation().
+    const real total_duration_seconds = animation.num_frames*animation.seconds_per_frame;
+    real u = std::fmod( t/total_duration_seconds, real(1) );
+    if( u < 0 ) u += 1;
+    
+    sample_position( animation, u*( animation.num_frames - 1 ), pose_out );
+}
+
+}
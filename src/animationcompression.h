@@ -0,0 +1,85 @@
+#ifndef __animationcompression_h__
+#define __animationcompression_h__
+
+#include "compiledanimation.h"
+
+#include <cstdint>
+
+namespace graphics101 {
+
+// Every bone's keys for one channel.
+// Bone `b`'s keys are [ begin[b], begin[b+1] ) in `frames` and `keys`, sorted by frame.
+template< typename Key >
+struct CompressedChannel {
+    std::vector< std::uint32_t > begin;
+    std::vector< std::uint32_t > frames;
+    std::vector< Key > keys;
+    // So sampling needn't search a whole track, block_keys[ block*num_bones + b ] is the
+    // last of bone `b`'s keys at or before frame block*kFramesPerBlock.
+    std::vector< std::uint32_t > block_keys;
+    
+    static const int kFramesPerBlock = 32;
+};
+
+/*
+A CompiledAnimation with its redundant keys removed.
+Each bone's translation, rotation, and scale tracks keep only the frames needed to stay
+within a world-space tolerance, and sampling interpolates linearly between the kept keys.
+Every track has a key at the first and last frame.
+Rotations are packed with pack_quat().
+*/
+struct CompressedAnimation {
+    int num_bones = 0;
+    int num_frames = 0;
+    real seconds_per_frame = 1./60.;
+    
+    CompressedChannel< vec3 > translations;
+    CompressedChannel< std::uint64_t > rotations;
+    CompressedChannel< vec3 > scales;
+    
+    bool empty() const { return num_frames == 0; }
+    void clear() { *this = CompressedAnimation(); }
+    // How much memory the keys take.
+    std::size_t sizeInBytes() const;
+};
+
+/*
+Packs a unit quaternion into 64 bits as its "smallest three" components.
+The largest component is dropped, since it can be recovered from the other three,
+and q and -q are the same rotation, so it is made positive.
+The other three lie in [ -1/sqrt(2), 1/sqrt(2) ] and are stored with 20 bits each,
+next to 2 bits saying which one was dropped. That is accurate to about 1e-6.
+*/
+std::uint64_t pack_quat( const quat& rotation );
+quat unpack_quat( std::uint64_t packed );
+
+struct CompressionSettings {
+    // The largest allowed distance between a point's compressed and original world-space positions.
+    // The points are every joint and points `shell_distance` along each of its axes, which
+    // stand in for the vertices a joint moves. Both are in the skeleton's units.
+    real tolerance = 0.01;
+    real shell_distance = 3;
+};
+
+/*
+Given:
+    skeleton: A Skeleton
+    animation: A CompiledAnimation of it
+    settings: How accurate the result must be
+    max_error_out: If not null, stores the largest world-space error of the result.
+Returns:
+    `animation` with as few keys as `settings` allow.
+
+Keys are removed greedily, track by track, using how far each bone's descendants reach
+to bound its effect in world space. The result is then checked with forward kinematics
+against the original at every frame, and compressed again more tightly if it's too far off.
+*/
+CompressedAnimation compress_animation( const Skeleton& skeleton, const CompiledAnimation& animation, const CompressionSettings& settings = CompressionSettings(), real* max_error_out = nullptr );
+
+// Like sample_animation() with RotationInterpolation::Nlerp, but reading the compressed keys.
+// Doesn't allocate.
+void sample_animation( const CompressedAnimation& animation, real t, QuatTRS* pose_out );
+
+}
+
+#endif /* __animationcompression_h__ */
@@ -0,0 +1,390 @@
+#include "blockcompression.h"
+
+#include "threadpool.h"
+
+#include <algorithm> // min(), max(), swap()
+#include <cassert>
+#include <chrono> // Measuring compression speed.
+#include <cmath> // log10(), sqrt()
+#include <cstdint>
+#include <cstdlib> // abs()
+#include <limits>
+#include <iostream>
+using std::cerr;
+
+namespace {
+using namespace graphics101;
+
+// RGB565 <-> RGB888, replicating the high bits into the low bits.
+std::uint16_t pack_565( int r, int g, int b ) {
+    return std::uint16_t( ( ( r*31 + 127 )/255 ) << 11 | ( ( g*63 + 127 )/255 ) << 5 | ( ( b*31 + 127 )/255 ) );
+}
+void unpack_565( std::uint16_t c, int rgb_out[3] ) {
+    const int r = ( c >> 11 ) & 31;
+    const int g = ( c >> 5 ) & 63;
+    const int b = c & 31;
+    rgb_out[0] = ( r << 3 ) | ( r >> 2 );
+    rgb_out[1] = ( g << 2 ) | ( g >> 4 );
+    rgb_out[2] = ( b << 3 ) | ( b >> 2 );
+}
+
+// The color part of BC1 and BC3. Always uses the 4-color mode,
+// which is the only mode BC3 has.
+void encode_color_block( const unsigned char rgba[64], unsigned char out[8] ) {
+    // Fit a line through the colors: the mean and the principal axis of the covariance.
+    float mean[3] = { 0, 0, 0 };
+    for( int i = 0; i < 16; ++i ) {
+        for( int c = 0; c < 3; ++c ) mean[c] += rgba[ 4*i + c ];
+    }
+    for( int c = 0; c < 3; ++c ) mean[c] /= 16;
+    
+    float covariance[6] = { 0, 0, 0, 0, 0, 0 };
+    for( int i = 0; i < 16; ++i ) {
+        const float r = rgba[ 4*i + 0 ] - mean[0];
+        const float g = rgba[ 4*i + 1 ] - mean[1];
+        const float b = rgba[ 4*i + 2 ] - mean[2];
+        covariance[0] += r*r; covariance[1] += r*g; covariance[2] += r*b;
+        covariance[3] += g*g; covariance[4] += g*b; covariance[5] += b*b;
+    }
+    
+    // A few steps of power iteration find the principal axis well enough.
+    float axis[3] = { 1, 1, 1 };
+    for( int iteration = 0; iteration < 4; ++iteration ) {
+        const float x = covariance[0]*axis[0] + covariance[1]*axis[1] + covariance[2]*axis[2];
+        const float y = covariance[1]*axis[0] + covariance[3]*axis[1] + covariance[4]*axis[2];
+        const float z = covariance[2]*axis[0] + covariance[4]*axis[1] + covariance[5]*axis[2];
+        const float length = std::max( std::max( std::fabs( x ), std::fabs( y ) ), std::fabs( z ) );
+        if( length <= 0 ) break;
+        axis[0] = x/length; axis[1] = y/length; axis[2] = z/length;
+    }
+    
+    // The endpoints are the extreme projections onto the axis.
+    float min_t = std::numeric_limits< float >::max();
+    float max_t = -std::numeric_limits< float >::max();
+    for( int i = 0; i < 16; ++i ) {
+        const float t = ( rgba[ 4*i + 0 ] - mean[0] )*axis[0] + ( rgba[ 4*i + 1 ] - mean[1] )*axis[1] + ( rgba[ 4*i + 2 ] - mean[2] )*axis[2];
+        min_t = std::min( min_t, t );
+        max_t = std::max( max_t, t );
+    }
+    const float axis_length2 = axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2];
+    int endpoints[2][3];
+    for( int c = 0; c < 3; ++c ) {
+        const float scale = axis_length2 > 0 ? axis[c]/axis_length2 : 0;
+        endpoints[0][c] = std::min( std::max( int( mean[c] + max_t*scale + 0.5f ), 0 ), 255 );
+        endpoints[1][c] = std::min( std::max( int( mean[c] + min_t*scale + 0.5f ), 0 ), 255 );
+    }
+    
+    std::uint16_t color0 = pack_565( endpoints[0][0], endpoints[0][1], endpoints[0][2] );
+    std::uint16_t color1 = pack_565( endpoints[1][0], endpoints[1][1], endpoints[1][2] );
+    // The 4-color mode needs color0 > color1.
+    if( color0 < color1 ) std::swap( color0, color1 );
+    
+    std::uint32_t indices = 0;
+    if( color0 != color1 ) {
+        // The palette the decoder will use.
+        int palette[4][3];
+        unpack_565( color0, palette[0] );
+        unpack_565( color1, palette[1] );
+        for( int c = 0; c < 3; ++c ) {
+            palette[2][c] = ( 2*palette[0][c] + palette[1][c] )/3;
+            palette[3][c] = ( palette[0][c] + 2*palette[1][c] )/3;
+        }
+        
+        for( int i = 0; i < 16; ++i ) {
+            int best = 0;
+            int best_distance = std::numeric_limits< int >::max();
+            for( int p = 0; p < 4; ++p ) {
+                const int dr = rgba[ 4*i + 0 ] - palette[p][0];
+                const int dg = rgba[ 4*i + 1 ] - palette[p][1];
+                const int db = rgba[ 4*i + 2 ] - palette[p][2];
+                const int distance = dr*dr + dg*dg + db*db;
+                if( distance < best_distance ) {
+                    best_distance = distance;
+                    best = p;
+                }
+            }
+            indices |= std::uint32_t( best ) << ( 2*i );
+        }
+    }
+    // Otherwise every index is 0, which is color0.
+    
+    out[0] = color0 & 0xFF; out[1] = color0 >> 8;
+    out[2] = color1 & 0xFF; out[3] = color1 >> 8;
+    for( int i = 0; i < 4; ++i ) out[ 4 + i ] = ( indices >> ( 8*i ) ) & 0xFF;
+}
+
+// A BC4 block (the alpha of BC3, and each channel of BC5) of
+// the channel `channel` of the 16 texels.
+void encode_channel_block( const unsigned char rgba[64], int channel, unsigned char out[8] ) {
+    int lo = 255, hi = 0;
+    for( int i = 0; i < 16; ++i ) {
+        lo = std::min( lo, int( rgba[ 4*i + channel ] ) );
+        hi = std::max( hi, int( rgba[ 4*i + channel ] ) );
+    }
+    
+    // The 8-value mode needs value0 > value1.
+    out[0] = hi;
+    out[1] = lo;
+    
+    std::uint64_t indices = 0;
+    if( hi != lo ) {
+        int palette[8];
+        palette[0] = hi;
+        palette[1] = lo;
+        for( int p = 1; p < 7; ++p ) palette[ p + 1 ] = ( ( 7 - p )*hi + p*lo )/7;
+        
+        for( int i = 0; i < 16; ++i ) {
+            const int value = rgba[ 4*i + channel ];
+            int best = 0;
+            int best_distance = 256;
+            for( int p = 0; p < 8; ++p ) {
+                const int distance = std::abs( value - palette[p] );
+                if( distance < best_distance ) {
+                    best_distance = distance;
+                    best = p;
+                }
+            }
+            indices |= std::uint64_t( best ) << ( 3*i );
+        }
+    }
+    
+    for( int i = 0; i < 6; ++i ) out[ 2 + i ] = ( indices >> ( 8*i ) ) & 0xFF;
+}
+
+void decode_color_block( const unsigned char in[8], bool allow_three_color_mode, unsigned char rgba_out[64] ) {
+    const std::uint16_t color0 = in[0] | ( in[1] << 8 );
+    const std::uint16_t color1 = in[2] | ( in[3] << 8 );
+    
+    int palette[4][4];
+    unpack_565( color0, palette[0] );
+    unpack_565( color1, palette[1] );
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+    if( color0 > color1 || !allow_three_color_mode ) {
+        for( int c = 0; c < 3; ++c ) {
+            palette[2][c] = ( 2*palette[0][c] + palette[1][c] )/3;
+            palette[3][c] = ( palette[0][c] + 2*palette[1][c] )/3;
+        }
+    } else {
+        for( int c = 0; c < 3; ++c ) {
+            palette[2][c] = ( palette[0][c] + palette[1][c] )/2;
+            palette[3][c] = 0;
+        }
+        palette[3][3] = 0;
+    }
+    
+    const std::uint32_t indices = in[4] | ( in[5] << 8 ) | ( in[6] << 16 ) | ( std::uint32_t( in[7] ) << 24 );
+    for( int i = 0; i < 16; ++i ) {
+        const int index = ( indices >> ( 2*i ) ) & 3;
+        for( int c = 0; c < 4; ++c ) rgba_out[ 4*i + c ] = palette[index][c];
+    }
+}
+
+void decode_channel_block( const unsigned char in[8], int channel, unsigned char rgba_out[64] ) {
+    int palette[8];
+    palette[0] = in[0];
+    palette[1] = in[1];
+    if( palette[0] > palette[1] ) {
+        for( int p = 1; p < 7; ++p ) palette[ p + 1 ] = ( ( 7 - p )*palette[0] + p*palette[1] )/7;
+    } else {
+        for( int p = 1; p < 5; ++p ) palette[ p + 1 ] = ( ( 5 - p )*palette[0] + p*palette[1] )/5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    
+    std::uint64_t indices = 0;
+    for( int i = 0; i < 6; ++i ) indices |= std::uint64_t( in[ 2 + i ] ) << ( 8*i );
+    for( int i = 0; i < 16; ++i ) {
+        rgba_out[ 4*i + channel ] = palette[ ( indices >> ( 3*i ) ) & 7 ];
+    }
+}
+
+int block_bytes( ImageEncoding encoding ) {
+    return encoding == ImageEncoding::BC1 ? 8 : 16;
+}
+
+// Copies the 4x4 block at block coordinates ( bx, by ) of a raw 8-bit image
+// into RGBA texels. Texels past the edge repeat the edge.
+void fetch_block( const unsigned char* texels, int width, int height, int channels, int bx, int by, unsigned char rgba_out[64] ) {
+    for( int y = 0; y < 4; ++y ) {
+        const int row = std::min( 4*by + y, height - 1 );
+        for( int x = 0; x < 4; ++x ) {
+            const int column = std::min( 4*bx + x, width - 1 );
+            const unsigned char* texel = texels + ( std::size_t( row )*width + column )*channels;
+            unsigned char* out = rgba_out + 4*( 4*y + x );
+            
+            if( channels >= 3 ) {
+                out[0] = texel[0]; out[1] = texel[1]; out[2] = texel[2];
+                out[3] = channels == 4 ? texel[3] : 255;
+            } else {
+                // Gray or gray and alpha.
+                out[0] = out[1] = out[2] = texel[0];
+                out[3] = channels == 2 ? texel[1] : 255;
+            }
+        }
+    }
+}
+
+void encode_block( ImageEncoding encoding, const unsigned char rgba[64], unsigned char* out ) {
+    switch( encoding ) {
+        case ImageEncoding::BC1: encode_bc1_block( rgba, out ); break;
+        case ImageEncoding::BC3: encode_bc3_block( rgba, out ); break;
+        case ImageEncoding::BC5: encode_bc5_block( rgba, out ); break;
+        default: assert( false );
+    }
+}
+void decode_block( ImageEncoding encoding, const unsigned char* in, unsigned char rgba_out[64] ) {
+    switch( encoding ) {
+        case ImageEncoding::BC1: decode_bc1_block( in, rgba_out ); break;
+        case ImageEncoding::BC3: decode_bc3_block( in, rgba_out ); break;
+        case ImageEncoding::BC5: decode_bc5_block( in, rgba_out ); break;
+        default: assert( false );
+    }
+}
+
+// The channels of the RGBA texels that `encoding` stores.
+int stored_channels( ImageEncoding encoding ) {
+    switch( encoding ) {
+        case ImageEncoding::BC1: return 3;
+        case ImageEncoding::BC5: return 2;
+        default: return 4;
+    }
+}
+
+const char* encoding_name( ImageEncoding encoding ) {
+    switch( encoding ) {
+        case ImageEncoding::BC1: return "BC1";
+        case ImageEncoding::BC3: return "BC3";
+        case ImageEncoding::BC5: return "BC5";
+        default: return "raw";
+    }
+}
+
+// The peak signal-to-noise ratio of the compressed `blocks` compared to the raw `texels`,
+// over the channels `encoding` stores.
+double psnr( ImageEncoding encoding, const unsigned char* texels, int width, int height, int channels, const unsigned char* blocks ) {
+    const int blocks_wide = ( width + 3 )/4;
+    const int blocks_high = ( height + 3 )/4;
+    const int num_channels = stored_channels( encoding );
+    
+    double squared_error = 0;
+    std::size_t count = 0;
+    for( int by = 0; by < blocks_high; ++by ) {
+        for( int bx = 0; bx < blocks_wide; ++bx ) {
+            unsigned char original[64], decoded[64];
+            fetch_block( texels, width, height, channels, bx, by, original );
+            decode_block( encoding, blocks + std::size_t( by*blocks_wide + bx )*block_bytes( encoding ), decoded );
+            
+            for( int i = 0; i < 16; ++i ) {
+                // Skip the repeated edge texels.
+                if( 4*bx + i%4 >= width || 4*by + i/4 >= height ) continue;
+                for( int c = 0; c < num_channels; ++c ) {
+                    const double difference = double( original[ 4*i + c ] ) - decoded[ 4*i + c ];
+                    squared_error += difference*difference;
+                    count += 1;
+                }
+            }
+        }
+    }
+    
+    if( squared_error == 0 || count == 0 ) return std::numeric_limits< double >::infinity();
+    return 10*std::log10( 255.0*255.0/( squared_error/count ) );
+}
+}
+
+namespace graphics101 {
+
+void encode_bc1_block( const unsigned char rgba[64], unsigned char out[8] ) {
+    encode_color_block( rgba, out );
+}
+void encode_bc3_block( const unsigned char rgba[64], unsigned char out[16] ) {
+    encode_channel_block( rgba, 3, out );
+    encode_color_block( rgba, out + 8 );
+}
+void encode_bc5_block( const unsigned char rgba[64], unsigned char out[16] ) {
+    encode_channel_block( rgba, 0, out );
+    encode_channel_block( rgba, 1, out + 8 );
+}
+
+void decode_bc1_block( const unsigned char in[8], unsigned char rgba_out[64] ) {
+    decode_color_block( in, true, rgba_out );
+}
+void decode_bc3_block( const unsigned char in[16], unsigned char rgba_out[64] ) {
+    decode_color_block( in + 8, false, rgba_out );
+    decode_channel_block( in, 3, rgba_out );
+}
+void decode_bc5_block( const unsigned char in[16], unsigned char rgba_out[64] ) {
+    decode_channel_block( in, 0, rgba_out );
+    decode_channel_block( in + 8, 1, rgba_out );
+    for( int i = 0; i < 16; ++i ) {
+        rgba_out[ 4*i + 2 ] = 0;
+        rgba_out[ 4*i + 3 ] = 255;
+    }
+}
+
+std::size_t compressed_size( ImageEncoding encoding, int width, int height ) {
+    if( encoding == ImageEncoding::Raw ) return 0;
+    return std::size_t( ( width + 3 )/4 )*( ( height + 3 )/4 )*block_bytes( encoding );
+}
+
+double compression_psnr( const Image& original, const Image& compressed ) {
+    const Image::Level& first = original.levels.front();
+    return psnr( compressed.encoding, first.texels, first.width, first.height, original.channels, compressed.levels.front().texels );
+}
+
+Image compress_image( const Image& image, ImageEncoding encoding, ThreadPool* pool ) {
+    if( encoding == ImageEncoding::Raw || !image.valid() || image.encoding != ImageEncoding::Raw ) return image;
+    if( image.is_float ) {
+        cerr << "WARNING: Float images can't be block compressed. Not compressing: " << image.path << '\n';
+        return image;
+    }
+    
+    const auto start = std::chrono::steady_clock::now();
+    
+    // Lay the compressed levels out one after another.
+    std::vector< std::size_t > offsets;
+    std::size_t total = 0;
+    std::size_t raw_total = 0;
+    std::size_t num_texels = 0;
+    for( const auto& level : image.levels ) {
+        offsets.push_back( total );
+        total += compressed_size( encoding, level.width, level.height );
+        raw_total += level.size;
+        num_texels += std::size_t( level.width )*level.height;
+    }
+    auto storage = std::make_shared< std::vector< unsigned char > >( total );
+    
+    Image result = image;
+    result.encoding = encoding;
+    result.storage = storage;
+    for( int i = 0; i < image.levels.size(); ++i ) {
+        const Image::Level& level = image.levels[i];
+        unsigned char* blocks = storage->data() + offsets[i];
+        
+        const int blocks_wide = ( level.width + 3 )/4;
+        const int blocks_high = ( level.height + 3 )/4;
+        const int channels = image.channels;
+        // Each row of blocks is independent.
+        const auto compress_row = [&]( int by ) {
+            unsigned char rgba[64];
+            for( int bx = 0; bx < blocks_wide; ++bx ) {
+                fetch_block( level.texels, level.width, level.height, channels, bx, by, rgba );
+                encode_block( encoding, rgba, blocks + std::size_t( by*blocks_wide + bx )*block_bytes( encoding ) );
+            }
+        };
+        if( pool ) pool->parallelFor( blocks_high, compress_row );
+        else for( int by = 0; by < blocks_high; ++by ) compress_row( by );
+        
+        result.levels[i].texels = blocks;
+        result.levels[i].size = compressed_size( encoding, level.width, level.height );
+    }
+    
+    const double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+    cerr << "Compressed " << image.path << " to " << encoding_name( encoding ) << " at "
+         << ( seconds > 0 ? num_texels/seconds/1e6 : 0 ) << " Mtexels/s"
+         << ", PSNR " << compression_psnr( image, result ) << " dB"
+         << ", " << raw_total/1024 << " KB -> " << total/1024 << " KB.\n";
+    
+    return result;
+}
+
+}
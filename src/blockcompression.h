@@ -0,0 +1,42 @@
+#ifndef __blockcompression_h__
+#define __blockcompression_h__
+
+#include "image.h"
+
+namespace graphics101 {
+
+class ThreadPool;
+
+/*
+Block compression (a.k.a. S3TC/DXT and RGTC) encoders and decoders.
+Each works on one 4x4 block of RGBA8 texels, stored row by row (64 bytes).
+
+BC1 stores RGB in 8 bytes. BC3 stores RGBA in 16 bytes.
+BC5 stores two channels (R and G, e.g. the X and Y of a normal) in 16 bytes;
+shaders must reconstruct Z = sqrt( 1 - X^2 - Y^2 ) themselves.
+*/
+void encode_bc1_block( const unsigned char rgba[64], unsigned char out[8] );
+void encode_bc3_block( const unsigned char rgba[64], unsigned char out[16] );
+void encode_bc5_block( const unsigned char rgba[64], unsigned char out[16] );
+
+void decode_bc1_block( const unsigned char in[8], unsigned char rgba_out[64] );
+void decode_bc3_block( const unsigned char in[16], unsigned char rgba_out[64] );
+void decode_bc5_block( const unsigned char in[16], unsigned char rgba_out[64] );
+
+// The number of bytes a `width` by `height` image takes with `encoding`.
+std::size_t compressed_size( ImageEncoding encoding, int width, int height );
+
+// The peak signal-to-noise ratio, in dB, of the first level of `compressed` compared
+// to the first level of the 8-bit `original` it was compressed from,
+// over the channels its encoding stores.
+double compression_psnr( const Image& original, const Image& compressed );
+
+// Returns `image` (every level) compressed with `encoding`.
+// Float images can't be compressed this way and are returned unchanged.
+// If `pool` isn't null, blocks are compressed on its threads.
+// Logs the compression speed, the PSNR of the first level, and the memory saved.
+Image compress_image( const Image& image, ImageEncoding encoding, ThreadPool* pool = nullptr );
+
+}
+
+#endif /* __blockcompression_h__ */
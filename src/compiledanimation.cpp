@@ -0,0 +1,121 @@
+#include "compiledanimation.h"
+
+#include <iostream>
+using std::cerr;
+
+using namespace graphics101;
+
+namespace graphics101 {
+
+QuatTRS::operator mat4() const {
+    // The rotation matrix's columns, scaled, followed by the translation.
+    const mat3 R = glm::mat3_cast( rotation );
+    return mat4(
+        vec4( R[0]*scale.x, 0 ),
+        vec4( R[1]*scale.y, 0 ),
+        vec4( R[2]*scale.z, 0 ),
+        vec4( translation, 1 )
+        );
+}
+
+CompiledAnimation compile_animation( const BoneAnimation& animation ) {
+    CompiledAnimation result;
+    if( animation.frames.empty() ) return result;
+    
+    const int num_bones = int( animation.frames.front().size() );
+    const int num_frames = int( animation.frames.size() );
+    const std::size_t count = std::size_t( num_bones )*num_frames;
+    
+    // The arrays, which the result will share.
+    struct Tracks {
+        std::vector< vec3 > translations;
+        std::vector< quat > rotations;
+        std::vector< vec3 > scales;
+    };
+    const std::shared_ptr< Tracks > tracks = std::make_shared< Tracks >();
+    tracks->translations.reserve( count );
+    tracks->rotations.reserve( count );
+    tracks->scales.reserve( count );
+    
+    for( int frame = 0; frame < num_frames; ++frame ) {
+        const TRSPose& pose = animation.frames[frame];
+        if( pose.size() != num_bones ) {
+            cerr << "ERROR: Can't compile an animation whose frames have different numbers of bones.\n";
+            return CompiledAnimation();
+        }
+        
+        for( int bone = 0; bone < num_bones; ++bone ) {
+            tracks->translations.push_back( pose[bone].translation );
+            tracks->scales.push_back( pose[bone].scale );
+            
+            // q and -q are the same rotation. Pick the one closer to the previous frame's.
+            quat rotation = quat_from_axis_angle( pose[bone].rotation );
+            if( frame > 0 && glm::dot( rotation, tracks->rotations[ std::size_t( frame - 1 )*num_bones + bone ] ) < 0 ) {
+                rotation = -rotation;
+            }
+            tracks->rotations.push_back( rotation );
+        }
+    }
+    
+    result.num_bones = num_bones;
+    result.num_frames = num_frames;
+    result.seconds_per_frame = animation.seconds_per_frame;
+    result.translations = tracks->translations.data();
+    result.rotations = tracks->rotations.data();
+    result.scales = tracks->scales.data();
+    result.storage = tracks;
+    return result;
+}
+
+void sample_animation( const CompiledAnimation& animation, real t, QuatTRS* pose_out, RotationInterpolation rotations ) {
+    assert( !animation.empty() );
+    assert( animation.seconds_per_frame > 0 );
+    
+    // Convert t, whose units are seconds, into u, the fraction of the way through the animation.
+    const real total_duration_seconds = animation.num_frames*animation.seconds_per_frame;
+    real u = std::fmod( t/total_duration_seconds, real(1) );
+    if( u < 0 ) u += 1;
+    
+    // Find the frames on either side and how far we are between them.
+    const real position = u*( animation.num_frames - 1 );
+    const int frame0 = std::min( int( position ), animation.num_frames - 1 );
+    const int frame1 = std::min( frame0 + 1, animation.num_frames - 1 );
+    const real alpha = position - frame0;
+    
+    const int num_bones = animation.num_bones;
+    const std::size_t offset0 = std::size_t( frame0 )*num_bones;
+    const std::size_t offset1 = std::size_t( frame1 )*num_bones;
+    
+    // One pass per channel, each reading two contiguous runs.
+    const vec3* translations0 = animation.translations + offset0;
+    const vec3* translations1 = animation.translations + offset1;
+    for( int bone = 0; bone < num_bones; ++bone ) {
+        pose_out[bone].translation = translations0[bone] + ( translations1[bone] - translations0[bone] )*alpha;
+    }
+    
+    const vec3* scales0 = animation.scales + offset0;
+    const vec3* scales1 = animation.scales + offset1;
+    for( int bone = 0; bone < num_bones; ++bone ) {
+        pose_out[bone].scale = scales0[bone] + ( scales1[bone] - scales0[bone] )*alpha;
+    }
+    
+    // Neighboring frames' rotations are on the same side of the hypersphere (see compile_animation()),
+    // so neither needs to check for the long way around.
+    const quat* rotations0 = animation.rotations + offset0;
+    const quat* rotations1 = animation.rotations + offset1;
+    if( rotations == RotationInterpolation::Nlerp ) {
+        for( int bone = 0; bone < num_bones; ++bone ) {
+            pose_out[bone].rotation = glm::normalize( rotations0[bone]*( 1 - alpha ) + rotations1[bone]*alpha );
+        }
+    } else {
+        for( int bone = 0; bone < num_bones; ++bone ) {
+            pose_out[bone].rotation = glm::slerp( rotations0[bone], rotations1[bone], alpha );
+        }
+    }
+}
+
+void matrices_from_pose( const QuatTRS* pose, int num_bones, mat4* matrices_out ) {
+    for( int bone = 0; bone < num_bones; ++bone ) matrices_out[bone] = mat4( pose[bone] );
+}
+
+}
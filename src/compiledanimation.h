@@ -0,0 +1,76 @@
+#ifndef __compiledanimation_h__
+#define __compiledanimation_h__
+
+#include "animation.h"
+#include "quaternion.h"
+
+#include <memory> // shared_ptr
+
+namespace graphics101 {
+
+/*
+A BoneAnimation rearranged for fast sampling.
+Each channel is one contiguous array with every bone of frame 0, then every bone of frame 1, ...,
+so the value for bone `b` in frame `f` is at [ f*num_bones + b ].
+Sampling between two frames reads two contiguous runs of each array.
+Rotations are unit quaternions, which interpolate without going through matrices.
+
+The arrays live in `storage`, which is either memory compile_animation() allocated or
+a memory-mapped cache file (see load_animation()). Copies share it, so they are cheap.
+*/
+struct CompiledAnimation {
+    int num_bones = 0;
+    int num_frames = 0;
+    real seconds_per_frame = 1./60.;
+    
+    // Each array holds num_frames*num_bones values.
+    const vec3* translations = nullptr;
+    // Each rotation is on the same side of the hypersphere as the same bone's rotation
+    // in the previous frame, so interpolating neighboring frames goes the short way around.
+    const quat* rotations = nullptr;
+    const vec3* scales = nullptr;
+    // Keeps the arrays alive.
+    std::shared_ptr< const void > storage;
+    
+    std::size_t numValues() const { return std::size_t( num_frames )*num_bones; }
+    bool empty() const { return num_frames == 0; }
+    void clear() { *this = CompiledAnimation(); }
+};
+
+// A TRS whose rotation is a unit quaternion.
+struct QuatTRS {
+    vec3 translation = vec3(0,0,0);
+    quat rotation = quat(1,0,0,0);
+    vec3 scale = vec3(1,1,1);
+    
+    // The matrix performs translation*rotation*scale, like TRS's.
+    operator mat4() const;
+};
+
+// Converts `animation` for sample_animation().
+CompiledAnimation compile_animation( const BoneAnimation& animation );
+
+enum class RotationInterpolation {
+    // Normalized linear interpolation. Cheaper, and close to slerp for neighboring frames.
+    Nlerp,
+    // Constant angular speed.
+    Slerp
+};
+
+/*
+Given:
+    animation: A CompiledAnimation
+    t: A time in seconds
+    pose_out: Room for `animation.num_bones` transformations
+Stores the bone-to-parent pose at time `t` in `pose_out`, interpolating between the
+two nearest frames. Time maps to frames the way interpolate() does, looping at the end.
+Doesn't allocate.
+*/
+void sample_animation( const CompiledAnimation& animation, real t, QuatTRS* pose_out, RotationInterpolation rotations = RotationInterpolation::Nlerp );
+
+// Converts `num_bones` transformations to matrices. Doesn't allocate.
+void matrices_from_pose( const QuatTRS* pose, int num_bones, mat4* matrices_out );
+
+}
+
+#endif /* __compiledanimation_h__ */
@@ -0,0 +1,186 @@
+#include "compiledskeleton.h"
+
+#include "compiledanimation.h" // QuatTRS
+
+#include <algorithm> // stable_sort(), max(), copy()
+#include <cassert>
+
+// SSE is always there on x86-64.
+#if defined(__SSE__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 1 )
+#define AFFINE_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+using namespace graphics101;
+
+namespace graphics101 {
+
+Affine3x4::Affine3x4() {
+    rows[0] = vec4( 1, 0, 0, 0 );
+    rows[1] = vec4( 0, 1, 0, 0 );
+    rows[2] = vec4( 0, 0, 1, 0 );
+}
+
+Affine3x4::Affine3x4( const mat4& M ) {
+    for( int i = 0; i < 3; ++i ) rows[i] = vec4( M[0][i], M[1][i], M[2][i], M[3][i] );
+}
+
+Affine3x4::Affine3x4( const QuatTRS& trs ) {
+    // The rotation matrix of a unit quaternion, written out by rows, with its columns scaled.
+    const quat& q = trs.rotation;
+    const real xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+    const real xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+    const real wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+    const vec3& s = trs.scale;
+    const vec3& t = trs.translation;
+    rows[0] = vec4( ( 1 - 2*( yy + zz ) )*s.x, 2*( xy - wz )*s.y, 2*( xz + wy )*s.z, t.x );
+    rows[1] = vec4( 2*( xy + wz )*s.x, ( 1 - 2*( xx + zz ) )*s.y, 2*( yz - wx )*s.z, t.y );
+    rows[2] = vec4( 2*( xz - wy )*s.x, 2*( yz + wx )*s.y, ( 1 - 2*( xx + yy ) )*s.z, t.z );
+}
+
+Affine3x4::operator mat4() const {
+    return mat4(
+        vec4( rows[0].x, rows[1].x, rows[2].x, 0 ),
+        vec4( rows[0].y, rows[1].y, rows[2].y, 0 ),
+        vec4( rows[0].z, rows[1].z, rows[2].z, 0 ),
+        vec4( rows[0].w, rows[1].w, rows[2].w, 1 )
+        );
+}
+
+Affine3x4 operator*( const Affine3x4& a, const Affine3x4& b ) {
+    // Row i of the product is a's row i times b, with b's implicit bottom row ( 0, 0, 0, 1 ):
+    //     a[i][0]*b.rows[0] + a[i][1]*b.rows[1] + a[i][2]*b.rows[2] + ( 0, 0, 0, a[i][3] )
+    Affine3x4 result;
+#ifdef AFFINE_USE_SSE
+    const __m128 b0 = _mm_load_ps( &b.rows[0][0] );
+    const __m128 b1 = _mm_load_ps( &b.rows[1][0] );
+    const __m128 b2 = _mm_load_ps( &b.rows[2][0] );
+    const __m128 b3 = _mm_set_ps( 1, 0, 0, 0 );
+    for( int i = 0; i < 3; ++i ) {
+        const __m128 row = _mm_load_ps( &a.rows[i][0] );
+        __m128 sum = _mm_mul_ps( _mm_shuffle_ps( row, row, _MM_SHUFFLE( 0, 0, 0, 0 ) ), b0 );
+        sum = _mm_add_ps( sum, _mm_mul_ps( _mm_shuffle_ps( row, row, _MM_SHUFFLE( 1, 1, 1, 1 ) ), b1 ) );
+        sum = _mm_add_ps( sum, _mm_mul_ps( _mm_shuffle_ps( row, row, _MM_SHUFFLE( 2, 2, 2, 2 ) ), b2 ) );
+        sum = _mm_add_ps( sum, _mm_mul_ps( row, b3 ) );
+        _mm_store_ps( &result.rows[i][0], sum );
+    }
+#else
+    for( int i = 0; i < 3; ++i ) {
+        const vec4& row = a.rows[i];
+        result.rows[i] = row.x*b.rows[0] + row.y*b.rows[1] + row.z*b.rows[2] + vec4( 0, 0, 0, row.w );
+    }
+#endif
+    return result;
+}
+
+CompiledSkeleton::CompiledSkeleton( const Skeleton& skeleton ) {
+    const int num_bones = int( skeleton.size() );
+    
+    // Parents come first, so their depth is known before their children's.
+    std::vector< int > depths( num_bones, 0 );
+    int num_levels = num_bones > 0 ? 1 : 0;
+    for( int i = 0; i < num_bones; ++i ) {
+        const int parent = skeleton[i].parent_index;
+        assert( parent < i );
+        if( parent >= 0 ) depths[i] = depths[parent] + 1;
+        num_levels = std::max( num_levels, depths[i] + 1 );
+    }
+    
+    // Sort by depth, then by parent.
+    m_bones.resize( num_bones );
+    for( int i = 0; i < num_bones; ++i ) m_bones[i] = i;
+    std::stable_sort( m_bones.begin(), m_bones.end(), [&]( int a, int b ) {
+        if( depths[a] != depths[b] ) return depths[a] < depths[b];
+        return skeleton[a].parent_index < skeleton[b].parent_index;
+    } );
+    
+    m_parents.resize( num_bones );
+    m_level_begin.assign( num_levels + 1, num_bones );
+    for( int k = num_bones - 1; k >= 0; --k ) {
+        m_parents[k] = skeleton[ m_bones[k] ].parent_index;
+        m_level_begin[ depths[ m_bones[k] ] ] = k;
+    }
+}
+
+void CompiledSkeleton::forwardKinematics( const Affine3x4* bone2parent, Affine3x4* bone2world ) const {
+    // The roots are the first level.
+    const int num_roots = numLevels() > 0 ? m_level_begin[1] : 0;
+    for( int k = 0; k < num_roots; ++k ) {
+        bone2world[ m_bones[k] ] = bone2parent[ m_bones[k] ];
+    }
+    
+    // Every later level only reads the levels before it, so none of its products
+    // waits for another. Each bone reads its own bone2parent before writing its bone2world,
+    // so this works in place, too.
+    for( int level = 1; level < numLevels(); ++level ) {
+        const int end = m_level_begin[ level + 1 ];
+        for( int k = m_level_begin[ level ]; k < end; ++k ) {
+            const int bone = m_bones[k];
+            bone2world[ bone ] = bone2world[ m_parents[k] ]*bone2parent[ bone ];
+        }
+    }
+}
+
+IncrementalKinematics::IncrementalKinematics( const Skeleton& skeleton ) {
+    const int num_bones = int( skeleton.size() );
+    m_parents.resize( num_bones );
+    for( int i = 0; i < num_bones; ++i ) {
+        m_parents[i] = skeleton[i].parent_index;
+        assert( m_parents[i] < i );
+    }
+    
+    // Children come after parents, so visiting bones last to first
+    // finishes every child's range before its parent's is extended by it.
+    m_subtree_end.resize( num_bones );
+    for( int i = 0; i < num_bones; ++i ) m_subtree_end[i] = i + 1;
+    for( int i = num_bones - 1; i >= 0; --i ) {
+        const int parent = m_parents[i];
+        if( parent >= 0 ) m_subtree_end[parent] = std::max( m_subtree_end[parent], m_subtree_end[i] );
+    }
+    
+    // Start at the rest pose, with everything dirty.
+    m_bone2parent.assign( num_bones, Affine3x4() );
+    m_bone2world.assign( num_bones, Affine3x4() );
+    m_dirty.assign( num_bones, 1 );
+    m_first_dirty = 0;
+}
+
+void IncrementalKinematics::setBone2Parent( int bone, const Affine3x4& bone2parent ) {
+    m_bone2parent.at( bone ) = bone2parent;
+    m_dirty[bone] = 1;
+    m_first_dirty = std::min( m_first_dirty, bone );
+}
+
+void IncrementalKinematics::setPose( const Affine3x4* bone2parent ) {
+    std::copy( bone2parent, bone2parent + numBones(), m_bone2parent.begin() );
+    std::fill( m_dirty.begin(), m_dirty.end(), 1 );
+    m_first_dirty = 0;
+}
+
+int IncrementalKinematics::update() {
+    const int num_bones = numBones();
+    int num_updated = 0;
+    
+    // Recompute each dirty bone's range, in order, so parents are always up-to-date first.
+    // A dirty bone inside a range extends it to the end of its own.
+    int bone = m_first_dirty;
+    while( bone < num_bones ) {
+        if( !m_dirty[bone] ) {
+            ++bone;
+            continue;
+        }
+        
+        for( int end = m_subtree_end[bone]; bone < end; ++bone ) {
+            if( m_dirty[bone] ) end = std::max( end, m_subtree_end[bone] );
+            const int parent = m_parents[bone];
+            m_bone2world[bone] = parent < 0 ? m_bone2parent[bone] : m_bone2world[parent]*m_bone2parent[bone];
+            m_dirty[bone] = 0;
+            ++num_updated;
+        }
+    }
+    
+    m_first_dirty = num_bones;
+    return num_updated;
+}
+
+}
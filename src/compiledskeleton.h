@@ -0,0 +1,104 @@
+#ifndef __compiledskeleton_h__
+#define __compiledskeleton_h__
+
+#include "kinematics.h"
+
+namespace graphics101 {
+
+struct QuatTRS;
+
+/*
+An affine transformation stored as the top three rows of its 4x4 matrix.
+The bottom row is always ( 0, 0, 0, 1 ), so we don't store or multiply it.
+Each row is 16-byte aligned for SSE.
+*/
+struct alignas(16) Affine3x4 {
+    // rows[i] = ( M[0][i], M[1][i], M[2][i], M[3][i] ) in glm's column-major terms.
+    vec4 rows[3];
+    
+    // Identity by default.
+    Affine3x4();
+    // Drops `M`'s bottom row, which should be ( 0, 0, 0, 1 ).
+    explicit Affine3x4( const mat4& M );
+    // translation*rotation*scale
+    explicit Affine3x4( const QuatTRS& trs );
+    
+    // Convert to a mat4 automatically as needed.
+    operator mat4() const;
+};
+// The transformation `a` after `b`.
+Affine3x4 operator*( const Affine3x4& a, const Affine3x4& b );
+
+/*
+A Skeleton flattened for forward kinematics.
+Bones are grouped into levels by their depth in the hierarchy, and sorted by parent within a level,
+so a level's parents are a handful of nearby bones from the levels before it.
+No bone depends on another in the same level, so each level is one sweep of independent
+Affine3x4 products rather than a chain of dependent ones, which the processor can overlap.
+*/
+class CompiledSkeleton {
+public:
+    CompiledSkeleton() {}
+    explicit CompiledSkeleton( const Skeleton& skeleton );
+    
+    int numBones() const { return int( m_bones.size() ); }
+    int numLevels() const { return int( m_level_begin.size() ) - 1; }
+    
+    // Like forward_kinematics(), with both poses indexed like the Skeleton,
+    // but into a caller-owned array. They may be the same array. Doesn't allocate.
+    void forwardKinematics( const Affine3x4* bone2parent, Affine3x4* bone2world ) const;
+
+private:
+    // Skeleton indices, level by level.
+    std::vector< int > m_bones;
+    // The Skeleton index of the parent of each bone in m_bones, or -1.
+    std::vector< int > m_parents;
+    // Level `l` is m_bones[ m_level_begin[l] ] up to m_bones[ m_level_begin[l+1] ].
+    std::vector< int > m_level_begin;
+};
+
+/*
+Forward kinematics for posing a few bones at a time, as in interactive posing or IK.
+It keeps every bone's bone2world and only recomputes the bones below the ones that changed.
+
+Bone `i`'s descendants all lie between `i` and subtreeEnd( i ). When the Skeleton is in
+depth-first order, as loadBVH() makes it, that is exactly its subtree.
+Otherwise the range also holds some bones that aren't descendants, which are
+recomputed needlessly but correctly.
+*/
+class IncrementalKinematics {
+public:
+    IncrementalKinematics() {}
+    explicit IncrementalKinematics( const Skeleton& skeleton );
+    
+    int numBones() const { return int( m_parents.size() ); }
+    // One past the last bone whose bone2world depends on `bone`'s.
+    int subtreeEnd( int bone ) const { return m_subtree_end.at( bone ); }
+    
+    // Changes one bone's bone2parent transformation, which dirties its subtree.
+    void setBone2Parent( int bone, const Affine3x4& bone2parent );
+    // Changes every bone's.
+    void setPose( const Affine3x4* bone2parent );
+    const Affine3x4& bone2parent( int bone ) const { return m_bone2parent.at( bone ); }
+    
+    // Recomputes bone2world for the dirty subtrees.
+    // Returns how many bones it recomputed. Doesn't allocate.
+    int update();
+    // Call update() first.
+    const Affine3x4& bone2world( int bone ) const { return m_bone2world.at( bone ); }
+    const std::vector< Affine3x4 >& bone2world() const { return m_bone2world; }
+
+private:
+    std::vector< int > m_parents;
+    std::vector< int > m_subtree_end;
+    std::vector< Affine3x4 > m_bone2parent;
+    std::vector< Affine3x4 > m_bone2world;
+    // Whether each bone's bone2parent changed since the last update().
+    std::vector< char > m_dirty;
+    // The smallest dirty bone, or numBones() if none are.
+    int m_first_dirty = 0;
+};
+
+}
+
+#endif /* __compiledskeleton_h__ */
@@ -0,0 +1,52 @@
+#include "crowd.h"
+
+#include "threadpool.h"
+
+#include <algorithm> // min()
+#include <cassert>
+
+namespace {
+// How many instances one thread takes at a time.
+// Big enough that taking the next batch is rare, small enough to even out at the end.
+const int kBatchSize = 16;
+}
+
+namespace graphics101 {
+
+CrowdEvaluator::CrowdEvaluator( const Skeleton& skeleton )
+    : m_skeleton( skeleton )
+{}
+
+void CrowdEvaluator::evaluate( const std::vector< CrowdInstance >& instances, mat4* bone2world_out, ThreadPool* pool, RotationInterpolation rotations ) {
+    const int num_bones = numBones();
+    const int num_instances = int( instances.size() );
+    const int num_batches = ( num_instances + kBatchSize - 1 )/kBatchSize;
+    if( m_scratch.size() < std::size_t( num_batches )*num_bones ) {
+        m_scratch.resize( std::size_t( num_batches )*num_bones );
+        m_scratch_transforms.resize( std::size_t( num_batches )*num_bones );
+    }
+    
+    const auto evaluate_batch = [&]( int batch ) {
+        QuatTRS* pose = m_scratch.data() + std::size_t( batch )*num_bones;
+        Affine3x4* transforms = m_scratch_transforms.data() + std::size_t( batch )*num_bones;
+        const int end = std::min( ( batch + 1 )*kBatchSize, num_instances );
+        for( int i = batch*kBatchSize; i < end; ++i ) {
+            const CrowdInstance& instance = instances[i];
+            assert( instance.animation && instance.animation->num_bones == num_bones );
+            
+            sample_animation( *instance.animation, instance.time, pose, rotations );
+            
+            // bone2parent becomes bone2world in place.
+            for( int bone = 0; bone < num_bones; ++bone ) transforms[bone] = Affine3x4( pose[bone] );
+            m_skeleton.forwardKinematics( transforms, transforms );
+            
+            mat4* bone2world = bone2world_out + std::size_t( i )*num_bones;
+            for( int bone = 0; bone < num_bones; ++bone ) bone2world[bone] = mat4( transforms[bone] );
+        }
+    };
+    
+    if( pool ) pool->parallelFor( num_batches, evaluate_batch );
+    else for( int batch = 0; batch < num_batches; ++batch ) evaluate_batch( batch );
+}
+
+}
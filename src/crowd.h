@@ -0,0 +1,44 @@
+#ifndef __crowd_h__
+#define __crowd_h__
+
+#include "compiledanimation.h"
+#include "compiledskeleton.h"
+
+namespace graphics101 {
+
+class ThreadPool;
+
+// One character in a crowd: which clip it plays and where it is in it.
+struct CrowdInstance {
+    // Must have as many bones as the crowd's skeleton.
+    const CompiledAnimation* animation = nullptr;
+    real time = 0;
+};
+
+/*
+Poses many characters that share a skeleton.
+Each instance is sampled with sample_animation() and then posed with CompiledSkeleton's
+forward kinematics, and written into its slice of one big output array.
+Instances are handed out to threads in small batches, so a thread that finishes early takes more.
+*/
+class CrowdEvaluator {
+public:
+    explicit CrowdEvaluator( const Skeleton& skeleton );
+    
+    int numBones() const { return m_skeleton.numBones(); }
+    
+    // Stores the bone2world matrix of bone `b` of instance `i` in bone2world_out[ i*numBones() + b ],
+    // using `pool`'s threads as well as this one if `pool` isn't null.
+    // Only allocates when there are more instances than any previous call.
+    void evaluate( const std::vector< CrowdInstance >& instances, mat4* bone2world_out, ThreadPool* pool = nullptr, RotationInterpolation rotations = RotationInterpolation::Nlerp );
+
+private:
+    CompiledSkeleton m_skeleton;
+    // Room for one sampled pose and its transformations per batch.
+    std::vector< QuatTRS > m_scratch;
+    std::vector< Affine3x4 > m_scratch_transforms;
+};
+
+}
+
+#endif /* __crowd_h__ */
@@ -24,7 +24,7 @@ void Drawable::bind() {
     
     program->use();
     uniforms.applyUniforms( *program );
-    bind_textures( textures );
+    bind_textures( textures, samplers );
 }
 
 void Drawable::draw() {
@@ -15,6 +15,9 @@ struct Drawable {
     
     UniformSet uniforms;
     TextureVec textures;
+    // The sampler object for each texture, or 0 to use the texture's own filtering.
+    // May be shorter than `textures`.
+    std::vector< GLuint > samplers;
     
     // Call bind() and then draw().
     // The caller can do extra things between these two calls if desired.
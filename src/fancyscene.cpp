@@ -5,6 +5,9 @@
 #include <iostream>
 using std::cerr;
 
+#include <algorithm> // sort()
+#include <chrono> // Measuring frame times.
+
 #include "parsing.h"
 
 #include "debugging.h"
@@ -12,9 +15,14 @@ using std::cerr;
 #include "shaderprogram.h"
 #include "vao.h"
 #include "texture.h"
+#include "texturecache.h"
 #include "mesh.h"
 #include "drawable.h"
 #include "camera.h"
+#include "textureatlas.h"
+#include "glstate.h"
+#include "animationcache.h"
+#include "mappedfile.h"
 
 #include "glcompat.h"
 
@@ -22,37 +30,35 @@ using namespace graphics101;
 
 // Helper function
 namespace {
-VertexAndFaceArraysPtr vaoFromOBJPath( const std::string& path, const ShaderProgram& program ) {
-    // Load the mesh from the OBJ.
-    Mesh mesh;
-    const bool success = mesh.loadFromOBJ( path );
-    if( !success ) {
-        cerr << "ERROR: Unable to load OBJ file: " << path << '\n';
-        return nullptr;
-    }
-    
-    // Create normals if we don't have them.
-    if( mesh.normals.size() == 0 ) {
-        mesh.computeNormals();
-    }
-    // Normalize the mesh to fit within the unit cube [-1,1]^3 centered at the origin.
-    mesh.applyTransformation( mesh.normalizingTransformation() );
-    
+// Only the attributes the program reads are computed, flattened, and uploaded.
+// The processed mesh comes from (and stays in) `meshes`.
+VertexAndFaceArraysPtr vaoFromOBJPath( const std::string& path, const ShaderProgram& program, MeshCache& meshes ) {
+    // Ask the program which vertex attributes it reads.
+    const StringSet active_attributes = program.getActiveAttributes();
+    const bool wants_normals = active_attributes.count( "vNormal" ) > 0;
+    const bool wants_texcoords = active_attributes.count( "vTexCoord" ) > 0;
+    const bool wants_tangents = active_attributes.count( "vTangent" ) > 0 || active_attributes.count( "vBitangent" ) > 0;
+    
+    // Get the mesh, normalized and with normals and tangents if the shader wants them.
+    const Mesh* cached = meshes.get( path, wants_normals, wants_tangents );
+    if( !cached ) return nullptr;
+    const Mesh& mesh = *cached;
+    
+    // A location of -1 skips flattening and uploading the attribute.
     VertexAndFaceArraysPtr vao = vao::makeFromMesh(
         mesh,
         program.getAttribLocation( "vPos" ),
-        program.getAttribLocation( "vNormal" ),
-        program.getAttribLocation( "vTexCoord" )
+        wants_normals ? program.getAttribLocation( "vNormal" ) : -1,
+        wants_texcoords ? program.getAttribLocation( "vTexCoord" ) : -1
         );
     
-    if( !mesh.face_texcoords.empty() ) {
+    if( wants_tangents && !mesh.face_texcoords.empty() ) {
         /// The code in vao::makeFromMesh() does the following to flatten and upload
         /// texture coordinates:
         // auto flat_texcoords = flatten_attribute( mesh.face_texcoords, mesh.texcoords );
         // vao->uploadAttribute( flat_texcoords, program.getAttribLocation( "vTexCoord" ) );
         
-        // Create tangent frame.
-        mesh.computeTangentBitangent();
+        // The tangent frame was created by MeshCache::get().
         // Upload mesh.tangents and mesh.bitangents to the GPU.
         
         std::cerr << "Uploading vertex attributes tangents and bitangents to the GPU.\n";
@@ -63,6 +69,27 @@ VertexAndFaceArraysPtr vaoFromOBJPath( const std::string& path, const ShaderProg
     
     return vao;
 }
+
+// Removes the translation of every bone but the roots.
+void pin_joints( const Skeleton& skeleton, mat4* bone2parent ) {
+    for( int i = 0; i < skeleton.size(); ++i ) {
+        if( skeleton[i].parent_index >= 0 ) bone2parent[i][3] = vec4(0,0,0,1);
+    }
+}
+
+// The sorted ShaderProgram::sourceHash()'es of `sources`, which is how ShaderProgramCache knows a program.
+ShaderProgramCache::Key source_hashes( const ShaderSources& sources ) {
+    ShaderProgramCache::Key hashes;
+    for( const auto& stage : sources ) {
+        if( !stage.second.empty() ) hashes.push_back( ShaderProgram::sourceHash( stage.first, stage.second ) );
+    }
+    std::sort( hashes.begin(), hashes.end() );
+    return hashes;
+}
+
+double milliseconds_since( std::chrono::steady_clock::time_point start ) {
+    return std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+}
 }
 
 namespace graphics101 {
@@ -74,7 +101,9 @@ FancyScene::FancyScene( const std::string& scene_path )
 // Without this line, we can't use the forward declaration of Drawable in a unique_ptr<>.
 // From: https://stackoverflow.com/questions/13414652/forward-declaration-with-unique-ptr
 // From: https://stackoverflow.com/questions/6012157/is-stdunique-ptrt-required-to-know-the-full-definition-of-t
-FancyScene::~FancyScene() = default;
+FancyScene::~FancyScene() {
+    if( m_frame_timer_queries[0] ) glDeleteQueries( kNumFrameTimerQueries, m_frame_timer_queries );
+}
 
 void FancyScene::init() {
     
@@ -90,11 +119,11 @@ void FancyScene::init() {
     // Turn on some standard OpenGL stuff.
     
     // We want the z-buffer.
-    glEnable( GL_DEPTH_TEST );
+    glstate::setEnabled( GL_DEPTH_TEST, true );
     
     // Allow alpha blending.
-    glEnable( GL_BLEND );
-    glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+    glstate::setEnabled( GL_BLEND, true );
+    glstate::blendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
     
     this->loadScene();
 }
@@ -120,10 +149,12 @@ void FancyScene::loadScene() {
     
     // Make a program.
     // Everyone else expects it to have been created so we can get binding locations.
-    m_drawable->program = ShaderProgram::makePtr();
+    // Keep the current one if we have it. loadShaders() replaces it only if the shaders changed.
+    if( !m_drawable->program ) m_drawable->program = ShaderProgram::makePtr();
     
     m_shader_changed = true;
     m_mesh_changed = true;
+    m_atlas_changed = true;
     m_uniforms_changed = true;
     m_textures_changed = true;
     m_animation_changed = true;
@@ -154,6 +185,132 @@ void FancyScene::loadScene() {
             }
         }
     }
+    
+    // How many threads decode textures.
+    if( j.count("TextureDecodeThreads") ) {
+        if( !j["TextureDecodeThreads"].is_number_integer() ) {
+            cerr << "ERROR: TextureDecodeThreads is not an integer.\n";
+        } else {
+            set_texture_decode_threads( j["TextureDecodeThreads"].get<int>() );
+        }
+    }
+    
+    // Save decoded textures to disk?
+    set_texture_cache_directory( "" );
+    if( j.count("TextureCacheDirectory") ) {
+        if( !j["TextureCacheDirectory"].is_string() ) {
+            cerr << "ERROR: TextureCacheDirectory is not a string.\n";
+        } else {
+            set_texture_cache_directory( relativePathFromJSONPath( j["TextureCacheDirectory"].get<std::string>() ) );
+        }
+    }
+    
+    // Pack small textures into shared atlas pages?
+    // This is true, false, or an object with atlas options.
+    m_atlas_enabled = false;
+    m_atlas_options = TextureAtlasOptions();
+    if( j.count("TextureAtlas") ) {
+        if( j["TextureAtlas"].is_boolean() ) {
+            m_atlas_enabled = j["TextureAtlas"].get<bool>();
+        } else if( j["TextureAtlas"].is_object() ) {
+            m_atlas_enabled = true;
+            parseTextureAtlasOptions( j["TextureAtlas"], m_atlas_options );
+        } else {
+            cerr << "ERROR: TextureAtlas is not a boolean or an object.\n";
+        }
+    }
+    
+    // Upload textures in the background, showing a placeholder until they arrive?
+    set_texture_streaming( false );
+    if( j.count("StreamTextures") ) {
+        if( !j["StreamTextures"].is_boolean() ) {
+            cerr << "ERROR: StreamTextures is not a boolean.\n";
+        } else {
+            set_texture_streaming( j["StreamTextures"].get<bool>() );
+        }
+    }
+    
+    // Sample the animation with interpolate() or from its compiled form?
+    m_compiled_sampling = false;
+    m_rotation_interpolation = RotationInterpolation::Nlerp;
+    if( j.count("AnimationSampling") ) {
+        const std::string sampling = j["AnimationSampling"].is_string() ? j["AnimationSampling"].get<std::string>() : "";
+        if( sampling == "interpolate" ) {
+            m_compiled_sampling = false;
+        } else if( sampling == "nlerp" ) {
+            m_compiled_sampling = true;
+            m_rotation_interpolation = RotationInterpolation::Nlerp;
+        } else if( sampling == "slerp" ) {
+            m_compiled_sampling = true;
+            m_rotation_interpolation = RotationInterpolation::Slerp;
+        } else {
+            cerr << "ERROR: AnimationSampling is not \"interpolate\", \"nlerp\", or \"slerp\".\n";
+        }
+    }
+    
+    // Compress the animation, keeping joints within this distance of where they should be?
+    m_compression_tolerance = 0;
+    if( j.count("AnimationCompression") ) {
+        if( !j["AnimationCompression"].is_number() || j["AnimationCompression"].get<real>() < 0 ) {
+            cerr << "ERROR: AnimationCompression is not a non-negative number.\n";
+        } else {
+            m_compression_tolerance = j["AnimationCompression"].get<real>();
+        }
+    }
+    
+    // Save compiled animations to disk?
+    m_animation_cache_directory.clear();
+    if( j.count("AnimationCacheDirectory") ) {
+        if( !j["AnimationCacheDirectory"].is_string() ) {
+            cerr << "ERROR: AnimationCacheDirectory is not a string.\n";
+        } else {
+            m_animation_cache_directory = relativePathFromJSONPath( j["AnimationCacheDirectory"].get<std::string>() );
+            if( !make_directory( m_animation_cache_directory ) ) {
+                cerr << "ERROR: Unable to create compiled animation cache directory: " << m_animation_cache_directory << '\n';
+                m_animation_cache_directory.clear();
+            }
+        }
+    }
+    
+    // Save linked shader programs to disk?
+    m_shader_cache.setDiskDirectory( "" );
+    if( j.count("ShaderCacheDirectory") ) {
+        if( !j["ShaderCacheDirectory"].is_string() ) {
+            cerr << "ERROR: ShaderCacheDirectory is not a string.\n";
+        } else {
+            m_shader_cache.setDiskDirectory( relativePathFromJSONPath( j["ShaderCacheDirectory"].get<std::string>() ) );
+        }
+    }
+    
+    // Keep how many linked shader programs in memory?
+    m_shader_cache.setCapacity( 32 );
+    if( j.count("ShaderCacheCapacity") ) {
+        if( !j["ShaderCacheCapacity"].is_number_integer() || j["ShaderCacheCapacity"].get<int>() < 0 ) {
+            cerr << "ERROR: ShaderCacheCapacity is not a non-negative integer.\n";
+        } else {
+            m_shader_cache.setCapacity( j["ShaderCacheCapacity"].get<int>() );
+        }
+    }
+    
+    // Compile changed shaders without blocking drawing? This needs KHR_parallel_shader_compile.
+    m_async_shader_compile = true;
+    if( j.count("AsyncShaderCompile") ) {
+        if( !j["AsyncShaderCompile"].is_boolean() ) {
+            cerr << "ERROR: AsyncShaderCompile is not a boolean.\n";
+        } else {
+            m_async_shader_compile = j["AsyncShaderCompile"];
+        }
+    }
+    
+    // Report the average frame time after textures load?
+    m_measure_frames = false;
+    if( j.count("MeasureFrames") ) {
+        if( !j["MeasureFrames"].is_boolean() ) {
+            cerr << "ERROR: MeasureFrames is not a boolean.\n";
+        } else {
+            m_measure_frames = j["MeasureFrames"];
+        }
+    }
 }
 
 void FancyScene::loadShaders() {
@@ -171,21 +328,137 @@ void FancyScene::loadShaders() {
         return;
     }
     
-    // Load shaders.
-    const StringSet paths_accessed = parseShader( j["shaders"], *m_drawable->program, relativePathFromJSONPathTransformer() );
+    // Load the shader sources.
+    ShaderSources sources;
+    const StringSet paths_accessed = parseShaderSources( j["shaders"], sources, relativePathFromJSONPathTransformer() );
+    
+    // Add shader paths to the file watcher.
+    for( const auto& path : paths_accessed ) {
+        m_watcher.watchPath( path, [=]( const std::string& ) { this->m_shader_changed = true; } );
+    }
+    
+    // Build the other variants the scene may switch to, so that they are in the cache when it does.
+    if( j.count("ShaderVariants") ) buildShaderVariants( j["shaders"], j["ShaderVariants"] );
+    
+    // If the current program was linked from exactly these sources, we're done.
+    const ShaderProgramCache::Key hashes = source_hashes( sources );
+    if( hashes == m_drawable->program->linkedSourceHashes() ) {
+        cerr << "Shader sources unchanged; keeping the current program.\n";
+        // Any program still being built is out-of-date.
+        m_pending_program.reset();
+        return;
+    }
+    
+    // We may have compiled these sources before (e.g. this variant's #defines).
+    const ShaderProgramPtr cached = m_shader_cache.find( hashes );
+    if( cached ) {
+        m_pending_program.reset();
+        setProgram( cached );
+        return;
+    }
+    
+    // Build a replacement program. Only the stages that changed are compiled.
+    // The current program keeps drawing until the replacement has linked.
+    m_pending_program = ShaderProgram::makePtr();
+    m_pending_program->shareCompiledShaders( *m_drawable->program );
+    addShaderSources( sources, *m_pending_program );
+    if( !m_shader_cache.diskDirectory().empty() ) m_pending_program->requestRetrievableBinary();
+    m_pending_program->beginLink();
+    
+    // If there is no working program to fall back on, we have to wait.
+    const bool have_working_program = !m_drawable->program->linkedSourceHashes().empty();
+    if( have_working_program ) {
+        m_measuring_reload = true;
+        m_reload_max_frame_milliseconds = 0;
+    }
+    // Otherwise, reloadChanged() finishes it on a later frame, once the driver says it's ready.
+    // Without KHR_parallel_shader_compile, the driver can't say, so waiting on a later frame
+    // would only move the stall there; finish it now.
+    if( !( asyncShaderCompile() && have_working_program ) ) finishLoadingShaders( true );
+}
+
+void FancyScene::buildShaderVariants( const json& j_shaders, const json& j_variants ) {
+    if( !j_variants.is_array() ) {
+        cerr << "ERROR: ShaderVariants is not an array of arrays of defines.\n";
+        return;
+    }
+    
+    const auto start = std::chrono::steady_clock::now();
+    int num_built = 0;
+    for( const auto& defines : j_variants ) {
+        // The scene's shaders with these defines instead of its own.
+        json j_variant = j_shaders;
+        j_variant["defines"] = defines;
+        ShaderSources sources;
+        parseShaderSources( j_variant, sources, relativePathFromJSONPathTransformer() );
+        
+        // find() reports hits.
+        const ShaderProgramCache::Key hashes = source_hashes( sources );
+        if( m_shader_cache.find( hashes ) ) continue;
+        
+        const auto variant_start = std::chrono::steady_clock::now();
+        ShaderProgramPtr program = ShaderProgram::makePtr();
+        program->shareCompiledShaders( *m_drawable->program );
+        addShaderSources( sources, *program );
+        if( !m_shader_cache.diskDirectory().empty() ) program->requestRetrievableBinary();
+        if( !program->link() ) {
+            cerr << "ERROR: Shader variant with defines " << defines << " failed to build.\n";
+            continue;
+        }
+        m_shader_cache.insert( program );
+        num_built += 1;
+        cerr << "Shader variant with defines " << defines << " wasn't cached. Built it in " << milliseconds_since( variant_start ) << " ms.\n";
+    }
+    
+    cerr << "Prepared " << j_variants.size() << " shader variants in " << milliseconds_since( start ) << " ms ("
+         << num_built << " built, " << m_shader_cache.compilesAvoided() << " shader compiles avoided so far).\n";
+}
+
+bool FancyScene::asyncShaderCompile() const {
+    return m_async_shader_compile && ShaderProgram::supportsParallelCompile();
+}
+
+void FancyScene::finishLoadingShaders( bool wait ) {
+    if( !m_pending_program ) return;
+    if( !wait && !m_pending_program->isReady() ) return;
+    
+    ShaderProgramPtr program;
+    program.swap( m_pending_program );
+    const bool linked = program->finishLink();
+    
+    // Keep drawing with the last program that worked.
+    const bool have_working_program = !m_drawable->program->linkedSourceHashes().empty();
+    if( !linked && have_working_program ) {
+        cerr << "ERROR: Shaders failed to build. Drawing with the last program that linked.\n";
+        return;
+    }
+    
+    if( linked ) m_shader_cache.insert( program );
+    setProgram( program );
+}
+
+void FancyScene::setProgram( const ShaderProgramPtr& program ) {
+    assert( program );
+    
+    // The vertex arrays were set up with the old program's attribute locations.
+    const ShaderProgramPtr old_program = m_drawable->program;
+    const bool have_working_program = !old_program->linkedSourceHashes().empty();
+    m_drawable->program = program;
     
-    // If the set of active attributes has changed, reload the mesh
+    // If the set of active attributes or their locations changed, reload the mesh
     // so we re-upload the attributes.
     const StringSet new_active_attributes = m_drawable->program->getActiveAttributes();
     if( new_active_attributes != m_shader_active_attributes ) {
         m_mesh_changed = true;
     }
-    m_shader_active_attributes = new_active_attributes;
-    
-    // Add shader paths to the file watcher.
-    for( const auto& path : paths_accessed ) {
-        m_watcher.watchPath( path, [=]( const std::string& ) { this->m_shader_changed = true; } );
+    if( have_working_program ) {
+        for( const auto& name : new_active_attributes ) {
+            if( program->getAttribLocation( name ) != old_program->getAttribLocation( name ) ) {
+                m_mesh_changed = true;
+            }
+        }
     }
+    m_shader_active_attributes = new_active_attributes;
 }
 
 void FancyScene::loadMesh() {
@@ -211,10 +484,15 @@ void FancyScene::loadMesh() {
     // Pass the program so we have locations for the positions, normals, and texcoords.
     const auto meshpath = relativePathFromJSONPath( j["mesh"].get<std::string>() );
     // Add the mesh path to the filewatcher.
-    m_watcher.watchPath( meshpath, [=]( const std::string& ) { this->m_mesh_changed = true; } );
+    m_watcher.watchPath( meshpath, [=]( const std::string& path ) {
+        this->m_mesh_cache.invalidate( path );
+        this->m_mesh_changed = true;
+        } );
     
     // Upload the mesh to the GPU.
-    m_drawable->vao = vaoFromOBJPath( meshpath, *m_drawable->program );
+    const auto start = std::chrono::steady_clock::now();
+    m_drawable->vao = vaoFromOBJPath( meshpath, *m_drawable->program, m_mesh_cache );
+    cerr << "Loaded mesh in " << std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count() << " ms: " << meshpath << '\n';
 }
 
 void FancyScene::loadUniforms() {
@@ -243,21 +521,100 @@ void FancyScene::loadUniforms() {
         json j_uniforms;
         const bool success = loadJSONFromPath( uniformpath, j_uniforms );
         if( success ) {
-            parseUniforms( j_uniforms, m_drawable->uniforms, m_texture_names_in_bind_order );
+            parseUniforms( j_uniforms, m_drawable->uniforms, m_texture_names_in_bind_order, &m_atlased_textures, &m_samplers_in_bind_order );
         }
         
         // Add the mesh path to the filewatcher.
-        m_watcher.watchPath( uniformpath, [=]( const std::string& ) { this->m_uniforms_changed = true; } );
+        // Its samplers decide which textures can be atlased.
+        m_watcher.watchPath( uniformpath, [=]( const std::string& ) {
+            this->m_uniforms_changed = true;
+            if( this->m_atlas_enabled ) this->m_atlas_changed = true;
+        } );
     }
     // Otherwise uniforms is JSON.
     else {
-        parseUniforms( j["uniforms"], m_drawable->uniforms, m_texture_names_in_bind_order );
+        parseUniforms( j["uniforms"], m_drawable->uniforms, m_texture_names_in_bind_order, &m_atlased_textures, &m_samplers_in_bind_order );
+    }
+    
+    // Sampler objects are shared and cheap to switch, so changing them doesn't reload textures.
+    m_drawable->samplers.clear();
+    for( const auto& sampler : m_samplers_in_bind_order ) {
+        m_drawable->samplers.push_back( SamplerCache::shared().get( sampler ) );
     }
     
     // If the texture names changed, reload textures.
     if( last_texture_names_in_bind_order != m_texture_names_in_bind_order ) m_textures_changed = true;
 }
 
+void FancyScene::loadAtlas() {
+    // Mark that we are no longer out-of-date with the parsed info.
+    this->m_atlas_changed = false;
+    
+    // The following code wants the scene JSON called `j`.
+    const auto& j = m_scene;
+    
+    // The uniforms will read the new pages (or the textures themselves).
+    const bool had_atlas = !m_atlased_textures.empty();
+    m_atlased_textures.clear();
+    m_atlas_pages.clear();
+    if( !m_atlas_enabled || !j.count("textures") || !j["textures"].is_object() ) {
+        if( had_atlas ) m_uniforms_changed = true;
+        return;
+    }
+    
+    // Textures read with repeat or mirror wrapping need their own texture.
+    json j_uniforms;
+    if( j.count("uniforms") && j["uniforms"].is_string() ) loadJSONFromPath( relativePathFromJSONPath( j["uniforms"].get<std::string>() ), j_uniforms );
+    else if( j.count("uniforms") ) j_uniforms = j["uniforms"];
+    const StringSet wrapped = parseWrappedTextureNames( j_uniforms );
+    
+    // Only plain 2D texture paths are packed.
+    // Cube maps and textures with their own settings keep their own textures.
+    StringVec names;
+    StringVec paths;
+    const auto& j_textures = j["textures"];
+    for( json::const_iterator iter = j_textures.begin(); iter != j_textures.end(); ++iter ) {
+        if( !iter.value().is_string() ) continue;
+        if( wrapped.count( iter.key() ) ) {
+            cerr << "Not atlasing texture " << iter.key() << ", because a sampler wraps it.\n";
+            continue;
+        }
+        names.push_back( iter.key() );
+        paths.push_back( relativePathFromJSONPath( iter.value().get<std::string>() ) );
+        
+        // Add the texture path to the filewatcher. Only its image is decoded again when it changes.
+        m_watcher.watchPath( paths.back(), [=]( const std::string& path ) {
+            this->m_atlas_builder.invalidate( path );
+            this->m_atlas_changed = true;
+        } );
+    }
+    
+    const TextureAtlas atlas = m_atlas_builder.build( paths, m_atlas_options, &texture_decode_pool() );
+    
+    StringVec page_names;
+    for( int page = 0; page < atlas.pages.size(); ++page ) {
+        page_names.push_back( "atlas page " + std::to_string( page ) );
+        
+        TextureSettings settings;
+        settings.mipmaps = atlas.pages[page].levels.size() > 1 ? TextureSettings::CPUMipmaps : TextureSettings::NoMipmaps;
+        m_atlas_pages[ page_names.back() ] = ImageTexture2D::makePtr( atlas.pages[page], settings );
+    }
+    
+    for( int i = 0; i < names.size(); ++i ) {
+        const auto placement = atlas.placements.find( paths[i] );
+        // Textures that didn't fit are loaded on their own by loadTextures().
+        if( placement == atlas.placements.end() ) continue;
+        
+        AtlasedTexture atlased;
+        atlased.page_name = page_names.at( placement->second.page );
+        atlased.uv_scale_offset = placement->second.uv_scale_offset;
+        m_atlased_textures[ names[i] ] = atlased;
+    }
+    
+    m_uniforms_changed = true;
+    m_textures_changed = true;
+}
+
 void FancyScene::loadTextures() {
     assert( m_drawable && m_drawable->program );
     
@@ -269,44 +626,87 @@ void FancyScene::loadTextures() {
     const StringVec& texture_names_in_bind_order = m_texture_names_in_bind_order;
     
     // Only load textures that are needed.
-    m_drawable->textures.clear();
+    // Hold on to the old textures until we're done, so that the cache can hand back
+    // the ones whose files haven't changed instead of loading them again.
+    const auto start = std::chrono::steady_clock::now();
+    TextureCache& cache = TextureCache::shared();
+    const int hits_before = cache.hits();
+    const int decoded_before = cache.imagesDecoded();
+    TextureVec old_textures;
+    old_textures.swap( m_drawable->textures );
     m_drawable->textures.resize( texture_names_in_bind_order.size() );
+    // When a texture file changes, the cache reloads it next time we ask.
+    const auto texture_file_changed = [=]( const std::string& path ) {
+        TextureCache::shared().invalidate( path );
+        this->m_textures_changed = true;
+    };
     if( j.count("textures") ) {
         auto j_textures = j["textures"];
         for( int i = 0; i < texture_names_in_bind_order.size(); ++i ) {
             const auto& name = texture_names_in_bind_order.at(i);
             
+            // Atlas pages aren't in the scene's textures.
+            const auto page = m_atlas_pages.find( name );
+            if( page != m_atlas_pages.end() ) {
+                m_drawable->textures.at(i) = page->second;
+                continue;
+            }
+            
             if( !j_textures.count( name ) ) {
                 cerr << "ERROR: Uniform references a texture name that isn't present: " << name << '\n';
                 continue;
             }
             
+            // A texture is a path, an array of six cube map paths, or an object
+            // with "path" or "faces" and filtering settings.
+            json j_paths = j_textures[name];
+            TextureSettings settings;
+            if( j_paths.is_object() ) {
+                parseTextureSettings( j_paths, settings );
+                if( j_paths.count("path") ) j_paths = j_paths["path"];
+                else if( j_paths.count("faces") ) j_paths = j_paths["faces"];
+            }
+            
             // Add the texture paths to the filewatcher.
-            if( j_textures[name].is_string() ) {
-                const auto fullpath = relativePathFromJSONPath( j_textures[name].get<std::string>() );
-                m_drawable->textures.at(i) = Texture2D::makePtr( fullpath );
+            if( j_paths.is_string() ) {
+                const auto fullpath = relativePathFromJSONPath( j_paths.get<std::string>() );
+                m_drawable->textures.at(i) = cache.get2D( fullpath, settings );
                 // Add the texture path to the filewatcher.
-                m_watcher.watchPath( fullpath, [=]( const std::string& ) { this->m_textures_changed = true; } );
+                m_watcher.watchPath( fullpath, texture_file_changed );
             }
-            else if( j_textures[name].is_array() && j_textures[name].size() == 6 ) {
+            else if( j_paths.is_array() && j_paths.size() == 6 ) {
                 StringVec fullpaths;
                 fullpaths.resize(6);
                 for( int i = 0; i < 6; ++i ) {
-                    fullpaths.at(i) = relativePathFromJSONPath( j_textures[name][i].get<std::string>() );
+                    fullpaths.at(i) = relativePathFromJSONPath( j_paths[i].get<std::string>() );
                     // Add the texture path to the filewatcher.
-                    m_watcher.watchPath( fullpaths.at(i), [=]( const std::string& ) { this->m_textures_changed = true; } );
+                    m_watcher.watchPath( fullpaths.at(i), texture_file_changed );
                 }
-                m_drawable->textures.at(i) = TextureCube::makePtr(
-                    fullpaths[0], fullpaths[1],
-                    fullpaths[2], fullpaths[3],
-                    fullpaths[4], fullpaths[5]
-                    );
+                m_drawable->textures.at(i) = cache.getCube( fullpaths, settings );
             }
             else {
                 cerr << "ERROR: Texture data is formatted incorrectly: " << j_textures[name] << '\n';
             }
         }
     }
+    
+    cerr << "Loaded textures in " << std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count() << " ms ("
+         << ( cache.imagesDecoded() - decoded_before ) << " images decoded, "
+         << ( cache.hits() - hits_before ) << " textures reused).\n";
+    
+    // Report how many binds a draw makes and, if the scene asks, what a frame costs with them.
+    int num_pages = 0;
+    for( const auto& name : texture_names_in_bind_order ) num_pages += m_atlas_pages.count( name );
+    cerr << "Each draw binds " << texture_names_in_bind_order.size() << " textures (" << num_pages << " of them atlas pages).\n";
+    m_frames_to_measure = m_measure_frames ? 100 : 0;
+    m_frames_measured = 0;
+    m_measured_frame_milliseconds = 0;
+    // Queries still pending timed frames with the old textures.
+    m_frame_timer_queries_stale = m_frame_timer_queries_pending;
+    m_gpu_frames_measured = 0;
+    m_measured_gpu_milliseconds = 0;
+    m_measured_state_calls_issued = 0;
+    m_measured_state_calls_skipped = 0;
 }
 
 void FancyScene::loadAnimation() {
@@ -321,6 +721,8 @@ void FancyScene::loadAnimation() {
     /// Load the animation.
     m_skeleton.clear();
     m_animation.clear();
+    m_compiled_animation.clear();
+    m_compressed_animation.clear();
     m_skelview.reset();
     
     // Load the skeleton and animation from the BVH.
@@ -334,7 +736,18 @@ void FancyScene::loadAnimation() {
     const auto BVHpath = relativePathFromJSONPath( j["animation"].get<std::string>() );
     // Add the animation path to the filewatcher.
     m_watcher.watchPath( BVHpath, [=]( const std::string& ) { this->m_animation_changed = true; } );
-    if( !loadBVH( BVHpath, m_skeleton, m_animation ) ) {
+    // Only load the form timerEvent() samples.
+    // Decode the frames on the texture decoding threads as well as this one.
+    if( m_compression_tolerance > 0 ) {
+        CompressionSettings settings;
+        settings.tolerance = m_compression_tolerance;
+        graphics101::real max_error = 0;
+        if( !load_compressed_animation( BVHpath, m_animation_cache_directory, settings, m_skeleton, m_compressed_animation, &max_error, &texture_decode_pool() ) ) {
+            cerr << "Error loading BVH file: " << BVHpath << '\n';
+            return;
+        }
+        cerr << "Compressed the animation to " << m_compressed_animation.sizeInBytes()/1024. << " KB with a world-space error of up to " << max_error << ".\n";
+    } else if( !load_animation( BVHpath, m_animation_cache_directory, m_skeleton, m_compiled_sampling ? nullptr : &m_animation, m_compiled_sampling ? &m_compiled_animation : nullptr, &texture_decode_pool() ) ) {
         cerr << "Error loading BVH file: " << BVHpath << '\n';
         return;
     }
@@ -355,11 +768,18 @@ void FancyScene::reloadChanged() {
     
     // loadScene() first, because it marks the others dirty.
     if( this->m_scene_changed     ) this->loadScene();
+    // Swap in shaders compiling in the background once they are ready.
+    // This comes before loadShaders(), so that a program it starts building is first
+    // polled a frame later.
+    this->finishLoadingShaders( false );
     if( this->m_shader_changed    ) this->loadShaders();
     if( this->m_mesh_changed      ) this->loadMesh();
+    if( this->m_atlas_changed     ) this->loadAtlas();
     if( this->m_uniforms_changed  ) this->loadUniforms();
     if( this->m_textures_changed  ) this->loadTextures();
     if( this->m_animation_changed ) this->loadAnimation();
+    // Move streaming textures along.
+    m_textures_streaming = update_streaming_textures();
 }
 
 namespace {
@@ -408,8 +828,21 @@ void FancyScene::setCameraUniforms() {
 }
 
 void FancyScene::draw() {
+    const auto frame_start = std::chrono::steady_clock::now();
+    // Count the GL state calls this frame makes.
+    glstate::resetCounters();
+    
     reloadChanged();
     
+    // While measuring, time the GPU, too, unless every query is still waiting for its result.
+    const bool measuring = m_frames_measured < m_frames_to_measure;
+    const bool timing_gpu = measuring && m_frame_timer_queries_pending < kNumFrameTimerQueries;
+    if( timing_gpu ) {
+        if( !m_frame_timer_queries[0] ) glGenQueries( kNumFrameTimerQueries, m_frame_timer_queries );
+        const int next = ( m_frame_timer_query_oldest + m_frame_timer_queries_pending ) % kNumFrameTimerQueries;
+        glBeginQuery( GL_TIME_ELAPSED, m_frame_timer_queries[ next ] );
+    }
+    
     glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
     
     setCameraUniforms();
@@ -425,6 +858,66 @@ void FancyScene::draw() {
     // This passes in general, but if there is a shader error it fails.
     // We don't want the program to terminate that way.
     // assert( glGetError() == GL_NO_ERROR );
+    
+    if( timing_gpu ) {
+        glEndQuery( GL_TIME_ELAPSED );
+        m_frame_timer_queries_pending += 1;
+    }
+    readFrameTimerQueries();
+    
+    // This is the CPU's time. The GPU may still be working on the frame.
+    const double frame_milliseconds = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - frame_start ).count();
+    
+    // Report the average frame after textures load, once the GPU's times for it are in.
+    if( measuring ) {
+        m_measured_frame_milliseconds += frame_milliseconds;
+        m_measured_state_calls_issued += glstate::counters().issued;
+        m_measured_state_calls_skipped += glstate::counters().skipped;
+        m_frames_measured += 1;
+    }
+    if( m_frames_to_measure > 0 && m_frames_measured == m_frames_to_measure && m_frame_timer_queries_pending == 0 ) {
+        cerr << "Average frame time over " << m_frames_measured << " frames with "
+             << m_drawable->textures.size() << " texture binds per draw: "
+             << m_measured_frame_milliseconds/m_frames_measured << " ms ("
+             << m_measured_gpu_milliseconds/std::max( m_gpu_frames_measured, 1 ) << " ms on the GPU over "
+             << m_gpu_frames_measured << " of them).\n";
+        cerr << "GL state calls per frame: " << double( m_measured_state_calls_issued )/m_frames_measured << " issued, "
+             << double( m_measured_state_calls_skipped )/m_frames_measured << " skipped as redundant.\n";
+        m_frames_to_measure = 0;
+        m_frames_measured = 0;
+    }
+    
+    // Report the longest frame while shaders were reloading.
+    if( m_measuring_reload ) {
+        m_reload_max_frame_milliseconds = std::max( m_reload_max_frame_milliseconds, frame_milliseconds );
+        if( !m_pending_program ) {
+            cerr << "Shader reload finished. Longest frame during the reload: " << m_reload_max_frame_milliseconds << " ms ("
+                 << ( asyncShaderCompile() ? "asynchronous" : "synchronous" ) << " compilation).\n";
+            m_measuring_reload = false;
+        }
+    }
+}
+
+void FancyScene::readFrameTimerQueries() {
+    // Queries finish in the order they were issued, so stop at the first that hasn't.
+    while( m_frame_timer_queries_pending > 0 ) {
+        const GLuint query = m_frame_timer_queries[ m_frame_timer_query_oldest ];
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv( query, GL_QUERY_RESULT_AVAILABLE, &available );
+        if( !available ) break;
+        
+        GLuint64 gpu_nanoseconds = 0;
+        glGetQueryObjectui64v( query, GL_QUERY_RESULT, &gpu_nanoseconds );
+        m_frame_timer_query_oldest = ( m_frame_timer_query_oldest + 1 ) % kNumFrameTimerQueries;
+        m_frame_timer_queries_pending -= 1;
+        
+        if( m_frame_timer_queries_stale > 0 ) {
+            m_frame_timer_queries_stale -= 1;
+        } else {
+            m_measured_gpu_milliseconds += gpu_nanoseconds*1e-6;
+            m_gpu_frames_measured += 1;
+        }
+    }
 }
 
 void FancyScene::mousePressEvent( const Event& event ) {
@@ -454,27 +947,47 @@ void FancyScene::timerEvent( real seconds_since_creation ) {
     m_drawable->uniforms.storeUniform( "uTime", GLfloat( seconds_since_creation ) );
     
     // Update the animation.
-    if( !m_skeleton.empty() && !m_animation.frames.empty() ) {
+    if( !m_skeleton.empty() && !( m_animation.frames.empty() && m_compiled_animation.empty() && m_compressed_animation.empty() ) ) {
+        // Everything for this frame comes from m_frame_arena, so that once it has grown
+        // to fit a frame, posing the skeleton doesn't touch the heap.
+        // tests/test_frame_allocations.cpp checks that.
+        m_frame_arena.reset();
+        const int num_bones = int( m_skeleton.size() );
+        
         // Interpolate the animation.
-        MatrixPose bone2parent = MatrixPoseFromTRSPose( interpolate( m_animation, seconds_since_creation ) );
+        mat4* bone2parent = m_frame_arena.allocate< mat4 >( num_bones );
+        if( !m_compressed_animation.empty() ) {
+            assert( m_compressed_animation.num_bones == num_bones );
+            QuatTRS* pose = m_frame_arena.allocate< QuatTRS >( num_bones );
+            sample_animation( m_compressed_animation, seconds_since_creation, pose );
+            matrices_from_pose( pose, num_bones, bone2parent );
+        } else if( !m_compiled_animation.empty() ) {
+            assert( m_compiled_animation.num_bones == num_bones );
+            QuatTRS* pose = m_frame_arena.allocate< QuatTRS >( num_bones );
+            sample_animation( m_compiled_animation, seconds_since_creation, pose, m_rotation_interpolation );
+            matrices_from_pose( pose, num_bones, bone2parent );
+        } else {
+            assert( m_animation.frames.front().size() == m_skeleton.size() );
+            TRS* pose = m_frame_arena.allocate< TRS >( num_bones );
+            interpolate( m_animation, seconds_since_creation, pose );
+            matrices_from_pose( pose, num_bones, bone2parent );
+        }
         
         // Turn off the root's translation so that the animation happens in-place where
         // we can better see it.
-        assert( m_skeleton.size() == bone2parent.size() );
-        for( int i = 0; i < m_skeleton.size(); ++i ) {
-            if( m_skeleton.at(i).parent_index >= 0 ) {
-                bone2parent.at(i)[3] = vec4(0,0,0,1);
-            }
-        }
+        pin_joints( m_skeleton, bone2parent );
         
         // Call forward kinematics to get bone2world matrices.
-        const MatrixPose bone2world = forward_kinematics( m_skeleton, bone2parent );
+        mat4* bone2world = m_frame_arena.allocate< mat4 >( num_bones );
+        forward_kinematics( m_skeleton, bone2parent, bone2world );
         
         // Update the skeleton visualizer.
-        m_skelview.setPose( bone2world );
+        m_skelview.setPose( bone2world, num_bones );
     }
 }
 int FancyScene::timerCallbackMilliseconds() {
+    // Keep drawing while textures stream in, or else they won't finish until the next event.
+    if( m_textures_streaming && m_timerMilliseconds < 0 ) return 16;
     return m_timerMilliseconds;
 }
 
@@ -5,7 +5,14 @@
 #include "pipelineguifactory.h"
 #include "filewatchermtime.h"
 #include "animation.h"
+#include "compiledanimation.h"
+#include "animationcompression.h"
 #include "kinematics_visualizer.h"
+#include "shaderprogramcache.h"
+#include "meshcache.h"
+#include "textureatlas.h"
+#include "samplercache.h"
+#include "framearena.h"
 
 // Forward declarations.
 #include "glfwd.h"
@@ -53,11 +60,28 @@ protected:
     // Call parseShaders() first, because it other parsers assume that m_program
     // has already been created.
     void loadShaders();
+    // Makes sure the shader cache has the scene's shaders compiled with each set of
+    // defines in `j_variants`, building the ones it doesn't. Logs the hits and misses.
+    void buildShaderVariants( const json& j_shaders, const json& j_variants );
+    // Swaps m_pending_program in for the drawable's program once it has finished
+    // linking. If `wait` is true, blocks until it has.
+    void finishLoadingShaders( bool wait );
+    // Whether the scene asked to build shaders in the background and the driver can.
+    bool asyncShaderCompile() const;
+    // Makes `program` the drawable's program. Marks the mesh changed if
+    // the program's vertex attributes differ.
+    void setProgram( const ShaderProgramPtr& program );
     void loadMesh();
+    // Packs the scene's small textures into atlas pages, if it asks for that.
+    // Call this before loadUniforms(), which redirects samplers to the pages.
+    void loadAtlas();
     void loadUniforms();
     void loadTextures();
     void loadAnimation();
     
+    // Reads the frame timer queries whose results are available, without waiting for the rest.
+    void readFrameTimerQueries();
+    
     // Transforms a path in the JSON file to a path that can
     // be opened with a file system call by prepending
     // the base directory of the scene file. For example,
@@ -77,16 +101,76 @@ private:
     bool m_scene_changed = true;
     bool m_shader_changed = true;
     bool m_mesh_changed = true;
+    bool m_atlas_changed = true;
     bool m_uniforms_changed = true;
     bool m_textures_changed = true;
     bool m_animation_changed = true;
     StringVec m_texture_names_in_bind_order;
+    SamplerSettingsVec m_samplers_in_bind_order;
     int m_timerMilliseconds = -1;
     StringSet m_shader_active_attributes;
     
+    // A replacement program compiling and linking in the background.
+    // The drawable's program keeps drawing until it is ready.
+    ShaderProgramPtr m_pending_program;
+    bool m_async_shader_compile = true;
+    // Every program we've linked, so that switching back to a
+    // shader variant doesn't compile it again.
+    ShaderProgramCache m_shader_cache;
+    // The processed meshes, so that re-uploading the attributes for a new
+    // shader doesn't read the OBJ again.
+    MeshCache m_mesh_cache;
+    // Related to measuring frame times while shaders reload.
+    bool m_measuring_reload = false;
+    double m_reload_max_frame_milliseconds = 0;
+    // Whether any textures were still streaming after the last update_streaming_textures().
+    bool m_textures_streaming = false;
+    
+    // Related to the texture atlas.
+    bool m_atlas_enabled = false;
+    TextureAtlasOptions m_atlas_options;
+    // The textures that are in a page, keyed by texture name.
+    AtlasedTextures m_atlased_textures;
+    // The pages, keyed by the names AtlasedTexture::page_name refers to.
+    TextureSet m_atlas_pages;
+    // Keeps the decoded images, so that a changed file doesn't decode the others again.
+    TextureAtlasBuilder m_atlas_builder;
+    // Related to measuring frame times after textures load, if the scene asks for that.
+    bool m_measure_frames = false;
+    int m_frames_to_measure = 0;
+    int m_frames_measured = 0;
+    double m_measured_frame_milliseconds = 0;
+    // GL_TIME_ELAPSED queries for timing the GPU's part of the measured frames.
+    // Frames use them in turn, and we read each one once its result is available,
+    // a frame or more later, so that measuring doesn't wait for the GPU.
+    static const int kNumFrameTimerQueries = 4;
+    GLuint m_frame_timer_queries[ kNumFrameTimerQueries ] = {};
+    // How many queries are waiting to be read, starting from the oldest.
+    int m_frame_timer_queries_pending = 0;
+    int m_frame_timer_query_oldest = 0;
+    // How many of the pending queries timed frames from before the measuring restarted.
+    int m_frame_timer_queries_stale = 0;
+    int m_gpu_frames_measured = 0;
+    double m_measured_gpu_milliseconds = 0;
+    long m_measured_state_calls_issued = 0;
+    long m_measured_state_calls_skipped = 0;
+    
     // Related to animation
     Skeleton m_skeleton;
+    // Only one of m_animation, m_compiled_animation, and m_compressed_animation is loaded,
+    // depending on m_compiled_sampling and m_compression_tolerance.
     BoneAnimation m_animation;
+    // Whether to sample m_compiled_animation instead of calling interpolate() on m_animation.
+    bool m_compiled_sampling = false;
+    RotationInterpolation m_rotation_interpolation = RotationInterpolation::Nlerp;
+    CompiledAnimation m_compiled_animation;
+    // The largest world-space error allowed when compressing the animation. 0 doesn't compress it.
+    real m_compression_tolerance = 0;
+    CompressedAnimation m_compressed_animation;
+    // Scratch memory for posing the skeleton each frame.
+    FrameArena m_frame_arena;
+    // Where load_animation() keeps compiled animations, or "" for nowhere.
+    std::string m_animation_cache_directory;
     KinematicsVisualizer m_skelview;
     bool m_showSkeleton = true;
     
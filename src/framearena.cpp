@@ -0,0 +1,52 @@
+#include "framearena.h"
+
+#include <cstdint> // uintptr_t
+
+namespace {
+// The padding needed after `address` to reach a multiple of `alignment`.
+std::size_t padding_for( const void* address, std::size_t alignment ) {
+    const std::uintptr_t misalignment = reinterpret_cast< std::uintptr_t >( address ) % alignment;
+    return misalignment == 0 ? 0 : alignment - misalignment;
+}
+}
+
+namespace graphics101 {
+
+FrameArena::FrameArena( std::size_t bytes ) {
+    if( bytes > 0 ) {
+        m_block.reset( new unsigned char[ bytes ] );
+        m_capacity = bytes;
+    }
+}
+
+void FrameArena::reset() {
+    // Grow to fit the whole frame, so that the next one like it fits in one block.
+    if( !m_overflow.empty() ) {
+        m_overflow.clear();
+        m_block.reset( new unsigned char[ m_used ] );
+        m_capacity = m_used;
+    }
+    m_offset = 0;
+    m_used = 0;
+}
+
+void* FrameArena::allocateBytes( std::size_t bytes, std::size_t alignment ) {
+    if( m_block ) {
+        const std::size_t padding = padding_for( m_block.get() + m_offset, alignment );
+        if( m_offset + padding + bytes <= m_capacity ) {
+            void* result = m_block.get() + m_offset + padding;
+            m_offset += padding + bytes;
+            m_used += padding + bytes;
+            return result;
+        }
+    }
+    
+    // Leave room to align it, which reset() needs to count, too.
+    const std::size_t size = bytes + alignment;
+    m_overflow.emplace_back( new unsigned char[ size ] );
+    m_used += size;
+    unsigned char* block = m_overflow.back().get();
+    return block + padding_for( block, alignment );
+}
+
+}
@@ -0,0 +1,60 @@
+#ifndef __framearena_h__
+#define __framearena_h__
+
+#include <cstddef> // size_t
+#include <memory> // unique_ptr
+#include <new> // placement new
+#include <type_traits> // is_trivially_destructible
+#include <vector>
+
+namespace graphics101 {
+
+/*
+Scratch memory that lasts until the end of the frame.
+allocate() hands out the next piece of one block, and reset() takes every piece back at once.
+If a frame needs more than the block holds, the rest comes from extra blocks, and the next
+reset() replaces them all with one block big enough for that frame.
+After that, frames that need no more than the largest frame so far don't touch the heap.
+Nothing allocated here is ever destroyed, so it only hands out trivially destructible types.
+*/
+class FrameArena {
+public:
+    // Starts with room for `bytes` bytes.
+    explicit FrameArena( std::size_t bytes = 0 );
+    
+    // Returns room for `count` default-constructed `T`s, valid until reset().
+    template< typename T >
+    T* allocate( std::size_t count ) {
+        static_assert( std::is_trivially_destructible< T >::value, "FrameArena never calls destructors." );
+        T* result = static_cast< T* >( allocateBytes( count*sizeof( T ), alignof( T ) ) );
+        for( std::size_t i = 0; i < count; ++i ) new( result + i ) T();
+        return result;
+    }
+    
+    // Frees everything allocated since the last reset().
+    void reset();
+    
+    // The bytes handed out since the last reset().
+    std::size_t used() const { return m_used; }
+    // The size of the block, which is the most any frame has used so far.
+    std::size_t capacity() const { return m_capacity; }
+    
+    // This class cannot be copied.
+    FrameArena( const FrameArena& ) = delete;
+    void operator=( const FrameArena& ) = delete;
+
+private:
+    void* allocateBytes( std::size_t bytes, std::size_t alignment );
+    
+    std::unique_ptr< unsigned char[] > m_block;
+    std::size_t m_capacity = 0;
+    // How far into m_block the next allocation can start.
+    std::size_t m_offset = 0;
+    std::size_t m_used = 0;
+    // Allocations that didn't fit in m_block this frame.
+    std::vector< std::unique_ptr< unsigned char[] > > m_overflow;
+};
+
+}
+
+#endif /* __framearena_h__ */
@@ -14,6 +14,10 @@ class ShaderProgram;
 struct UniformSet;
 class VertexAndFaceArrays;
 class Texture;
+struct TextureSettings;
+struct AtlasedTexture;
+struct TextureAtlasOptions;
+struct SamplerSettings;
 struct Drawable;
 
 typedef std::shared_ptr< ShaderProgram > ShaderProgramPtr;
@@ -25,6 +29,8 @@ typedef std::unordered_set< std::string > StringSet;
 typedef std::vector< TexturePtr > TextureVec;
 typedef std::vector< std::string > StringVec;
 typedef std::unique_ptr< Drawable > DrawablePtr;
+typedef std::unordered_map< std::string, AtlasedTexture > AtlasedTextures;
+typedef std::vector< SamplerSettings > SamplerSettingsVec;
 
 }
 
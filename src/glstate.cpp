@@ -0,0 +1,167 @@
+#include "glstate.h"
+
+#include "glcompat.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace {
+// A name that no object has, meaning we don't know what is bound.
+const GLuint kUnknown = ~GLuint(0);
+
+struct State {
+    GLuint program = kUnknown;
+    GLuint vertex_array = kUnknown;
+    
+    // The unit glActiveTexture() was last called with and the one activeTexture() asked for.
+    GLuint active_unit = kUnknown;
+    GLuint requested_unit = 0;
+    // The texture bound to each target of each unit. Missing means unknown.
+    std::vector< std::unordered_map< GLenum, GLuint > > textures;
+    // The sampler bound to each unit.
+    std::vector< GLuint > samplers;
+    
+    // -1 means unknown.
+    int blend = -1;
+    int depth_test = -1;
+    int depth_mask = -1;
+    GLenum blend_source = kUnknown;
+    GLenum blend_destination = kUnknown;
+    GLenum depth_function = kUnknown;
+    
+    graphics101::glstate::Counters counters;
+};
+State& state() {
+    static State s;
+    return s;
+}
+
+// Returns true, counting the call as issued, if `cached` isn't `value` already
+// (and remembers `value`). Otherwise counts the call as skipped.
+template< typename T >
+bool changes( T& cached, const T& value ) {
+    if( cached == value ) {
+        state().counters.skipped += 1;
+        return false;
+    }
+    cached = value;
+    state().counters.issued += 1;
+    return true;
+}
+
+// Binds `texture` to `target` on `unit` unless it already is.
+void bind_texture_on_unit( GLuint unit, GLenum target, GLuint texture ) {
+    State& s = state();
+    if( s.textures.size() <= unit ) s.textures.resize( unit + 1 );
+    
+    // An unknown binding compares unequal to every texture.
+    auto& bindings = s.textures[unit];
+    if( !bindings.count( target ) ) bindings[target] = kUnknown;
+    if( !changes( bindings[target], texture ) ) return;
+    
+    if( s.active_unit != unit ) {
+        glActiveTexture( GL_TEXTURE0 + unit );
+        s.active_unit = unit;
+        s.counters.issued += 1;
+    }
+    glBindTexture( target, texture );
+}
+}
+
+namespace graphics101 {
+namespace glstate {
+
+void useProgram( GLuint program ) {
+    if( changes( state().program, program ) ) glUseProgram( program );
+}
+
+void bindVertexArray( GLuint vertex_array ) {
+    if( changes( state().vertex_array, vertex_array ) ) glBindVertexArray( vertex_array );
+}
+
+void activeTexture( GLuint unit ) {
+    state().requested_unit = unit;
+}
+
+void bindTexture( GLenum target, GLuint texture ) {
+    bind_texture_on_unit( state().requested_unit, target, texture );
+}
+
+void editTexture( GLenum target, GLuint texture ) {
+    State& s = state();
+    if( s.active_unit == kUnknown ) {
+        glActiveTexture( GL_TEXTURE0 );
+        s.active_unit = 0;
+        s.counters.issued += 1;
+    }
+    bind_texture_on_unit( s.active_unit, target, texture );
+}
+
+void bindSampler( GLuint unit, GLuint sampler ) {
+    State& s = state();
+    if( s.samplers.size() <= unit ) s.samplers.resize( unit + 1, kUnknown );
+    if( changes( s.samplers[unit], sampler ) ) glBindSampler( unit, sampler );
+}
+
+void setEnabled( GLenum capability, bool enabled ) {
+    int* cached = nullptr;
+    if( capability == GL_BLEND ) cached = &state().blend;
+    else if( capability == GL_DEPTH_TEST ) cached = &state().depth_test;
+    
+    if( cached && !changes( *cached, int( enabled ) ) ) return;
+    if( !cached ) state().counters.issued += 1;
+    
+    if( enabled ) glEnable( capability );
+    else glDisable( capability );
+}
+
+void blendFunc( GLenum source_factor, GLenum destination_factor ) {
+    State& s = state();
+    if( s.blend_source == source_factor && s.blend_destination == destination_factor ) {
+        s.counters.skipped += 1;
+        return;
+    }
+    s.blend_source = source_factor;
+    s.blend_destination = destination_factor;
+    s.counters.issued += 1;
+    glBlendFunc( source_factor, destination_factor );
+}
+
+void depthFunc( GLenum function ) {
+    if( changes( state().depth_function, function ) ) glDepthFunc( function );
+}
+
+void depthMask( bool write ) {
+    if( changes( state().depth_mask, int( write ) ) ) glDepthMask( write ? GL_TRUE : GL_FALSE );
+}
+
+void forgetVertexArray( GLuint vertex_array ) {
+    // Deleting the bound vertex array binds 0.
+    if( state().vertex_array == vertex_array ) state().vertex_array = 0;
+}
+
+void forgetTexture( GLuint texture ) {
+    // Deleting a bound texture binds 0 in its place on every unit.
+    for( auto& bindings : state().textures ) {
+        for( auto& binding : bindings ) {
+            if( binding.second == texture ) binding.second = 0;
+        }
+    }
+}
+
+void invalidate() {
+    const Counters counters = state().counters;
+    state() = State();
+    state().counters = counters;
+}
+
+const Counters& counters() {
+    return state().counters;
+}
+
+void resetCounters() {
+    state().counters = Counters();
+}
+
+}
+}
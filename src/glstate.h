@@ -0,0 +1,66 @@
+#ifndef __glstate_h__
+#define __glstate_h__
+
+#include "types.h"
+
+namespace graphics101 {
+
+/*
+Remembers the OpenGL state we last set, and skips calls that wouldn't change it.
+It shadows the program in use, the bound vertex array, the texture and sampler bound
+to each texture unit, and blending and depth testing.
+For this to work, that state must only be changed through these functions.
+Call them on the OpenGL thread.
+*/
+namespace glstate {
+
+// glUseProgram()
+void useProgram( GLuint program );
+// glBindVertexArray()
+void bindVertexArray( GLuint vertex_array );
+
+// Makes `unit` (0, 1, 2, ..., not GL_TEXTURE0 + unit) the one bindTexture() binds to.
+// glActiveTexture() isn't called until a texture actually needs binding.
+void activeTexture( GLuint unit );
+// glBindTexture() on the unit set by activeTexture(), for drawing with.
+void bindTexture( GLenum target, GLuint texture );
+// glBindTexture() on the active unit, so that glTexImage2D(), glTexParameteri(), etc. change `texture`.
+// Use this rather than bindTexture() before changing a texture, since
+// bindTexture() may have skipped glActiveTexture().
+void editTexture( GLenum target, GLuint texture );
+
+// glBindSampler(). 0 means the texture's own filtering.
+void bindSampler( GLuint unit, GLuint sampler );
+
+// glEnable() or glDisable(). Only GL_BLEND and GL_DEPTH_TEST are shadowed.
+void setEnabled( GLenum capability, bool enabled );
+// glBlendFunc()
+void blendFunc( GLenum source_factor, GLenum destination_factor );
+// glDepthFunc()
+void depthFunc( GLenum function );
+// glDepthMask()
+void depthMask( bool write );
+
+// Call these right before deleting an object with glDelete*(),
+// which unbinds it, so that a new object given the same name isn't mistaken for it.
+void forgetVertexArray( GLuint vertex_array );
+void forgetTexture( GLuint texture );
+
+// Forgets everything, so that the next calls are all issued.
+// Call this after changing the state without going through these functions.
+void invalidate();
+
+// How many calls went to OpenGL and how many were skipped.
+struct Counters {
+    int issued = 0;
+    int skipped = 0;
+};
+// The counts since the last resetCounters(). Call that once per frame for per-frame counts.
+const Counters& counters();
+void resetCounters();
+
+}
+
+}
+
+#endif /* __glstate_h__ */
@@ -0,0 +1,24 @@
+#ifndef __hashing_h__
+#define __hashing_h__
+
+#include <cstdint> // uint64_t
+#include <cstddef> // size_t
+
+namespace graphics101 {
+
+// The 64-bit FNV-1a hash of `size` bytes at `data`.
+// Unlike std::hash, the result is the same across runs and platforms,
+// so it can name things saved to disk.
+// Pass the result of a previous call as `hash` to hash several pieces as one.
+inline std::uint64_t fnv1a( const void* data, std::size_t size, std::uint64_t hash = 14695981039346656037ull ) {
+    const unsigned char* bytes = static_cast< const unsigned char* >( data );
+    for( std::size_t i = 0; i < size; ++i ) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+}
+
+#endif /* __hashing_h__ */
@@ -0,0 +1,499 @@
+#include "image.h"
+
+#include "hashing.h"
+#include "mappedfile.h"
+#include "blockcompression.h"
+
+#include "stb_image.h"
+
+#include <algorithm> // equal(), min(), max()
+#include <cassert>
+#include <cmath> // pow(), sqrt()
+#include <chrono> // Measuring load times.
+#include <cstdint>
+#include <cstdio> // rename(), remove()
+#include <cstdlib> // malloc()
+#include <cstring> // memcpy()
+#include <fstream>
+#include <iomanip> // setw(), setfill()
+#include <sstream>
+#include <iostream>
+using std::cerr;
+
+namespace {
+using namespace graphics101;
+
+/*
+The decoded image cache file is:
+    ImageFileHeader
+    the source path (header.path_length bytes)
+    header.num_levels LevelHeaders
+    the texels of each level, starting at LevelHeader::offset
+It is a simpler version of the KTX container.
+*/
+const char kMagic[8] = { 'G','1','0','1','I','M','G','5' };
+struct ImageFileHeader {
+    char magic[8];
+    // The source file this was decoded from.
+    std::uint64_t source_size;
+    std::int64_t source_mtime;
+    std::uint32_t path_length;
+    // The ImageLoadOptions.
+    std::uint32_t flip;
+    std::uint32_t mipmaps;
+    std::uint32_t content;
+    std::uint32_t requested_channels;
+    std::uint32_t requested_encoding;
+    // The texels.
+    std::uint32_t channels;
+    std::uint32_t is_float;
+    std::uint32_t encoding;
+    std::uint32_t num_levels;
+};
+struct LevelHeader {
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+// Level data starts on a multiple of this.
+const std::uint64_t kLevelAlignment = 16;
+// Larger than any texture OpenGL allows, and its full mip chain.
+const std::uint32_t kMaxDimension = 1 << 16;
+const std::uint32_t kMaxLevels = 17;
+
+double milliseconds_since( const std::chrono::steady_clock::time_point& start ) {
+    return std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+}
+
+std::string cache_path( const std::string& cache_directory, const std::string& path, const ImageLoadOptions& options ) {
+    std::uint64_t hash = fnv1a( path.data(), path.size() );
+    const char options_bytes[5] = { char( options.flip ), char( options.mipmaps ), char( options.content ), char( options.channels ), char( options.encoding ) };
+    hash = fnv1a( options_bytes, sizeof( options_bytes ), hash );
+    
+    std::ostringstream name;
+    name << std::hex << std::setw( 16 ) << std::setfill( '0' ) << hash;
+    return cache_directory + '/' + name.str() + ".glimage";
+}
+
+// Returns an invalid image if there is no up-to-date cache file.
+Image load_cached( const std::string& file, const std::string& path, const ImageLoadOptions& options, std::uint64_t source_size, std::int64_t source_mtime ) {
+    Image image;
+    
+    std::size_t size = 0;
+    std::shared_ptr< const unsigned char > data = map_file( file, size );
+    // Not an error. It just hasn't been saved yet.
+    if( !data ) return image;
+    
+    ImageFileHeader header;
+    if( size < sizeof( header ) ) return image;
+    std::memcpy( &header, data.get(), sizeof( header ) );
+    if( !std::equal( kMagic, kMagic + sizeof( kMagic ), header.magic ) ) return image;
+    // Out-of-date?
+    if( header.source_size != source_size || header.source_mtime != source_mtime ) return image;
+    if( header.flip != std::uint32_t( options.flip ) || header.mipmaps != std::uint32_t( options.mipmaps ) || header.content != std::uint32_t( options.content ) ) return image;
+    if( header.requested_channels != std::uint32_t( options.channels ) || header.requested_encoding != std::uint32_t( options.encoding ) ) return image;
+    // A different file with the same hash?
+    std::size_t offset = sizeof( header );
+    if( size < offset + header.path_length ) return image;
+    if( std::string( reinterpret_cast< const char* >( data.get() ) + offset, header.path_length ) != path ) return image;
+    offset += header.path_length;
+    
+    // Don't trust a corrupt file's counts.
+    if( header.channels < 1 || header.channels > 4 || header.encoding > std::uint32_t( ImageEncoding::BC5 ) ) return image;
+    if( header.num_levels < 1 || header.num_levels > kMaxLevels ) return image;
+    const ImageEncoding encoding = ImageEncoding( header.encoding );
+    const std::size_t bytes_per_texel = header.channels*( header.is_float ? sizeof( float ) : 1 );
+    
+    std::vector< Image::Level > levels( header.num_levels );
+    for( auto& level : levels ) {
+        LevelHeader level_header;
+        if( size < offset + sizeof( level_header ) ) return image;
+        std::memcpy( &level_header, data.get() + offset, sizeof( level_header ) );
+        offset += sizeof( level_header );
+        
+        // The texels must all be there, and there must be as many as the level's size needs.
+        if( level_header.width < 1 || level_header.height < 1 || level_header.width > kMaxDimension || level_header.height > kMaxDimension ) return image;
+        const std::size_t expected_size = encoding == ImageEncoding::Raw
+            ? std::size_t( level_header.width )*level_header.height*bytes_per_texel
+            : compressed_size( encoding, level_header.width, level_header.height );
+        if( level_header.size != expected_size ) return image;
+        if( level_header.offset > size || level_header.size > size - level_header.offset ) return image;
+        level.width = level_header.width;
+        level.height = level_header.height;
+        level.texels = data.get() + level_header.offset;
+        level.size = level_header.size;
+    }
+    
+    image.path = path;
+    image.channels = header.channels;
+    image.is_float = header.is_float;
+    image.encoding = encoding;
+    image.levels = levels;
+    image.storage = data;
+    image.from_disk_cache = true;
+    return image;
+}
+
+template< typename T >
+void write_pod( std::ostream& out, const T& value ) {
+    out.write( reinterpret_cast< const char* >( &value ), sizeof( T ) );
+}
+
+void save_cached( const std::string& file, const Image& image, const ImageLoadOptions& options, std::uint64_t source_size, std::int64_t source_mtime ) {
+    // Write to a temporary file and rename it, so that nobody maps a half-written file.
+    // Decode threads may be saving the same file at the same time, so each writes its own.
+    const std::string temporary = unique_temporary_path( file );
+    {
+        std::ofstream out( temporary, std::ios::binary );
+        if( !out ) {
+            cerr << "ERROR: Could not open file for writing: " << temporary << '\n';
+            return;
+        }
+        
+        ImageFileHeader header;
+        std::copy( kMagic, kMagic + sizeof( kMagic ), header.magic );
+        header.source_size = source_size;
+        header.source_mtime = source_mtime;
+        header.path_length = image.path.size();
+        header.flip = options.flip;
+        header.mipmaps = options.mipmaps;
+        header.content = std::uint32_t( options.content );
+        header.requested_channels = options.channels;
+        header.requested_encoding = std::uint32_t( options.encoding );
+        header.channels = image.channels;
+        header.is_float = image.is_float;
+        header.encoding = std::uint32_t( image.encoding );
+        header.num_levels = image.levels.size();
+        write_pod( out, header );
+        out.write( image.path.data(), image.path.size() );
+        
+        // Lay out the levels after the level headers.
+        std::uint64_t offset = sizeof( header ) + image.path.size() + image.levels.size()*sizeof( LevelHeader );
+        std::vector< std::uint64_t > offsets;
+        for( const auto& level : image.levels ) {
+            offset = ( offset + kLevelAlignment - 1 ) / kLevelAlignment * kLevelAlignment;
+            offsets.push_back( offset );
+            
+            LevelHeader level_header;
+            level_header.width = level.width;
+            level_header.height = level.height;
+            level_header.offset = offset;
+            level_header.size = level.size;
+            write_pod( out, level_header );
+            
+            offset += level.size;
+        }
+        for( int i = 0; i < image.levels.size(); ++i ) {
+            // Pad up to the level's offset.
+            while( std::uint64_t( out.tellp() ) < offsets[i] ) out.put( 0 );
+            out.write( reinterpret_cast< const char* >( image.levels[i].texels ), image.levels[i].size );
+        }
+        
+        if( !out ) {
+            cerr << "ERROR: Could not write decoded image cache file: " << temporary << '\n';
+            return;
+        }
+    }
+    
+    // rename() won't replace an existing file on Windows.
+    std::remove( file.c_str() );
+    if( std::rename( temporary.c_str(), file.c_str() ) != 0 ) {
+        cerr << "ERROR: Could not rename " << temporary << " to " << file << '\n';
+        std::remove( temporary.c_str() );
+    }
+}
+
+// sRGB <-> linear conversion.
+// Decoding uses a table with an entry per byte value.
+// Encoding uses a table fine enough that every byte value is reachable.
+const int kEncodeTableSize = 4096;
+struct SRGBTables {
+    float to_linear[256];
+    unsigned char to_srgb[ kEncodeTableSize + 1 ];
+    
+    SRGBTables() {
+        for( int i = 0; i < 256; ++i ) {
+            const float c = i/255.f;
+            to_linear[i] = c <= 0.04045f ? c/12.92f : std::pow( ( c + 0.055f )/1.055f, 2.4f );
+        }
+        for( int i = 0; i <= kEncodeTableSize; ++i ) {
+            const float c = float(i)/kEncodeTableSize;
+            const float srgb = c <= 0.0031308f ? 12.92f*c : 1.055f*std::pow( c, 1.f/2.4f ) - 0.055f;
+            to_srgb[i] = (unsigned char)( srgb*255.f + 0.5f );
+        }
+    }
+};
+const SRGBTables& srgb_tables() {
+    // Thread-safe in C++11.
+    static const SRGBTables tables;
+    return tables;
+}
+
+inline unsigned char to_byte( float value ) {
+    return (unsigned char)( std::min( std::max( value, 0.f ), 1.f )*255.f + 0.5f );
+}
+
+// Converts 8-bit texels to floats that can be averaged:
+// linear colors, signed normals, or plain [0,1] values.
+void texels_to_floats( const unsigned char* texels, int count, int channels, ImageContent content, float* out ) {
+    const SRGBTables& tables = srgb_tables();
+    // The last channel of a 2- or 4-channel image is alpha, which is always linear.
+    const int color_channels = ( channels == 2 || channels == 4 ) ? channels - 1 : channels;
+    
+    for( int i = 0; i < count*channels; ++i ) {
+        const int channel = i % channels;
+        if( content == ImageContent::Color && channel < color_channels ) {
+            out[i] = tables.to_linear[ texels[i] ];
+        } else if( content == ImageContent::NormalMap && channel < 3 ) {
+            out[i] = texels[i]*( 2.f/255.f ) - 1.f;
+        } else {
+            out[i] = texels[i]*( 1.f/255.f );
+        }
+    }
+}
+// The inverse of texels_to_floats().
+void floats_to_texels( const float* values, int count, int channels, ImageContent content, unsigned char* out ) {
+    const SRGBTables& tables = srgb_tables();
+    const int color_channels = ( channels == 2 || channels == 4 ) ? channels - 1 : channels;
+    
+    for( int texel = 0; texel < count; ++texel ) {
+        const float* in = values + texel*channels;
+        unsigned char* texel_out = out + texel*channels;
+        
+        int channel = 0;
+        if( content == ImageContent::NormalMap && channels >= 3 ) {
+            // Averaged normals are shorter than 1.
+            const float length = std::sqrt( in[0]*in[0] + in[1]*in[1] + in[2]*in[2] );
+            const float scale = length > 0 ? 1.f/length : 0.f;
+            for( ; channel < 3; ++channel ) texel_out[channel] = to_byte( 0.5f*( in[channel]*scale + 1.f ) );
+        } else if( content == ImageContent::Color ) {
+            for( ; channel < color_channels; ++channel ) {
+                const float c = std::min( std::max( in[channel], 0.f ), 1.f );
+                texel_out[channel] = tables.to_srgb[ int( c*kEncodeTableSize + 0.5f ) ];
+            }
+        }
+        for( ; channel < channels; ++channel ) texel_out[channel] = to_byte( in[channel] );
+    }
+}
+
+// The input texels that make up one output texel along one axis, and how much each counts.
+struct Taps {
+    int count;
+    int index[3];
+    float weight[3];
+};
+
+// Box filter taps for halving `size` texels.
+// An even size averages pairs. An odd size spreads each output texel over 2 + 1/out_size inputs,
+// so every input, including the last one, counts the same in total (3 taps, weights from
+// "Non-Power-of-Two Mipmapping", NVIDIA 2005).
+std::vector< Taps > box_taps( int size ) {
+    const int out_size = std::max( 1, size/2 );
+    std::vector< Taps > taps( out_size );
+    for( int i = 0; i < out_size; ++i ) {
+        Taps& t = taps[i];
+        if( size == 1 ) {
+            t.count = 1;
+            t.index[0] = 0;
+            t.weight[0] = 1.f;
+        } else if( size % 2 == 0 ) {
+            t.count = 2;
+            t.index[0] = 2*i;
+            t.index[1] = 2*i + 1;
+            t.weight[0] = t.weight[1] = 0.5f;
+        } else {
+            const float total = float( size );
+            t.count = 3;
+            t.index[0] = 2*i;
+            t.index[1] = 2*i + 1;
+            t.index[2] = 2*i + 2;
+            t.weight[0] = ( out_size - i )/total;
+            t.weight[1] = out_size/total;
+            t.weight[2] = ( i + 1 )/total;
+        }
+    }
+    return taps;
+}
+
+// Box filters `in` into `out`, which is half the size (rounded down, at least 1).
+// Odd rows and columns are folded into their neighbors with 3-tap filters (see box_taps()).
+// This is plain scalar code; there is no SIMD version.
+void downsample( const float* in, int width, int height, int channels, float* out ) {
+    const int out_width = std::max( 1, width/2 );
+    const int out_height = std::max( 1, height/2 );
+    const std::vector< Taps > columns = box_taps( width );
+    const std::vector< Taps > rows = box_taps( height );
+    
+    for( int y = 0; y < out_height; ++y ) {
+        const Taps& row = rows[y];
+        float* row_out = out + std::size_t( y )*out_width*channels;
+        std::fill( row_out, row_out + std::size_t( out_width )*channels, 0.f );
+        
+        for( int r = 0; r < row.count; ++r ) {
+            const float* row_in = in + std::size_t( row.index[r] )*width*channels;
+            for( int x = 0; x < out_width; ++x ) {
+                const Taps& column = columns[x];
+                for( int k = 0; k < column.count; ++k ) {
+                    const float weight = row.weight[r]*column.weight[k];
+                    const float* texel = row_in + std::size_t( column.index[k] )*channels;
+                    for( int c = 0; c < channels; ++c ) row_out[ x*channels + c ] += weight*texel[c];
+                }
+            }
+        }
+    }
+}
+}
+
+namespace graphics101 {
+
+Image decode_image( const std::string& path, bool flip, int channels ) {
+    const auto start = std::chrono::steady_clock::now();
+    
+    Image image;
+    image.path = path;
+    
+    int width(-1), height(-1), file_channels(-1);
+    // The non-_thread version sets the flag for every thread.
+    stbi_set_flip_vertically_on_load_thread( flip );
+    
+    void* data = nullptr;
+    if( stbi_is_hdr( path.c_str() ) ) {
+        // HDR files are already linear floats.
+        data = stbi_loadf( path.c_str(), &width, &height, &file_channels, channels );
+        image.is_float = true;
+    }
+    else if( stbi_is_16_bit( path.c_str() ) ) {
+        // Keep the extra precision by converting to floats in [0,1].
+        // (stbi_loadf() would also apply a gamma curve to them.)
+        stbi_us* data16 = stbi_load_16( path.c_str(), &width, &height, &file_channels, channels );
+        if( data16 ) {
+            const std::size_t count = std::size_t( width )*height*( channels ? channels : file_channels );
+            float* converted = static_cast< float* >( std::malloc( count*sizeof( float ) ) );
+            // Out of memory is handled like a failed load below.
+            if( converted ) {
+                for( std::size_t i = 0; i < count; ++i ) converted[i] = data16[i]*( 1.f/65535.f );
+            } else {
+                cerr << "ERROR: Out of memory converting 16-bit image: " << path << '\n';
+            }
+            stbi_image_free( data16 );
+            data = converted;
+        }
+        image.is_float = true;
+    }
+    else {
+        data = stbi_load( path.c_str(), &width, &height, &file_channels, channels );
+    }
+    if( !data ) {
+        image.is_float = false;
+        return image;
+    }
+    
+    image.channels = channels ? channels : file_channels;
+    // stbi_image_free() is free(), which is also right for `converted`.
+    image.storage = std::shared_ptr< const void >( data, stbi_image_free );
+    
+    Image::Level level;
+    level.width = width;
+    level.height = height;
+    level.texels = static_cast< const unsigned char* >( data );
+    level.size = std::size_t( width )*height*image.bytes_per_texel();
+    image.levels.push_back( level );
+    
+    image.load_milliseconds = milliseconds_since( start );
+    return image;
+}
+
+Image generate_mipmaps( const Image& image, ImageContent content ) {
+    assert( image.valid() );
+    if( !image.valid() ) return image;
+    
+    const int channels = image.channels;
+    const int bytes_per_texel = image.bytes_per_texel();
+    int width = image.width();
+    int height = image.height();
+    
+    // Lay the levels out one after another.
+    std::vector< std::size_t > offsets;
+    std::vector< Image::Level > levels;
+    std::size_t total = 0;
+    while( true ) {
+        Image::Level level;
+        level.width = width;
+        level.height = height;
+        level.size = std::size_t( width )*height*bytes_per_texel;
+        offsets.push_back( total );
+        levels.push_back( level );
+        total += level.size;
+        
+        if( width == 1 && height == 1 ) break;
+        width = std::max( 1, width/2 );
+        height = std::max( 1, height/2 );
+    }
+    
+    // Floats so that float texels are aligned.
+    auto storage = std::make_shared< std::vector< float > >( ( total + sizeof( float ) - 1 )/sizeof( float ) );
+    unsigned char* texels = reinterpret_cast< unsigned char* >( storage->data() );
+    
+    // The first level is copied as-is.
+    std::copy( image.levels.front().texels, image.levels.front().texels + levels.front().size, texels );
+    
+    // Filter in floats so that rounding doesn't build up from level to level.
+    const int count = levels.front().width*levels.front().height;
+    std::vector< float > current( std::size_t( count )*channels );
+    std::vector< float > next;
+    if( image.is_float ) {
+        std::copy( reinterpret_cast< const float* >( texels ), reinterpret_cast< const float* >( texels ) + current.size(), current.begin() );
+    } else {
+        texels_to_floats( texels, count, channels, content, current.data() );
+    }
+    for( int i = 1; i < levels.size(); ++i ) {
+        const int level_count = levels[i].width*levels[i].height;
+        next.resize( std::size_t( level_count )*channels );
+        downsample( current.data(), levels[i-1].width, levels[i-1].height, channels, next.data() );
+        if( image.is_float ) {
+            std::copy( next.begin(), next.end(), reinterpret_cast< float* >( texels + offsets[i] ) );
+        } else {
+            floats_to_texels( next.data(), level_count, channels, content, texels + offsets[i] );
+        }
+        current.swap( next );
+    }
+    
+    Image result = image;
+    for( int i = 0; i < levels.size(); ++i ) levels[i].texels = texels + offsets[i];
+    result.levels = levels;
+    result.storage = storage;
+    return result;
+}
+
+Image load_image( const std::string& path, const ImageLoadOptions& options, const std::string& cache_directory, ThreadPool* pool ) {
+    const auto start = std::chrono::steady_clock::now();
+    
+    const auto decode = [&]() {
+        Image image = decode_image( path, options.flip, options.channels );
+        if( image.valid() && options.mipmaps ) image = generate_mipmaps( image, options.content );
+        if( image.valid() && options.encoding != ImageEncoding::Raw ) image = compress_image( image, options.encoding, pool );
+        image.load_milliseconds = milliseconds_since( start );
+        return image;
+    };
+    
+    if( cache_directory.empty() ) return decode();
+    
+    std::uint64_t source_size = 0;
+    std::int64_t source_mtime = 0;
+    // decode_image() will report the problem.
+    if( !stat_path( path, source_size, source_mtime ) ) return decode();
+    
+    const std::string file = cache_path( cache_directory, path, options );
+    Image image = load_cached( file, path, options, source_size, source_mtime );
+    if( image.valid() ) {
+        image.load_milliseconds = milliseconds_since( start );
+        return image;
+    }
+    
+    image = decode();
+    if( image.valid() ) save_cached( file, image, options, source_size, source_mtime );
+    return image;
+}
+
+}
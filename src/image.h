@@ -0,0 +1,103 @@
+#ifndef __image_h__
+#define __image_h__
+
+#include <cstddef> // size_t
+#include <memory> // shared_ptr
+#include <string>
+#include <vector>
+
+namespace graphics101 {
+
+class ThreadPool;
+
+// How an image's texels are stored.
+enum class ImageEncoding {
+    // `channels` values per texel.
+    Raw,
+    // Block compressed. See blockcompression.h.
+    BC1,
+    BC3,
+    BC5
+};
+
+/*
+Decoded texel data, ready to hand to glTexImage2D().
+The texels may live in memory that stb_image allocated or in a
+memory-mapped file; `storage` keeps them alive either way.
+*/
+struct Image {
+    // One level of a mip chain. Level 0 is the full-size image.
+    struct Level {
+        int width = 0;
+        int height = 0;
+        const unsigned char* texels = nullptr;
+        std::size_t size = 0;
+    };
+    
+    std::string path;
+    // The number of channels per texel, 1 to 4. 1 is gray, 2 is gray and alpha,
+    // 3 is RGB, and 4 is RGBA.
+    int channels = 4;
+    // Whether each channel is a 32-bit float (from HDR and 16-bit files)
+    // rather than an 8-bit unsigned integer.
+    bool is_float = false;
+    // If this isn't Raw, each level holds compressed blocks.
+    ImageEncoding encoding = ImageEncoding::Raw;
+    std::vector< Level > levels;
+    std::shared_ptr< const void > storage;
+    
+    // Whether the texels came from the decoded image cache
+    // and how long it took to get them.
+    bool from_disk_cache = false;
+    double load_milliseconds = 0;
+    
+    bool valid() const { return !levels.empty(); }
+    int width() const { return valid() ? levels.front().width : -1; }
+    int height() const { return valid() ? levels.front().height : -1; }
+    int bytes_per_texel() const { return channels*( is_float ? 4 : 1 ); }
+};
+
+// What an image's texels mean. This decides how mipmaps average them.
+enum class ImageContent {
+    // sRGB-encoded colors. Averaged in linear space (gamma-correct).
+    Color,
+    // Data that is averaged as-is, such as height maps.
+    Linear,
+    // Tangent- or object-space normals encoded as ( n + 1 )/2.
+    // Averaged as vectors and renormalized.
+    NormalMap
+};
+
+struct ImageLoadOptions {
+    // Flip the image vertically, so that the first row is the bottom.
+    bool flip = false;
+    // Compute the full mip chain with generate_mipmaps().
+    bool mipmaps = false;
+    ImageContent content = ImageContent::Color;
+    // The number of channels to convert the image to, or 0 to keep the file's.
+    int channels = 0;
+    // Compress the image (after computing mipmaps) with compress_image().
+    ImageEncoding encoding = ImageEncoding::Raw;
+};
+
+// Returns a copy of `image` with a full mip chain down to 1x1, computed from its first level
+// with a 2x2 box filter that respects `content`. Float images are averaged as-is.
+Image generate_mipmaps( const Image& image, ImageContent content );
+
+// Decodes the image file at `path`, flipping it vertically if `flip` is true.
+// The texels have the file's channels, or `channels` channels if it isn't 0.
+// 8-bit files have 8-bit texels. HDR and 16-bit files have float texels.
+// Returns an invalid image if the file can't be decoded.
+// This doesn't call OpenGL, so it is safe to call from any thread.
+Image decode_image( const std::string& path, bool flip, int channels = 0 );
+
+// Decodes the image with decode_image(), generate_mipmaps(), and compress_image() according to `options`.
+// Compression runs on `pool`'s threads if it isn't null.
+// If `cache_directory` isn't empty, reuses the texels saved there if the file's size
+// and modification time haven't changed since they were saved, and otherwise
+// saves the texels there for next time. Saved texels are memory-mapped rather than read.
+Image load_image( const std::string& path, const ImageLoadOptions& options, const std::string& cache_directory, ThreadPool* pool = nullptr );
+
+}
+
+#endif /* __image_h__ */
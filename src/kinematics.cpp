@@ -6,11 +6,18 @@ using namespace graphics101;
 namespace graphics101 {
 
 MatrixPose forward_kinematics( const Skeleton& skeleton, const MatrixPose& bone2parent ) {
+    assert( skeleton.size() == bone2parent.size() );
+    
+    MatrixPose bone2world( bone2parent.size() );
+    forward_kinematics( skeleton, bone2parent.data(), bone2world.data() );
+    return bone2world;
+}
+void forward_kinematics( const Skeleton& skeleton, const mat4* bone2parent, mat4* bone2world ) {
     // Verify that parents always have smaller indices than children.
     for( int i = 0; i < skeleton.size(); ++i ) { assert( skeleton.at(i).parent_index < i ); }
     
     // Initialize bone2world as bone2parent.
-    MatrixPose bone2world( bone2parent );
+    std::copy( bone2parent, bone2parent + skeleton.size(), bone2world );
     
     // Your code goes here.
     
@@ -18,8 +25,6 @@ MatrixPose forward_kinematics( const Skeleton& skeleton, const MatrixPose& bone2
     ///    before children. As a result, the parent transform is already bone-to-world.
     /// 2. Get the bone's bone-to-parent transform B and its parent's bone-to-world transform P.
     /// 3. Set the bone's bone-to-world transform to: PB.
-    
-    return bone2world;
 }
 
 }
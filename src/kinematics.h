@@ -39,6 +39,9 @@ This function assumes that the bones in the skeleton are topologically sorted,
 meaning that parents always have smaller indices than children.
 */
 MatrixPose forward_kinematics( const Skeleton& skeleton, const MatrixPose& bone2parent );
+// The same, storing the result in `bone2world`, which has room for one matrix per bone,
+// instead of allocating it.
+void forward_kinematics( const Skeleton& skeleton, const mat4* bone2parent, mat4* bone2world );
 
 }
 
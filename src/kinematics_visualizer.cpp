@@ -10,6 +10,11 @@
 
 #include <glm/ext/matrix_transform.hpp> // translate, rotate, scale
 
+namespace {
+// Set this to true to print the pose every time it is set.
+const bool kPrintPoses = false;
+}
+
 namespace graphics101 {
 
 KinematicsVisualizer::KinematicsVisualizer() {}
@@ -114,15 +119,21 @@ void KinematicsVisualizer::setViewMatrix( const mat4& view ) {
     m_drawable->uniforms.storeUniform( "uNormalMatrix", glm::inverse( glm::transpose( mat3(view) ) ) );
 }
 void KinematicsVisualizer::setPose( const MatrixPose& bone2world ) {
+    setPose( bone2world.data(), int( bone2world.size() ) );
+}
+void KinematicsVisualizer::setPose( const mat4* bone2world, int num_bones ) {
     // This shouldn't be called if a skeleton was never given.
     assert( m_drawable );
     
     // Set uniforms, a matrix for each bone that transforms from bone2world.
-    m_drawable->uniforms.storeUniform( "uBoneToWorld", bone2world );
+    m_drawable->uniforms.storeUniform( "uBoneToWorld", bone2world, num_bones );
     
-    std::cout << "Bone-to-world matrices (column-at-a-time):\n";
-    for( const mat4& m : bone2world ) {
-        std::cout << m << '\n';
+    // For debugging. This runs every frame, and printing every bone is slow and allocates.
+    if( kPrintPoses ) {
+        std::cout << "Bone-to-world matrices (column-at-a-time):\n";
+        for( int i = 0; i < num_bones; ++i ) {
+            std::cout << bone2world[i] << '\n';
+        }
     }
 }
 
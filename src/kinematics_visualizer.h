@@ -20,6 +20,8 @@ public:
     void setProjectionMatrix( const mat4& projection );
     void setViewMatrix( const mat4& view );
     void setPose( const MatrixPose& bone2world );
+    // The same for `num_bones` matrices. Doesn't allocate after the first call.
+    void setPose( const mat4* bone2world, int num_bones );
     
     void draw();
     
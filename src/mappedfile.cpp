@@ -0,0 +1,82 @@
+#include "mappedfile.h"
+
+#include <fstream>
+#include <functional> // hash
+#include <sstream>
+#include <thread> // this_thread::get_id()
+
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h> // _mkdir()
+#include <process.h> // _getpid()
+#define stat _stat
+#define getpid _getpid
+#else
+#include <fcntl.h> // open()
+#include <sys/mman.h> // mmap()
+#include <unistd.h> // close(), getpid()
+#endif
+
+namespace graphics101 {
+
+std::shared_ptr< const unsigned char > map_file( const std::string& path, std::size_t& size_out ) {
+#ifdef _WIN32
+    // Just read it.
+    std::ifstream in( path, std::ios::binary | std::ios::ate );
+    if( !in ) return nullptr;
+    size_out = std::size_t( in.tellg() );
+    in.seekg( 0 );
+    std::shared_ptr< unsigned char > data( new unsigned char[ size_out ], []( unsigned char* p ) { delete [] p; } );
+    in.read( reinterpret_cast< char* >( data.get() ), size_out );
+    if( !in ) return nullptr;
+    return data;
+#else
+    const int fd = open( path.c_str(), O_RDONLY );
+    if( fd < 0 ) return nullptr;
+    
+    struct stat info;
+    if( fstat( fd, &info ) != 0 || info.st_size == 0 ) {
+        close( fd );
+        return nullptr;
+    }
+    size_out = info.st_size;
+    
+    void* mapping = mmap( nullptr, size_out, PROT_READ, MAP_PRIVATE, fd, 0 );
+    // The mapping stays valid after closing the file.
+    close( fd );
+    if( mapping == MAP_FAILED ) return nullptr;
+    
+    const std::size_t size = size_out;
+    return std::shared_ptr< const unsigned char >(
+        static_cast< const unsigned char* >( mapping ),
+        [size]( const unsigned char* p ) { munmap( const_cast< unsigned char* >( p ), size ); }
+        );
+#endif
+}
+
+bool stat_path( const std::string& path, std::uint64_t& size_out, std::int64_t& mtime_out ) {
+    struct stat result;
+    if( stat( path.c_str(), &result ) != 0 ) return false;
+    size_out = result.st_size;
+    mtime_out = result.st_mtime;
+    return true;
+}
+
+std::string unique_temporary_path( const std::string& path ) {
+    std::ostringstream result;
+    result << path << '.' << getpid() << '.' << std::hex << std::hash< std::thread::id >()( std::this_thread::get_id() ) << ".tmp";
+    return result.str();
+}
+
+bool make_directory( const std::string& path ) {
+#ifdef _WIN32
+    const int result = _mkdir( path.c_str() );
+#else
+    const int result = mkdir( path.c_str(), 0755 );
+#endif
+    return result == 0 || errno == EEXIST;
+}
+
+}
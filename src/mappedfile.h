@@ -0,0 +1,29 @@
+#ifndef __mappedfile_h__
+#define __mappedfile_h__
+
+#include <cstddef> // size_t
+#include <cstdint>
+#include <memory> // shared_ptr
+#include <string>
+
+namespace graphics101 {
+
+// Returns the contents of the file at `path`, or nullptr if it can't be read.
+// The file is memory-mapped where we can, so only the pages that are touched are read.
+std::shared_ptr< const unsigned char > map_file( const std::string& path, std::size_t& size_out );
+
+// Gets the size and modification time of the file at `path`.
+// Returns false if it doesn't exist.
+bool stat_path( const std::string& path, std::uint64_t& size_out, std::int64_t& mtime_out );
+
+// Returns a path next to `path` for writing a file that will be renamed to `path`.
+// It is different in every process and thread, so that writers don't share it.
+std::string unique_temporary_path( const std::string& path );
+
+// Creates `path` if it isn't a directory already.
+// Returns true if it exists afterwards.
+bool make_directory( const std::string& path );
+
+}
+
+#endif /* __mappedfile_h__ */
@@ -0,0 +1,52 @@
+#include "meshcache.h"
+
+#include <iostream>
+using std::cerr;
+
+namespace graphics101 {
+
+const Mesh* MeshCache::get( const std::string& path, bool need_normals, bool need_tangents ) {
+    auto found = m_entries.find( path );
+    if( found == m_entries.end() ) {
+        Entry entry;
+        
+        // Load the mesh from the OBJ.
+        const bool success = entry.mesh.loadFromOBJ( path );
+        if( !success ) {
+            cerr << "ERROR: Unable to load OBJ file: " << path << '\n';
+            return nullptr;
+        }
+        // Normalize the mesh to fit within the unit cube [-1,1]^3 centered at the origin.
+        // The normalizing transformation is a uniform scale and a translation,
+        // so normals computed later come out the same as normals computed before.
+        entry.mesh.applyTransformation( entry.mesh.normalizingTransformation() );
+        
+        found = m_entries.emplace( path, std::move( entry ) ).first;
+    } else {
+        cerr << "Reusing the mesh in memory for: " << path << '\n';
+    }
+    
+    Entry& entry = found->second;
+    
+    // Create normals if we don't have them.
+    if( need_normals && entry.mesh.normals.empty() ) {
+        entry.mesh.computeNormals();
+    }
+    // Create the tangent frame.
+    if( need_tangents && !entry.has_tangents && !entry.mesh.face_texcoords.empty() ) {
+        entry.mesh.computeTangentBitangent();
+        entry.has_tangents = true;
+    }
+    
+    return &entry.mesh;
+}
+
+void MeshCache::invalidate( const std::string& path ) {
+    m_entries.erase( path );
+}
+
+void MeshCache::clear() {
+    m_entries.clear();
+}
+
+}
@@ -0,0 +1,44 @@
+#ifndef __meshcache_h__
+#define __meshcache_h__
+
+#include "mesh.h"
+
+#include <string>
+#include <unordered_map>
+
+namespace graphics101 {
+
+/*
+Keeps loaded meshes in memory, keyed by the path of their OBJ file,
+so that re-uploading a mesh (e.g. because the shader's set of vertex
+attributes changed) doesn't read and parse the OBJ again.
+
+Meshes are stored normalized to fit within the unit cube.
+Normals and tangents are computed the first time they are asked for
+and kept with the mesh after that.
+*/
+class MeshCache {
+public:
+    // Returns the mesh for `path`, loading it if it isn't in memory.
+    // If `need_normals` is true, the mesh has normals.
+    // If `need_tangents` is true and the mesh has texture coordinates,
+    // the mesh has tangents and bitangents.
+    // Returns nullptr if the OBJ can't be loaded.
+    const Mesh* get( const std::string& path, bool need_normals, bool need_tangents );
+    
+    // Forgets the mesh for `path`. Call this when the file changes.
+    void invalidate( const std::string& path );
+    // Forgets all meshes.
+    void clear();
+    
+private:
+    struct Entry {
+        Mesh mesh;
+        bool has_tangents = false;
+    };
+    std::unordered_map< std::string, Entry > m_entries;
+};
+
+}
+
+#endif /* __meshcache_h__ */
@@ -2,17 +2,37 @@
 
 #include "glcompat.h"
 #include "shaderprogram.h"
+#include "texture.h" // TextureSettings
+#include "textureatlas.h" // TextureAtlasOptions, AtlasedTexture
+#include "samplercache.h" // SamplerSettings
 
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm> // sort(), unique(), find()
 using std::cerr;
 
+namespace {
+// The name of the uniform holding an atlased sampler's scale and offset.
+// For an element of a sampler array, "tiles[3]", it's the element of a vec4 array, "tiles_uv_transform[3]".
+std::string uv_transform_name( const std::string& sampler_name ) {
+    const std::string suffix = "_uv_transform";
+    const auto bracket = sampler_name.rfind( '[' );
+    if( !sampler_name.empty() && sampler_name.back() == ']' && bracket != std::string::npos ) {
+        return sampler_name.substr( 0, bracket ) + suffix + sampler_name.substr( bracket );
+    }
+    return sampler_name + suffix;
+}
+}
+
 namespace graphics101 {
 
 // Adds the uniforms in `j` to the UniformSet `u`.
-void parseUniforms( const json& j, UniformSet& u, StringVec& texture_names_in_bind_order ) {
+void parseUniforms( const json& j, UniformSet& u, StringVec& texture_names_in_bind_order, const AtlasedTextures* atlased, SamplerSettingsVec* samplers_in_bind_order ) {
     texture_names_in_bind_order.clear();
+    if( samplers_in_bind_order ) samplers_in_bind_order->clear();
+    // Each texture unit holds a texture and a sampler. This is both their keys.
+    StringVec unit_keys;
     
     for( json::const_iterator iter = j.begin(); iter != j.end(); ++iter ) {
         
@@ -35,8 +55,32 @@ void parseUniforms( const json& j, UniformSet& u, StringVec& texture_names_in_bi
                 continue;
             }
             
-            u.storeUniformSampler( name );
-            texture_names_in_bind_order.push_back( val.get<std::string>() );
+            // Read atlased textures from their page.
+            std::string texture_name = val.get<std::string>();
+            if( atlased && atlased->count( texture_name ) ) {
+                const AtlasedTexture& atlased_texture = atlased->at( texture_name );
+                u.storeUniform( uv_transform_name( name ), atlased_texture.uv_scale_offset );
+                texture_name = atlased_texture.page_name;
+            }
+            
+            SamplerSettings sampler;
+            if( iter.value().count("sampler") ) {
+                if( !iter.value()["sampler"].is_object() ) {
+                    cerr << "Uniform sampler is not an object: " << iter.value() << '\n';
+                } else {
+                    parseSamplerSettings( iter.value()["sampler"], sampler );
+                }
+            }
+            
+            // Reuse the texture unit if another sampler reads the same texture the same way.
+            const std::string unit_key = texture_name + '\n' + sampler.key();
+            const auto unit = std::find( unit_keys.begin(), unit_keys.end(), unit_key );
+            u.storeUniformSampler( name, GLint( unit - unit_keys.begin() ) );
+            if( unit == unit_keys.end() ) {
+                unit_keys.push_back( unit_key );
+                texture_names_in_bind_order.push_back( texture_name );
+                if( samplers_in_bind_order ) samplers_in_bind_order->push_back( sampler );
+            }
         }
         else if( type == "1f" ) {
             if( !val.is_number() ) {
@@ -157,6 +201,140 @@ void parseUniforms( const json& j, UniformSet& u, StringVec& texture_names_in_bi
     }
 }
 
+void parseTextureSettings( const json& j, TextureSettings& settings ) {
+    if( !j.is_object() ) return;
+    
+    if( j.count("mipmaps") ) {
+        const auto& mipmaps = j["mipmaps"];
+        if( mipmaps.is_boolean() ) {
+            settings.mipmaps = mipmaps.get<bool>() ? TextureSettings::GPUMipmaps : TextureSettings::NoMipmaps;
+        }
+        else if( mipmaps == "gpu" ) settings.mipmaps = TextureSettings::GPUMipmaps;
+        else if( mipmaps == "cpu" ) settings.mipmaps = TextureSettings::CPUMipmaps;
+        else if( mipmaps == "none" ) settings.mipmaps = TextureSettings::NoMipmaps;
+        else {
+            cerr << "ERROR: Texture mipmaps must be \"gpu\", \"cpu\", or \"none\": " << mipmaps << '\n';
+        }
+    }
+    
+    if( j.count("content") ) {
+        const auto& content = j["content"];
+        if( content == "color" ) settings.content = ImageContent::Color;
+        else if( content == "linear" ) settings.content = ImageContent::Linear;
+        else if( content == "normalmap" ) settings.content = ImageContent::NormalMap;
+        else {
+            cerr << "ERROR: Texture content must be \"color\", \"linear\", or \"normalmap\": " << content << '\n';
+        }
+    }
+    
+    if( j.count("srgb") ) {
+        if( !j["srgb"].is_boolean() ) {
+            cerr << "ERROR: Texture srgb is not true or false: " << j["srgb"] << '\n';
+        } else {
+            settings.srgb = j["srgb"].get<bool>();
+        }
+    }
+    
+    if( j.count("compression") ) {
+        const auto& compression = j["compression"];
+        if( compression == "none" ) settings.compression = TextureSettings::NoCompression;
+        else if( compression == "auto" ) settings.compression = TextureSettings::AutoCompression;
+        else if( compression == "bc1" ) settings.compression = TextureSettings::BC1Compression;
+        else if( compression == "bc3" ) settings.compression = TextureSettings::BC3Compression;
+        else if( compression == "bc5" ) settings.compression = TextureSettings::BC5Compression;
+        else {
+            cerr << "ERROR: Texture compression must be \"none\", \"auto\", \"bc1\", \"bc3\", or \"bc5\": " << compression << '\n';
+        }
+    }
+    
+    if( j.count("anisotropy") ) {
+        if( !j["anisotropy"].is_number() ) {
+            cerr << "ERROR: Texture anisotropy is not a number: " << j["anisotropy"] << '\n';
+        } else {
+            settings.anisotropy = j["anisotropy"].get<float>();
+        }
+    }
+}
+
+void parseSamplerSettings( const json& j, SamplerSettings& settings ) {
+    if( !j.is_object() ) return;
+    
+    settings.use_sampler = true;
+    
+    if( j.count("filter") ) {
+        const auto& filter = j["filter"];
+        if( filter == "linear" ) settings.filter = SamplerSettings::Linear;
+        else if( filter == "nearest" ) settings.filter = SamplerSettings::Nearest;
+        else {
+            cerr << "ERROR: Sampler filter must be \"linear\" or \"nearest\": " << filter << '\n';
+        }
+    }
+    
+    if( j.count("mipmaps") ) {
+        const auto& mipmaps = j["mipmaps"];
+        if( mipmaps == "linear" ) settings.mipmap_filter = SamplerSettings::LinearMipmap;
+        else if( mipmaps == "nearest" ) settings.mipmap_filter = SamplerSettings::NearestMipmap;
+        else if( mipmaps == "none" ) settings.mipmap_filter = SamplerSettings::NoMipmaps;
+        else {
+            cerr << "ERROR: Sampler mipmaps must be \"linear\", \"nearest\", or \"none\": " << mipmaps << '\n';
+        }
+    }
+    
+    if( j.count("wrap") ) {
+        const auto& wrap = j["wrap"];
+        if( wrap == "clamp" ) settings.wrap = SamplerSettings::ClampToEdge;
+        else if( wrap == "repeat" ) settings.wrap = SamplerSettings::Repeat;
+        else if( wrap == "mirror" ) settings.wrap = SamplerSettings::MirroredRepeat;
+        else {
+            cerr << "ERROR: Sampler wrap must be \"clamp\", \"repeat\", or \"mirror\": " << wrap << '\n';
+        }
+    }
+    
+    if( j.count("anisotropy") ) {
+        if( !j["anisotropy"].is_number() ) {
+            cerr << "ERROR: Sampler anisotropy is not a number: " << j["anisotropy"] << '\n';
+        } else {
+            settings.anisotropy = j["anisotropy"].get<float>();
+        }
+    }
+}
+
+StringSet parseWrappedTextureNames( const json& j ) {
+    StringSet result;
+    if( !j.is_object() ) return result;
+    
+    for( json::const_iterator iter = j.begin(); iter != j.end(); ++iter ) {
+        const json& uniform = iter.value();
+        if( !uniform.is_object() || !uniform.count("type") || uniform["type"] != "texture" ) continue;
+        if( !uniform.count("value") || !uniform["value"].is_string() ) continue;
+        if( !uniform.count("sampler") || !uniform["sampler"].is_object() ) continue;
+        
+        SamplerSettings sampler;
+        parseSamplerSettings( uniform["sampler"], sampler );
+        if( sampler.wrap != SamplerSettings::ClampToEdge ) result.insert( uniform["value"].get<std::string>() );
+    }
+    return result;
+}
+
+void parseTextureAtlasOptions( const json& j, TextureAtlasOptions& options ) {
+    if( !j.is_object() ) return;
+    
+    const std::pair< const char*, int* > sizes[] = {
+        { "page_size", &options.page_size },
+        { "padding", &options.padding },
+        { "max_texture_size", &options.max_texture_size }
+        };
+    for( const auto& size : sizes ) {
+        if( !j.count( size.first ) ) continue;
+    
+        if( !j[ size.first ].is_number_integer() || j[ size.first ].get<int>() < 1 ) {
+            cerr << "ERROR: Texture atlas " << size.first << " is not a positive integer: " << j[ size.first ] << '\n';
+        } else {
+            *size.second = j[ size.first ].get<int>();
+        }
+    }
+}
+
 std::string fileAsString( const std::string& path ) {
     // Open the file from the string path.
     std::ifstream infile( path );
@@ -177,26 +355,25 @@ namespace {
 void plus_equals( StringSet& lhs, const StringSet& rhs ) {
     for( const auto& item : rhs ) { lhs.insert( item ); }
 }
-// Every path accessed is inserted into `paths_accessed_out`.
-StringSet parseShaderType( const json& j, ShaderProgram& program, GLenum type, const StringTransformer& path_transformer ) {
+// Stores the source code pieces in `pieces_out` and returns every path accessed.
+StringSet parseShaderType( const json& j, StringVec& pieces_out, const StringTransformer& path_transformer ) {
     StringSet paths_accessed;
+    pieces_out.clear();
     
     // If it's a string, it's a shader.
     if( j.is_string() ) {
-        program.addShader( type, j.get<std::string>() );
+        pieces_out.push_back( j.get<std::string>() );
     }
     // If it's an array, each element is a path.
     // Load all the paths, each one is a piece of the shader.
     else if( j.is_array() ) {
-        StringVec pieces;
-        pieces.reserve( j.size() );
+        pieces_out.reserve( j.size() );
         // Load each path.
         for( const std::string& path : j ) {
             const auto fullpath = path_transformer( path );
             paths_accessed.insert( fullpath );
-            pieces.push_back( fileAsString( fullpath ) );
+            pieces_out.push_back( fileAsString( fullpath ) );
         }
-        program.addShader( type, pieces );
     } else {
         cerr << "ERROR: Unknown JSON data encountered when parsing shader type.\n";
     }
@@ -205,21 +382,93 @@ StringSet parseShaderType( const json& j, ShaderProgram& program, GLenum type, c
 }
 }
 
-StringSet parseShader(
+namespace {
+// Inserts `#define KEYWORD 1` for each keyword into a shader's source pieces.
+// GLSL requires #version to come first, so the defines go right after it.
+void insert_defines( StringVec& pieces, const StringVec& defines ) {
+    if( defines.empty() || pieces.empty() ) return;
+    
+    std::string define_lines;
+    for( const auto& keyword : defines ) define_lines += "#define " + keyword + " 1\n";
+    
+    for( auto& piece : pieces ) {
+        const auto version = piece.find( "#version" );
+        if( version == std::string::npos ) continue;
+        
+        // Insert after the end of the #version line.
+        const auto end_of_line = piece.find( '\n', version );
+        if( end_of_line == std::string::npos ) {
+            piece += '\n' + define_lines;
+        } else {
+            piece.insert( end_of_line + 1, define_lines );
+        }
+        return;
+    }
+    
+    // No #version. The defines can go first.
+    pieces.front() = define_lines + pieces.front();
+}
+}
+
+StringSet parseShaderSources(
     const json& j,
-    ShaderProgram& program,
+    ShaderSources& sources_out,
     const StringTransformer& path_transformer
     ) {
     
     StringSet paths_accessed;
+    sources_out.clear();
     
-    // Add the various kinds of shaders:
+    // Gather the various kinds of shaders:
     // GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER, GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER
-    if( j.count("vertex")          ) plus_equals( paths_accessed, parseShaderType( j["vertex"],          program, GL_VERTEX_SHADER,          path_transformer ) );
-    if( j.count("fragment")        ) plus_equals( paths_accessed, parseShaderType( j["fragment"],        program, GL_FRAGMENT_SHADER,        path_transformer ) );
-    if( j.count("geometry")        ) plus_equals( paths_accessed, parseShaderType( j["geometry"],        program, GL_GEOMETRY_SHADER,        path_transformer ) );
-    if( j.count("tess_control")    ) plus_equals( paths_accessed, parseShaderType( j["tess_control"],    program, GL_TESS_CONTROL_SHADER,    path_transformer ) );
-    if( j.count("tess_evaluation") ) plus_equals( paths_accessed, parseShaderType( j["tess_evaluation"], program, GL_TESS_EVALUATION_SHADER, path_transformer ) );
+    if( j.count("vertex")          ) plus_equals( paths_accessed, parseShaderType( j["vertex"],          sources_out[ GL_VERTEX_SHADER ],          path_transformer ) );
+    if( j.count("fragment")        ) plus_equals( paths_accessed, parseShaderType( j["fragment"],        sources_out[ GL_FRAGMENT_SHADER ],        path_transformer ) );
+    if( j.count("geometry")        ) plus_equals( paths_accessed, parseShaderType( j["geometry"],        sources_out[ GL_GEOMETRY_SHADER ],        path_transformer ) );
+    if( j.count("tess_control")    ) plus_equals( paths_accessed, parseShaderType( j["tess_control"],    sources_out[ GL_TESS_CONTROL_SHADER ],    path_transformer ) );
+    if( j.count("tess_evaluation") ) plus_equals( paths_accessed, parseShaderType( j["tess_evaluation"], sources_out[ GL_TESS_EVALUATION_SHADER ], path_transformer ) );
+    
+    // Feature keywords select a variant of the shaders.
+    if( j.count("defines") ) {
+        StringVec defines;
+        if( !j["defines"].is_array() ) {
+            cerr << "ERROR: Shader defines are not an array: " << j["defines"] << '\n';
+        } else {
+            for( const auto& keyword : j["defines"] ) {
+                if( !keyword.is_string() ) {
+                    cerr << "ERROR: Shader define is not a string: " << keyword << '\n';
+                    continue;
+                }
+                defines.push_back( keyword.get<std::string>() );
+            }
+        }
+        // The same set of defines in a different order is the same variant.
+        std::sort( defines.begin(), defines.end() );
+        defines.erase( std::unique( defines.begin(), defines.end() ), defines.end() );
+        
+        for( auto& stage : sources_out ) insert_defines( stage.second, defines );
+    }
+    
+    return paths_accessed;
+}
+
+void addShaderSources( const ShaderSources& sources, ShaderProgram& program ) {
+    for( const auto& stage : sources ) {
+        // A stage whose JSON couldn't be parsed has no pieces.
+        if( stage.second.empty() ) continue;
+        
+        program.addShader( stage.first, stage.second );
+    }
+}
+
+StringSet parseShader(
+    const json& j,
+    ShaderProgram& program,
+    const StringTransformer& path_transformer
+    ) {
+    
+    ShaderSources sources;
+    const StringSet paths_accessed = parseShaderSources( j, sources, path_transformer );
+    addShaderSources( sources, program );
     // Compile and link.
     program.link();
     
@@ -3,6 +3,7 @@
 
 // Some helper functions for parsing common classes from JSON.
 
+#include "types.h"
 // Forward declarations of the types to be filled.
 #include "glfwd.h"
 // For parsing JSON.
@@ -12,13 +13,53 @@ using json = nlohmann::json;
 #include <string>
 #include <unordered_set>
 #include <functional>
+#include <map>
 
 namespace graphics101 {
 
 // Given a block of JSON `j`, adds the uniforms to the UniformSet `u` and outputs the texture names in bind order.
 // The incoming UniformSet `u` is not cleared first, so uniform names not in the JSON are
 // left untouched.
-void parseUniforms( const json& j, UniformSet& u, StringVec& texture_names_in_bind_order );
+// Samplers that read the same texture share a texture unit.
+// If `atlased` isn't null, samplers reading a texture in it read its atlas page instead,
+// and the vec4 uniform "<sampler name>_uv_transform" is set to the texture's scale and offset
+// within the page. Shaders that sample atlased textures should declare it with a default, e.g.
+//     uniform vec4 matcap_texture_uv_transform = vec4( 1.0, 1.0, 0.0, 0.0 );
+// and sample at uv*matcap_texture_uv_transform.xy + matcap_texture_uv_transform.zw.
+// For an element of a sampler array, "tiles[3]", the uniform is "tiles_uv_transform[3]"
+// (see examples/atlas.fs).
+// A texture uniform may have a "sampler" object (see parseSamplerSettings()).
+// If `samplers_in_bind_order` isn't null, it gets the sampler settings for each texture
+// unit, in the same order as the texture names.
+void parseUniforms( const json& j, UniformSet& u, StringVec& texture_names_in_bind_order, const AtlasedTextures* atlased = nullptr, SamplerSettingsVec* samplers_in_bind_order = nullptr );
+
+// Given the JSON object `j` describing a texture, fills in the settings it contains:
+//   "mipmaps": "gpu" (the default), "cpu", or "none" (true and false mean "gpu" and "none")
+//   "content": "color" (the default), "linear", or "normalmap"
+//   "anisotropy": a number >= 1
+//   "srgb": true or false (the default)
+//   "compression": "none" (the default), "auto", "bc1", "bc3", or "bc5"
+// Settings not in the JSON are left untouched.
+void parseTextureSettings( const json& j, TextureSettings& settings );
+
+// Given the JSON object `j` describing a sampler, fills in the settings it contains
+// and turns on `settings.use_sampler`:
+//   "filter": "linear" (the default) or "nearest"
+//   "mipmaps": "linear" (the default), "nearest", or "none" (for textures without mipmaps)
+//   "wrap": "clamp" (the default), "repeat", or "mirror"
+//   "anisotropy": a number >= 1
+// Settings not in the JSON are left untouched.
+void parseSamplerSettings( const json& j, SamplerSettings& settings );
+
+// Given a block of uniforms JSON `j`, returns the names of the textures that a sampler
+// reads with "repeat" or "mirror" wrapping. Those read past the texture's edges,
+// which an atlas page can't provide, so they must not be atlased.
+StringSet parseWrappedTextureNames( const json& j );
+
+// Given the JSON object `j` describing a texture atlas, fills in the options it contains:
+//   "page_size", "padding", and "max_texture_size": positive integers
+// Options not in the JSON are left untouched.
+void parseTextureAtlasOptions( const json& j, TextureAtlasOptions& options );
 
 // Parses the JSON `j` to fill in a ShaderProgram `program`.
 // Note that this does not/cannot delete and re-create `program`.
@@ -30,6 +71,19 @@ StringSet parseShader( const json& j, ShaderProgram& program );
 typedef std::function< std::string( const std::string& ) > StringTransformer;
 StringSet parseShader( const json& j, ShaderProgram& program, const StringTransformer& path_transformer );
 
+// The source code pieces of each shader stage, keyed by shader type
+// (GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, etc.).
+typedef std::map< GLenum, StringVec > ShaderSources;
+// Parses the JSON `j` into the resolved source code of each shader stage
+// without compiling anything. `parseShader()` is this followed by
+// `addShaderSources()` and `ShaderProgram::link()`.
+// If `j` has a "defines" array of feature keywords, e.g. [ "SKINNING", "TEXTURED" ],
+// each one is #define'd in every stage right after the #version line.
+// Returns the set of (transformed) paths accessed.
+StringSet parseShaderSources( const json& j, ShaderSources& sources_out, const StringTransformer& path_transformer );
+// Adds each stage in `sources` to `program`. Does not link.
+void addShaderSources( const ShaderSources& sources, ShaderProgram& program );
+
 // Loads the contents of path into the `json` object `json_out`.
 // Returns true if parsing succeeded and false otherwise.
 bool loadJSONFromPath( const std::string& path, json& json_out );
@@ -0,0 +1,23 @@
+#include "quaternion.h"
+
+namespace graphics101 {
+
+quat quat_from_axis_angle( const vec3& rotation ) {
+    const real radians = glm::length( rotation );
+    // The axis is arbitrary if the rotation is by 0 radians.
+    if( radians <= 1e-7 ) return quat( 1, 0, 0, 0 );
+    return glm::angleAxis( radians, rotation/radians );
+}
+
+vec3 axis_angle_from_quat( const quat& rotation ) {
+    // q and -q are the same rotation. The one with w >= 0 turns by at most pi.
+    const quat q = rotation.w < 0 ? -rotation : rotation;
+    const vec3 v( q.x, q.y, q.z );
+    const real sin_half = glm::length( v );
+    // For tiny angles, sin( angle/2 ) ~= angle/2.
+    if( sin_half <= 1e-7 ) return real(2)*v;
+    const real radians = 2*std::atan2( sin_half, q.w );
+    return v*( radians/sin_half );
+}
+
+}
@@ -0,0 +1,19 @@
+#ifndef __quaternion_h__
+#define __quaternion_h__
+
+#include "types.h"
+
+#include <glm/gtc/quaternion.hpp> // glm::quat
+
+namespace graphics101 {
+
+typedef glm::quat quat;
+
+// Converts between axis*radians rotations, as in TRS, and unit quaternions.
+quat quat_from_axis_angle( const vec3& rotation );
+// Returns a rotation by at most pi radians.
+vec3 axis_angle_from_quat( const quat& rotation );
+
+}
+
+#endif /* __quaternion_h__ */
@@ -0,0 +1,62 @@
+#include "samplercache.h"
+
+#include "glcompat.h"
+#include "texture.h" // max_texture_anisotropy()
+
+#include <algorithm> // min(), max()
+#include <iostream>
+#include <sstream>
+using std::cerr;
+
+namespace graphics101 {
+
+std::string SamplerSettings::key() const
+{
+    if( !use_sampler ) return "";
+    
+    std::ostringstream result;
+    result << "filter " << int( filter ) << " mipmaps " << int( mipmap_filter ) << " wrap " << int( wrap )
+           << " anisotropy " << anisotropy;
+    return result.str();
+}
+
+SamplerCache& SamplerCache::shared() {
+    static SamplerCache cache;
+    return cache;
+}
+
+GLuint SamplerCache::get( const SamplerSettings& settings ) {
+    if( !settings.use_sampler ) return 0;
+    
+    const std::string key = settings.key();
+    auto found = m_samplers.find( key );
+    if( found != m_samplers.end() ) return found->second;
+    
+    GLuint sampler = 0;
+    glGenSamplers( 1, &sampler );
+    
+    // GL_NEAREST_MIPMAP_NEAREST, GL_LINEAR_MIPMAP_NEAREST, etc., indexed by [mipmap_filter][filter].
+    static const GLenum min_filters[3][2] = {
+        { GL_NEAREST, GL_LINEAR },
+        { GL_NEAREST_MIPMAP_NEAREST, GL_LINEAR_MIPMAP_NEAREST },
+        { GL_NEAREST_MIPMAP_LINEAR, GL_LINEAR_MIPMAP_LINEAR }
+        };
+    static const GLenum wraps[3] = { GL_CLAMP_TO_EDGE, GL_REPEAT, GL_MIRRORED_REPEAT };
+    
+    glSamplerParameteri( sampler, GL_TEXTURE_MIN_FILTER, min_filters[ settings.mipmap_filter ][ settings.filter ] );
+    glSamplerParameteri( sampler, GL_TEXTURE_MAG_FILTER, settings.filter == SamplerSettings::Nearest ? GL_NEAREST : GL_LINEAR );
+    glSamplerParameteri( sampler, GL_TEXTURE_WRAP_S, wraps[ settings.wrap ] );
+    glSamplerParameteri( sampler, GL_TEXTURE_WRAP_T, wraps[ settings.wrap ] );
+    glSamplerParameteri( sampler, GL_TEXTURE_WRAP_R, wraps[ settings.wrap ] );
+    
+    const float max_anisotropy = max_texture_anisotropy();
+    if( max_anisotropy > 1 ) {
+        glSamplerParameterf( sampler, GL_TEXTURE_MAX_ANISOTROPY, std::min( std::max( settings.anisotropy, 1.f ), max_anisotropy ) );
+    }
+    
+    m_samplers[ key ] = sampler;
+    cerr << "Created sampler object " << m_samplers.size() << ": " << key << '\n';
+    return sampler;
+}
+
+}
@@ -0,0 +1,78 @@
+#ifndef __samplercache_h__
+#define __samplercache_h__
+
+#include "types.h"
+#include "glfwd.h" // SamplerSettingsVec
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace graphics101 {
+
+// How a sampler uniform filters and wraps the texture it reads.
+// Set per texture uniform in the scene JSON.
+struct SamplerSettings {
+    // Without a sampler object, the texture's own filtering (from its TextureSettings) applies.
+    // The other settings only matter if this is true.
+    bool use_sampler = false;
+    
+    enum Filter {
+        Nearest,
+        Linear
+    };
+    // Within a mip level.
+    Filter filter = Linear;
+    
+    enum MipmapFilter {
+        // Sample only the full-size level. Use this for textures without mipmaps,
+        // which the other choices would leave unreadable.
+        NoMipmaps,
+        NearestMipmap,
+        LinearMipmap
+    };
+    // Between mip levels.
+    MipmapFilter mipmap_filter = LinearMipmap;
+    
+    enum Wrap {
+        ClampToEdge,
+        Repeat,
+        MirroredRepeat
+    };
+    // For all three texture coordinates.
+    Wrap wrap = ClampToEdge;
+    
+    // The maximum anisotropy. 1 turns anisotropic filtering off.
+    // Values above what the driver supports are clamped.
+    float anisotropy = 1;
+    
+    // A string that is different for different settings.
+    std::string key() const;
+};
+
+/*
+A process-wide cache of OpenGL sampler objects keyed by their settings.
+Samplers are tiny and few, so they are kept until the program exits.
+Binding a sampler to a texture unit overrides the filtering and wrapping of
+whatever texture is bound there, so one texture can be read with different
+filtering without a second copy, and changing filtering doesn't reload anything.
+*/
+class SamplerCache {
+public:
+    // The cache shared by the whole process.
+    static SamplerCache& shared();
+    
+    // Returns the sampler object for `settings`, creating it if needed.
+    // Returns 0, which means no sampler, if `settings.use_sampler` is false.
+    GLuint get( const SamplerSettings& settings );
+    
+    // The number of sampler objects created.
+    int size() const { return int( m_samplers.size() ); }
+    
+private:
+    std::unordered_map< std::string, GLuint > m_samplers;
+};
+
+}
+
+#endif /* __samplercache_h__ */
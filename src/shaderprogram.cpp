@@ -1,10 +1,15 @@
 #include "shaderprogram.h"
 
 #include "glcompat.h"
+#include "hashing.h"
+#include "glstate.h"
 
 // To limit repetitive warnings.
 #include <unordered_set>
 
+#include <algorithm> // sort(), find()
+#include <chrono> // Timing compiles and links.
+
 #include <iostream>
 using std::cerr;
 
@@ -146,6 +151,22 @@ std::string getProgramInfoLog( GLuint program ) {
     return std::string( info_log.data() );
 }
 
+// OpenGL concatenates the pieces of a shader, so we hash the concatenation.
+std::uint64_t hash_shader_source( GLenum shaderType, const std::vector< std::string >& codes ) {
+    using graphics101::fnv1a;
+    std::uint64_t hash = fnv1a( &shaderType, sizeof( shaderType ) );
+    for( const auto& code : codes ) {
+        hash = fnv1a( code.data(), code.size(), hash );
+    }
+    return hash;
+}
+
+double milliseconds_since( const std::chrono::steady_clock::time_point& start ) {
+    return std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+}
+
+// Creates a shader and starts compiling it. Call check_compile_status() to find out
+// whether compilation succeeded. Drivers can compile in the background until then.
 GLuint create_and_compile_shader( GLenum shaderType, const std::vector< std::string >& codes ) {
     GLuint shader = glCreateShader( shaderType );
     {
@@ -159,6 +180,14 @@ GLuint create_and_compile_shader( GLenum shaderType, const std::vector< std::str
     }
     glCompileShader( shader );
     
+    return shader;
+}
+GLuint create_and_compile_shader( GLenum shaderType, const std::string& code ) {
+    return create_and_compile_shader( shaderType, std::vector< std::string >{ code } );
+}
+// Waits for the compiler if needed. Prints the source and the error log on failure.
+// Returns true if compilation succeeded.
+bool check_compile_status( GLuint shader, GLenum shaderType, const std::vector< std::string >& codes ) {
     GLint status = 0;
     glGetShaderiv( shader, GL_COMPILE_STATUS, &status );
     
@@ -180,10 +209,55 @@ GLuint create_and_compile_shader( GLenum shaderType, const std::vector< std::str
         cerr << name_from_shaderType( shaderType ) << " compiled successfully.\n";
     }
     
-    return shader;
+    return status == GL_TRUE;
 }
-GLuint create_and_compile_shader( GLenum shaderType, const std::string& code ) {
-    return create_and_compile_shader( shaderType, std::vector< std::string >{ code } );
+
+// Returns true if the driver supports KHR_parallel_shader_compile (or the ARB version),
+// which lets us ask whether compiling and linking is complete without blocking.
+// Requires a current OpenGL context the first time it is called.
+bool parallel_shader_compile_supported() {
+    static const bool supported = []() {
+        bool found = false;
+        GLint num_extensions = 0;
+        glGetIntegerv( GL_NUM_EXTENSIONS, &num_extensions );
+        for( GLint i = 0; i < num_extensions && !found; ++i ) {
+            const std::string name( reinterpret_cast< const char* >( glGetStringi( GL_EXTENSIONS, i ) ) );
+            found = ( name == "GL_KHR_parallel_shader_compile" || name == "GL_ARB_parallel_shader_compile" );
+        }
+        if( !found ) {
+            cerr << "Shaders will be compiled synchronously (no KHR_parallel_shader_compile), so the frame that builds them waits for the driver.\n";
+            return false;
+        }
+        
+        // gl3w doesn't load extension functions. Let the driver use as many
+        // compiler threads as it likes.
+        PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads =
+            reinterpret_cast< PFNGLMAXSHADERCOMPILERTHREADSKHRPROC >( gl3wGetProcAddress( "glMaxShaderCompilerThreadsKHR" ) );
+        if( !maxShaderCompilerThreads ) {
+            maxShaderCompilerThreads = reinterpret_cast< PFNGLMAXSHADERCOMPILERTHREADSKHRPROC >( gl3wGetProcAddress( "glMaxShaderCompilerThreadsARB" ) );
+        }
+        if( maxShaderCompilerThreads ) maxShaderCompilerThreads( 0xFFFFFFFF );
+        
+        cerr << "Shaders will be compiled in parallel (KHR_parallel_shader_compile).\n";
+        return true;
+    }();
+    return supported;
+}
+
+void detach_all_shaders( GLuint program ) {
+    std::vector< GLuint > attached_shaders;
+    {
+        GLint num_attached_shaders = 0;
+        glGetProgramiv( program, GL_ATTACHED_SHADERS, &num_attached_shaders );
+        attached_shaders.resize( num_attached_shaders );
+    }
+    glGetAttachedShaders( program, attached_shaders.size(), nullptr, attached_shaders.data() );
+    
+    // Free the shaders by detaching them. Shaders we failed to compile have already been
+    // marked for deletion. Shaders we remember are deleted when no longer needed.
+    for( const auto& shader : attached_shaders ) {
+        glDetachShader( program, shader );
+    }
 }
 
 
@@ -191,6 +265,15 @@ GLuint create_and_compile_shader( GLenum shaderType, const std::string& code ) {
 
 namespace graphics101 {
 
+// A shader object that is deleted when the last program remembering it lets go.
+struct ShaderProgram::CompiledShader {
+    GLuint shader = 0;
+    // Time spent compiling on this thread, including waiting for the driver.
+    double compile_milliseconds = 0;
+    
+    ~CompiledShader() { glDeleteShader( shader ); }
+};
+
 ShaderProgram::ShaderProgram()
 {
     m_program = glCreateProgram();
@@ -198,11 +281,15 @@ ShaderProgram::ShaderProgram()
 ShaderProgram::~ShaderProgram()
 {
     // glUseProgram(0) so that we can delete the program right away.
-    glUseProgram(0);
+    glstate::useProgram(0);
     
     // Note: It is not an error to delete 0.
     glDeleteProgram( m_program );
     
+    // Release the compiled shaders we were remembering.
+    m_pending_shaders.clear();
+    m_compiled_shaders.clear();
+    
     // The call to glDeleteProgram() doesn't actually
     // change the value stored in m_program.
     // Let's set it to 0, which is an invalid value,
@@ -219,7 +306,9 @@ void ShaderProgram::use() const
 {
     assert( m_program != 0 );
     
-    glUseProgram( m_program );
+    // This is skipped if the program is already in use,
+    // so setting uniforms one after another is cheap.
+    glstate::useProgram( m_program );
 }
 
 GLint ShaderProgram::getUniformLocation( const std::string& name ) const {
@@ -241,14 +330,14 @@ StringSet ShaderProgram::getActiveAttributes() const {
     // Allocate a large enough buffer.
     std::vector<GLchar> name( buffer_size );
     
-    GLint num_active_uniforms = 0;
-    glGetProgramiv( m_program, GL_ACTIVE_UNIFORMS, &num_active_uniforms );
+    GLint num_active_attributes = 0;
+    glGetProgramiv( m_program, GL_ACTIVE_ATTRIBUTES, &num_active_attributes );
     
-    for( GLuint i = 0; i < num_active_uniforms; i++ ) {
+    for( GLuint i = 0; i < num_active_attributes; i++ ) {
         GLsizei length;
  	    GLint size;
      	GLenum type;
-        glGetActiveUniform( m_program, i, buffer_size, &length, &size, &type, &name[0] );
+        glGetActiveAttrib( m_program, i, buffer_size, &length, &size, &type, &name[0] );
         result.insert( std::string( &name[0] ) );
     }
     
@@ -259,39 +348,175 @@ void ShaderProgram::addShader( GLenum shaderType, const std::string& shader_sour
     addShader( shaderType, std::vector<std::string>{ shader_source_code } );
 }
 void ShaderProgram::addShader( GLenum shaderType, const std::vector< std::string >& shader_source_code ) {
-    // Create and compile.
-    GLuint shader = create_and_compile_shader( shaderType, shader_source_code );
+    const std::uint64_t hash = sourceHash( shaderType, shader_source_code );
+    // Identical source added twice is already attached.
+    const bool already_attached = std::find( m_attached_hashes.begin(), m_attached_hashes.end(), hash ) != m_attached_hashes.end();
+    m_attached_hashes.push_back( hash );
+    if( already_attached ) return;
+    
+    // If we have compiled this exact source before, attach the same shader again.
+    const auto found = m_compiled_shaders.find( hash );
+    if( found != m_compiled_shaders.end() ) {
+        cerr << name_from_shaderType( shaderType ) << " unchanged; reusing the compiled shader (saved " << found->second->compile_milliseconds << " ms).\n";
+        glAttachShader( m_program, found->second->shader );
+        return;
+    }
+    
+    // Create and start compiling. We check whether it compiled in finishLink().
+    const auto start = std::chrono::steady_clock::now();
+    CompiledShaderPtr compiled = std::make_shared< CompiledShader >();
+    compiled->shader = create_and_compile_shader( shaderType, shader_source_code );
+    compiled->compile_milliseconds = milliseconds_since( start );
     // Attach it to the program.
-    glAttachShader( m_program, shader );
-    // Delete it.
-    // Deleting the shader won't have an effect until the shader is detached.
-    // We detach it after we link.
-    glDeleteShader( shader );
+    glAttachShader( m_program, compiled->shader );
+    
+    // Remember it. It is detached after we link and deleted once no program needs it.
+    m_compiled_shaders[ hash ] = compiled;
+    
+    PendingShader pending;
+    pending.type = shaderType;
+    pending.hash = hash;
+    pending.code = shader_source_code;
+    m_pending_shaders.push_back( pending );
+}
+void ShaderProgram::shareCompiledShaders( const ShaderProgram& other ) {
+    for( const auto& compiled : other.m_compiled_shaders ) {
+        // Shaders still waiting for their compile status may yet fail.
+        const bool pending = std::any_of(
+            other.m_pending_shaders.begin(), other.m_pending_shaders.end(),
+            [&]( const PendingShader& p ) { return p.hash == compiled.first; }
+            );
+        if( !pending ) m_compiled_shaders.insert( compiled );
+    }
+}
+std::uint64_t ShaderProgram::sourceHash( GLenum shaderType, const std::vector< std::string >& shader_source_code ) {
+    return hash_shader_source( shaderType, shader_source_code );
 }
+bool ShaderProgram::supportsParallelCompile() {
+    return parallel_shader_compile_supported();
+}
+
+bool ShaderProgram::supportsProgramBinary() {
+    // gl3w leaves the function pointer null if the driver doesn't have it.
+    if( !glGetProgramBinary || !glProgramBinary ) return false;
+    
+    GLint num_formats = 0;
+    glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats );
+    return num_formats > 0;
+}
+void ShaderProgram::requestRetrievableBinary() {
+    if( !supportsProgramBinary() ) return;
+    glProgramParameteri( m_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+}
+bool ShaderProgram::getBinary( GLenum& format_out, std::vector< char >& binary_out ) const {
+    if( m_linked_hashes.empty() || !supportsProgramBinary() ) return false;
+    
+    GLint length = 0;
+    glGetProgramiv( m_program, GL_PROGRAM_BINARY_LENGTH, &length );
+    if( length <= 0 ) return false;
+    
+    binary_out.resize( length );
+    GLsizei written = 0;
+    glGetProgramBinary( m_program, length, &written, &format_out, binary_out.data() );
+    binary_out.resize( written );
+    return written > 0;
+}
+bool ShaderProgram::setBinary( GLenum format, const std::vector< char >& binary, const std::vector< std::uint64_t >& source_hashes ) {
+    if( binary.empty() || !supportsProgramBinary() ) return false;
+    
+    glProgramBinary( m_program, format, binary.data(), binary.size() );
+    
+    GLint status = 0;
+    glGetProgramiv( m_program, GL_LINK_STATUS, &status );
+    if( status != GL_TRUE ) {
+        m_linked_hashes.clear();
+        return false;
+    }
+    
+    m_linked_hashes = source_hashes;
+    std::sort( m_linked_hashes.begin(), m_linked_hashes.end() );
+    m_link_milliseconds = 0;
+    return true;
+}
+
 bool ShaderProgram::link() {
+    beginLink();
+    return finishLink();
+}
+void ShaderProgram::beginLink() {
+    // The order in which shaders are attached doesn't matter.
+    m_linking_hashes.clear();
+    m_linking_hashes.swap( m_attached_hashes );
+    std::sort( m_linking_hashes.begin(), m_linking_hashes.end() );
+    
+    // If the same shaders are attached as in the last successful link,
+    // the executable is already up-to-date.
+    m_link_skipped = !m_linked_hashes.empty() && m_linking_hashes == m_linked_hashes;
+    if( m_link_skipped ) return;
+    
+    // Time only the calls that link, not the frames between beginLink() and finishLink().
+    const auto start = std::chrono::steady_clock::now();
     glLinkProgram( m_program );
+    m_linking_milliseconds = milliseconds_since( start );
+}
+bool ShaderProgram::isReady() const {
+    if( m_link_skipped ) return true;
+    // Without the extension, there is no way to ask. finishLink() will wait.
+    if( !parallel_shader_compile_supported() ) return true;
     
+    GLint complete = GL_FALSE;
+    glGetProgramiv( m_program, GL_COMPLETION_STATUS_KHR, &complete );
+    return complete == GL_TRUE;
+}
+bool ShaderProgram::finishLink() {
+    // Check the shaders compiled since the last link. Forget any that failed.
+    for( const auto& pending : m_pending_shaders ) {
+        const auto found = m_compiled_shaders.find( pending.hash );
+        assert( found != m_compiled_shaders.end() );
+        const auto check_start = std::chrono::steady_clock::now();
+        const bool compiled = check_compile_status( found->second->shader, pending.type, pending.code );
+        found->second->compile_milliseconds += milliseconds_since( check_start );
+        if( !compiled ) m_compiled_shaders.erase( found );
+    }
+    m_pending_shaders.clear();
+    
+    if( m_link_skipped ) {
+        detach_all_shaders( m_program );
+        cerr << "Shader program unchanged; skipping link (saved " << m_link_milliseconds << " ms).\n";
+        return true;
+    }
+    
+    // This waits for the driver if it hasn't finished linking.
+    const auto status_start = std::chrono::steady_clock::now();
     GLint status = 0;
     glGetProgramiv( m_program, GL_LINK_STATUS, &status );
+    m_linking_milliseconds += milliseconds_since( status_start );
     
     if( status != GL_TRUE ) {
         cerr << "Shader linker error: " << '\n' << getProgramInfoLog(m_program) << '\n';
     }
     
     // Now that we have linked, detach all shaders.
-    std::vector< GLuint > attached_shaders;
-    {
-        GLint num_attached_shaders = 0;
-        glGetProgramiv( m_program, GL_ATTACHED_SHADERS, &num_attached_shaders );
-        attached_shaders.resize( num_attached_shaders );
+    detach_all_shaders( m_program );
+    
+    // Forget compiled shaders that are no longer part of the program.
+    for( auto it = m_compiled_shaders.begin(); it != m_compiled_shaders.end(); ) {
+        if( !std::binary_search( m_linking_hashes.begin(), m_linking_hashes.end(), it->first ) ) {
+            it = m_compiled_shaders.erase( it );
+        } else {
+            ++it;
+        }
     }
-    glGetAttachedShaders( m_program, attached_shaders.size(), nullptr, attached_shaders.data() );
     
-	// Free the shaders by detaching them. (They have already been marked for deletion.)
-	for( const auto& shader : attached_shaders ) {
-	    glDetachShader( m_program, shader );
-	}
-
+    // Only a successful link can be skipped next time.
+    if( status == GL_TRUE ) {
+        m_linked_hashes = m_linking_hashes;
+        m_link_milliseconds = m_linking_milliseconds;
+    } else {
+        m_linked_hashes.clear();
+    }
+    m_linking_hashes.clear();
+    
     return status;
 }
 
@@ -397,6 +622,20 @@ void ShaderProgram::setUniformSamplers( const std::vector< std::string >& unifor
         bind_uniform( location( m_program, uniform_names[index] ), index );
     }
 }
+void ShaderProgram::setUniformSamplers( const std::vector< std::string >& uniform_names, const std::vector< GLint >& texture_units ) {
+    assert( uniform_names.size() == texture_units.size() );
+    use();
+    
+    for( int index = 0; index < uniform_names.size(); ++index ) {
+        bind_uniform( location( m_program, uniform_names[index] ), texture_units[index] );
+    }
+}
+
+void UniformSet::storeUniformSamplers( const std::vector< std::string >& uniform_names ) {
+    m_uniform_samplers = uniform_names;
+    m_uniform_sampler_units.resize( uniform_names.size() );
+    for( GLint index = 0; index < uniform_names.size(); ++index ) m_uniform_sampler_units[index] = index;
+}
 
 void UniformSet::applyUniforms( ShaderProgram& program ) {
     for( const auto& u : m_uniforms_float ) program.setUniform( u.first, u.second );
@@ -423,7 +662,7 @@ void UniformSet::applyUniforms( ShaderProgram& program ) {
     for( const auto& u : m_uniforms_ivec3s ) program.setUniform( u.first, u.second );
     for( const auto& u : m_uniforms_ivec4s ) program.setUniform( u.first, u.second );
     
-    program.setUniformSamplers( m_uniform_samplers );
+    program.setUniformSamplers( m_uniform_samplers, m_uniform_sampler_units );
 }
 
 }
@@ -10,6 +10,8 @@
 #include <string>
 #include <vector>
 #include <memory> // shared_ptr
+#include <cstdint> // uint64_t
+#include <chrono> // steady_clock
 
 namespace graphics101 {
 
@@ -26,14 +28,54 @@ public:
     //      GL_VERTEX_SHADER, GL_FRAGMENT_SHADER,
     //      GL_GEOMETRY_SHADER,
     //      GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER
+    // The program remembers the shaders it compiled, keyed by a hash of their source code.
+    // Adding a shader whose source is unchanged since the last link() reuses the
+    // compiled shader instead of compiling it again.
     void addShader( GLenum shaderType, const std::string& shader_source_code );
     void addShader( GLenum shaderType, const std::vector< std::string >& shader_source_code );
     // Returns true if linking succeeded, false otherwise.
+    // If exactly the same shaders are attached as in the last successful link,
+    // the program is already up-to-date and linking is skipped.
     bool link();
     
+    // link() split in two so that the caller needn't wait for the driver.
+    // Call beginLink(), then poll isReady() (e.g. once per frame), then call finishLink(),
+    // which returns what link() would have. finishLink() blocks if called before isReady().
+    // isReady() is always true unless the driver supports KHR_parallel_shader_compile
+    // (see supportsParallelCompile()). Without it, finishLink() waits for the driver.
+    void beginLink();
+    bool isReady() const;
+    bool finishLink();
+    static bool supportsParallelCompile();
+    
+    // Lets this program reuse the shaders `other` has compiled.
+    // Call it before addShader() when building a replacement for `other`,
+    // so that only the stages whose source changed are compiled.
+    void shareCompiledShaders( const ShaderProgram& other );
+    
+    // A hash of a shader's type and source code that is stable across runs.
+    static std::uint64_t sourceHash( GLenum shaderType, const std::vector< std::string >& shader_source_code );
+    // The sorted sourceHash()'es of the shaders in the last successful link,
+    // or empty if the program has never linked successfully.
+    const std::vector< std::uint64_t >& linkedSourceHashes() const { return m_linked_hashes; }
+    
+    // Linked program binaries, for saving programs to disk.
+    // They require OpenGL 4.1 or ARB_get_program_binary.
+    static bool supportsProgramBinary();
+    // Call before beginLink() to ask the driver to keep the binary around.
+    void requestRetrievableBinary();
+    // Returns false if the program hasn't linked or there is no binary.
+    bool getBinary( GLenum& format_out, std::vector< char >& binary_out ) const;
+    // Replaces the program's executable with a binary from getBinary().
+    // Drivers reject binaries from other drivers or versions, so this can fail.
+    // On success, linkedSourceHashes() becomes `source_hashes`.
+    bool setBinary( GLenum format, const std::vector< char >& binary, const std::vector< std::uint64_t >& source_hashes );
+    
     GLint getUniformLocation( const std::string& name ) const;
     GLint getAttribLocation( const std::string& name ) const;
     typedef std::unordered_set< std::string > ActiveAttributes;
+    // The names of the vertex attributes the linked program actually reads.
+    // Attributes that are declared but optimized away are not included.
     StringSet getActiveAttributes() const;
     
     void use() const;
@@ -67,6 +109,8 @@ public:
     // This function assumes that the textures are bound to the texture unit
     // corresponding to the index in the vector.
     void setUniformSamplers( const std::vector< std::string >& uniform_names );
+    // The same, but sampler `uniform_names[i]` reads texture unit `texture_units[i]`.
+    void setUniformSamplers( const std::vector< std::string >& uniform_names, const std::vector< GLint >& texture_units );
     
     // This class cannot be copied. Use a ShaderProgramPtr.
     ShaderProgram( const ShaderProgram& ) = delete;
@@ -74,6 +118,32 @@ public:
     
 private:
     GLuint m_program;
+    
+    // Compiled shader objects, keyed by the hash of their type and source code.
+    // They stay alive between links so that unchanged stages needn't be recompiled.
+    // They are shared with replacement programs via shareCompiledShaders().
+    struct CompiledShader;
+    typedef std::shared_ptr< CompiledShader > CompiledShaderPtr;
+    std::unordered_map< std::uint64_t, CompiledShaderPtr > m_compiled_shaders;
+    // Shaders compiled since the last link whose compile status we haven't checked.
+    struct PendingShader {
+        GLenum type;
+        std::uint64_t hash;
+        std::vector< std::string > code;
+    };
+    std::vector< PendingShader > m_pending_shaders;
+    // The hashes of the shaders attached since the last call to beginLink().
+    std::vector< std::uint64_t > m_attached_hashes;
+    // The (sorted) hashes of the shaders being linked by beginLink().
+    std::vector< std::uint64_t > m_linking_hashes;
+    bool m_link_skipped = false;
+    // How long this thread has spent in the link begun by beginLink().
+    // With KHR_parallel_shader_compile, the driver's own threads do most of the work, which this misses.
+    double m_linking_milliseconds = 0;
+    // The (sorted) hashes of the shaders in the last successfully linked executable.
+    std::vector< std::uint64_t > m_linked_hashes;
+    // m_linking_milliseconds for that executable.
+    double m_link_milliseconds = 0;
 };
 
 /*
@@ -107,14 +177,20 @@ public:
     void storeUniform( const std::string& name, const std::vector< ivec2 >& value )   { m_uniforms_ivec2s[name] = value; }
     void storeUniform( const std::string& name, const std::vector< ivec3 >& value )   { m_uniforms_ivec3s[name] = value; }
     void storeUniform( const std::string& name, const std::vector< ivec4 >& value )   { m_uniforms_ivec4s[name] = value; }
+    // Copies `count` matrices into the array already stored under `name`,
+    // which doesn't allocate once it has been that long.
+    void storeUniform( const std::string& name, const mat4* values, int count )       { m_uniforms_mat4s[name].assign( values, values + count ); }
     
     // To use sampler() functions, pass the uniform names.
     // This version of the function assumes that the textures are bound to texture units
     // in the order this function was called.
-    void storeUniformSampler( const std::string& uniform_name )      { m_uniform_samplers.push_back( uniform_name ); }
+    void storeUniformSampler( const std::string& uniform_name )      { storeUniformSampler( uniform_name, GLint( m_uniform_samplers.size() ) ); }
+    // This version reads from `texture_unit`. Samplers reading the same texture
+    // can share a unit, so that the texture is bound once.
+    void storeUniformSampler( const std::string& uniform_name, GLint texture_unit )      { m_uniform_samplers.push_back( uniform_name ); m_uniform_sampler_units.push_back( texture_unit ); }
     // This function assumes that the textures are bound to the texture unit
     // corresponding to the index in the vector.
-    void storeUniformSamplers( const std::vector< std::string >& uniform_names )      { m_uniform_samplers = uniform_names; }
+    void storeUniformSamplers( const std::vector< std::string >& uniform_names );
     
 private:
     std::unordered_map< std::string, GLfloat > m_uniforms_float;
@@ -142,6 +218,7 @@ private:
     std::unordered_map< std::string, std::vector< ivec4   > > m_uniforms_ivec4s;
     
     std::vector< std::string > m_uniform_samplers;
+    std::vector< GLint > m_uniform_sampler_units;
 };
 
 }
@@ -0,0 +1,220 @@
+#include "shaderprogramcache.h"
+
+#include "glcompat.h"
+#include "shaderprogram.h"
+#include "hashing.h"
+#include "mappedfile.h" // make_directory(), unique_temporary_path()
+
+#include <algorithm> // equal(), min_element()
+#include <chrono>
+#include <cstdio> // rename(), remove()
+#include <fstream>
+#include <iomanip> // setw(), setfill()
+#include <sstream>
+#include <iostream>
+using std::cerr;
+
+namespace {
+// Binaries only load with the driver that made them. Remember which one did.
+std::uint64_t driver_hash() {
+    using graphics101::fnv1a;
+    std::uint64_t hash = fnv1a( nullptr, 0 );
+    for( GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION } ) {
+        const char* str = reinterpret_cast< const char* >( glGetString( name ) );
+        if( str ) hash = fnv1a( str, std::string( str ).size(), hash );
+    }
+    return hash;
+}
+
+// The binary file starts with this, followed by the driver hash, the key,
+// the binary format, and the binary itself.
+const char kMagic[8] = { 'G','1','0','1','P','R','G','1' };
+
+template< typename T >
+void write_pod( std::ostream& out, const T& value ) {
+    out.write( reinterpret_cast< const char* >( &value ), sizeof( T ) );
+}
+template< typename T >
+bool read_pod( std::istream& in, T& value ) {
+    in.read( reinterpret_cast< char* >( &value ), sizeof( T ) );
+    return bool( in );
+}
+}
+
+namespace graphics101 {
+
+ShaderProgramPtr ShaderProgramCache::find( const Key& key ) {
+    const auto start = std::chrono::steady_clock::now();
+    ShaderProgramPtr result;
+    
+    const auto found = m_programs.find( key );
+    const bool in_memory = found != m_programs.end();
+    if( in_memory ) {
+        result = found->second.program;
+        found->second.last_used = ++m_clock;
+        m_memory_hits += 1;
+    } else {
+        result = loadFromDisk( key );
+        if( !result ) return nullptr;
+        
+        store( key, result );
+        m_disk_hits += 1;
+    }
+    
+    // Every shader in the program and the link were avoided.
+    m_compiles_avoided += key.size();
+    cerr << "Shader program found in the " << ( in_memory ? "memory" : "disk" ) << " cache in "
+         << std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count() << " ms ("
+         << m_compiles_avoided << " shader compiles and " << linksAvoided() << " links avoided so far).\n";
+    
+    return result;
+}
+
+void ShaderProgramCache::insert( const ShaderProgramPtr& program ) {
+    assert( program );
+    const Key& key = program->linkedSourceHashes();
+    // Only successfully linked programs have a key.
+    if( key.empty() ) return;
+    
+    store( key, program );
+    
+    if( !m_disk_directory.empty() ) saveToDisk( *program );
+}
+
+void ShaderProgramCache::store( const Key& key, const ShaderProgramPtr& program ) {
+    Entry& entry = m_programs[ key ];
+    entry.program = program;
+    entry.last_used = ++m_clock;
+    evict();
+}
+
+void ShaderProgramCache::evict() {
+    while( m_programs.size() > std::size_t( std::max( m_capacity, 0 ) ) ) {
+        const auto oldest = std::min_element( m_programs.begin(), m_programs.end(),
+            []( const std::pair< const Key, Entry >& a, const std::pair< const Key, Entry >& b ) { return a.second.last_used < b.second.last_used; }
+            );
+        m_programs.erase( oldest );
+    }
+}
+
+void ShaderProgramCache::setCapacity( int capacity ) {
+    m_capacity = capacity;
+    evict();
+}
+
+void ShaderProgramCache::setDiskDirectory( const std::string& directory ) {
+    m_disk_directory = directory;
+    if( m_disk_directory.empty() ) return;
+    
+    if( !ShaderProgram::supportsProgramBinary() ) {
+        cerr << "WARNING: The OpenGL driver can't save program binaries. Not saving shaders to: " << m_disk_directory << '\n';
+        m_disk_directory.clear();
+        return;
+    }
+    if( !make_directory( m_disk_directory ) ) {
+        cerr << "ERROR: Unable to create shader cache directory: " << m_disk_directory << '\n';
+        m_disk_directory.clear();
+    }
+}
+
+void ShaderProgramCache::clear() {
+    m_programs.clear();
+}
+
+std::string ShaderProgramCache::pathForKey( const Key& key ) const {
+    const std::uint64_t hash = fnv1a( key.data(), key.size()*sizeof( std::uint64_t ) );
+    std::ostringstream name;
+    name << std::hex << std::setw( 16 ) << std::setfill( '0' ) << hash;
+    return m_disk_directory + '/' + name.str() + ".glprogram";
+}
+
+ShaderProgramPtr ShaderProgramCache::loadFromDisk( const Key& key ) const {
+    if( m_disk_directory.empty() ) return nullptr;
+    
+    std::ifstream in( pathForKey( key ), std::ios::binary | std::ios::ate );
+    // Not an error. It just hasn't been saved yet.
+    if( !in ) return nullptr;
+    const std::streamoff file_size = in.tellg();
+    in.seekg( 0 );
+    
+    // Check that the file is for this driver and this key.
+    char magic[ sizeof( kMagic ) ];
+    in.read( magic, sizeof( magic ) );
+    if( !in || !std::equal( magic, magic + sizeof( magic ), kMagic ) ) return nullptr;
+    
+    std::uint64_t driver = 0;
+    if( !read_pod( in, driver ) || driver != driver_hash() ) return nullptr;
+    
+    std::uint32_t key_size = 0;
+    if( !read_pod( in, key_size ) || key_size != key.size() ) return nullptr;
+    for( std::uint64_t hash : key ) {
+        std::uint64_t stored = 0;
+        if( !read_pod( in, stored ) || stored != hash ) return nullptr;
+    }
+    
+    std::uint32_t format = 0;
+    std::uint32_t length = 0;
+    if( !read_pod( in, format ) || !read_pod( in, length ) ) return nullptr;
+    // Don't trust the length of a truncated or corrupt file.
+    if( std::streamoff( length ) > file_size - std::streamoff( in.tellg() ) ) {
+        cerr << "ERROR: Saved shader program is truncated. It will be recompiled.\n";
+        return nullptr;
+    }
+    std::vector< char > binary( length );
+    in.read( binary.data(), length );
+    if( !in ) return nullptr;
+    
+    ShaderProgramPtr program = ShaderProgram::makePtr();
+    if( !program->setBinary( format, binary, key ) ) {
+        cerr << "The OpenGL driver rejected a saved shader program. It will be recompiled.\n";
+        return nullptr;
+    }
+    return program;
+}
+
+void ShaderProgramCache::saveToDisk( const ShaderProgram& program ) const {
+    GLenum format = 0;
+    std::vector< char > binary;
+    if( !program.getBinary( format, binary ) ) {
+        cerr << "WARNING: The OpenGL driver didn't provide a binary for the shader program. Not saving it.\n";
+        return;
+    }
+    
+    const Key& key = program.linkedSourceHashes();
+    const std::string path = pathForKey( key );
+    
+    // Write to a temporary file and rename it, so that a crash or another instance
+    // of the program saving the same variant never leaves a half-written binary behind.
+    const std::string temporary = unique_temporary_path( path );
+    {
+        std::ofstream out( temporary, std::ios::binary );
+        if( !out ) {
+            cerr << "ERROR: Could not open file for writing: " << temporary << '\n';
+            return;
+        }
+        
+        out.write( kMagic, sizeof( kMagic ) );
+        write_pod( out, driver_hash() );
+        write_pod( out, std::uint32_t( key.size() ) );
+        for( std::uint64_t hash : key ) write_pod( out, hash );
+        write_pod( out, std::uint32_t( format ) );
+        write_pod( out, std::uint32_t( binary.size() ) );
+        out.write( binary.data(), binary.size() );
+        
+        if( !out ) {
+            cerr << "ERROR: Could not write shader program cache file: " << temporary << '\n';
+            out.close();
+            std::remove( temporary.c_str() );
+            return;
+        }
+    }
+    
+    // rename() won't replace an existing file on Windows.
+    std::remove( path.c_str() );
+    if( std::rename( temporary.c_str(), path.c_str() ) != 0 ) {
+        cerr << "ERROR: Could not rename " << temporary << " to " << path << '\n';
+        std::remove( temporary.c_str() );
+    }
+}
+
+}
@@ -0,0 +1,88 @@
+#ifndef __shaderprogramcache_h__
+#define __shaderprogramcache_h__
+
+#include "types.h"
+
+// Forward declarations.
+#include "glfwd.h"
+
+#include <cstdint> // uint64_t
+#include <map>
+#include <string>
+#include <vector>
+
+namespace graphics101 {
+
+/*
+A cache of linked ShaderPrograms keyed by the source code of their shaders.
+A shader variant (the same files compiled with a different set of #defines)
+has different source code, so each variant is compiled once, the first time
+it is needed, and reused after that.
+
+The cache can also save the linked program binaries to a directory
+so that later runs needn't compile them at all.
+
+Every hot reload of a shader file makes a new key, so the cache keeps at most
+capacity() programs in memory and forgets the least recently used ones first.
+*/
+class ShaderProgramCache {
+public:
+    // The sorted ShaderProgram::sourceHash()'es of a program's shaders.
+    // This is what ShaderProgram::linkedSourceHashes() returns.
+    typedef std::vector< std::uint64_t > Key;
+    
+    // Returns the program for `key` if it is in memory or on disk.
+    // Returns nullptr if it has to be compiled.
+    ShaderProgramPtr find( const Key& key );
+    // Stores a successfully linked program under its linkedSourceHashes().
+    // Also saves its binary if there is a disk directory.
+    // Call ShaderProgram::requestRetrievableBinary() before linking it.
+    void insert( const ShaderProgramPtr& program );
+    
+    // Sets the directory in which to save program binaries.
+    // The empty string (the default) turns saving off.
+    void setDiskDirectory( const std::string& directory );
+    const std::string& diskDirectory() const { return m_disk_directory; }
+    
+    // Forgets all programs in memory. Doesn't touch the disk.
+    void clear();
+    
+    // The most programs kept in memory. Lowering it forgets programs right away.
+    // Programs in use elsewhere stay alive; the cache just stops holding them.
+    void setCapacity( int capacity );
+    int capacity() const { return m_capacity; }
+    int size() const { return int( m_programs.size() ); }
+    
+    // How many times find() found a program in memory or on disk,
+    // and how many shader compiles and program links that avoided.
+    int hits() const { return m_memory_hits + m_disk_hits; }
+    int compilesAvoided() const { return m_compiles_avoided; }
+    int linksAvoided() const { return hits(); }
+    
+private:
+    // Returns the path of the binary for `key` in the disk directory.
+    std::string pathForKey( const Key& key ) const;
+    ShaderProgramPtr loadFromDisk( const Key& key ) const;
+    void saveToDisk( const ShaderProgram& program ) const;
+    // Stores `program` under `key` and forgets the least recently used programs past capacity().
+    void store( const Key& key, const ShaderProgramPtr& program );
+    void evict();
+    
+    struct Entry {
+        ShaderProgramPtr program;
+        // When find() or insert() last touched it, in calls.
+        std::uint64_t last_used = 0;
+    };
+    std::map< Key, Entry > m_programs;
+    std::uint64_t m_clock = 0;
+    int m_capacity = 32;
+    std::string m_disk_directory;
+    
+    int m_memory_hits = 0;
+    int m_disk_hits = 0;
+    int m_compiles_avoided = 0;
+};
+
+}
+
+#endif /* __shaderprogramcache_h__ */
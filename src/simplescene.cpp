@@ -17,6 +17,7 @@ using std::cerr;
 #include "drawable.h"
 #include "camera.h"
 #include "parsing.h"
+#include "glstate.h"
 
 #include "glcompat.h"
 
@@ -46,11 +47,11 @@ void SimpleScene::init() {
     // Turn on some standard OpenGL stuff.
     
     // We want the z-buffer.
-    glEnable( GL_DEPTH_TEST );
+    glstate::setEnabled( GL_DEPTH_TEST, true );
     
     // Allow alpha blending.
-    glEnable( GL_BLEND );
-    glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+    glstate::setEnabled( GL_BLEND, true );
+    glstate::blendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
     
     this->loadScene( m_scene_path );
 }
@@ -1,18 +1,41 @@
 #include "texture.h"
 
 #include "glcompat.h"
+#include "glfwd.h" // StringSet
+#include "glstate.h"
 
+#include "image.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+
+#include <algorithm> // max()
+#include <chrono> // Measuring load times.
+#include <cstring> // memcpy()
+#include <future>
 #include <iostream>
+#include <sstream>
 using std::cerr;
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+// From GL_EXT_texture_sRGB, which glcorearb.h doesn't have.
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
 namespace graphics101 {
 
 void bind_textures( const TextureVec& textures ) {
+    bind_textures( textures, std::vector< GLuint >() );
+}
+void bind_textures( const TextureVec& textures, const std::vector< GLuint >& samplers ) {
     for( int index = 0; index < textures.size(); ++index ) {
-        glActiveTexture( GL_TEXTURE0 + index );
+        glstate::activeTexture( index );
+        glstate::bindSampler( index, index < samplers.size() ? samplers[index] : 0 );
         
         // We will have a null pointer if bindable_textures was called
         // with an unknown name.
@@ -51,6 +74,7 @@ Texture::Texture()
 }
 Texture::~Texture()
 {
+    glstate::forgetTexture( m_textureName );
     glDeleteTextures( 1, &m_textureName );
     // Set it to zero for debugging purposes.
     m_textureName = 0;
@@ -59,109 +83,738 @@ Texture::~Texture()
 }
 
 namespace {
-std::pair< int, int > upload_image( GLenum target, const std::string& path, bool flip = false ) {
-    int width(-1), height(-1), num_channels(-1);
-    stbi_set_flip_vertically_on_load( flip );
-    unsigned char* data = stbi_load( path.c_str(), &width, &height, &num_channels, 4 );
-    if( !data ) {
-        cerr << "ERROR: Could not load texture: " << path << '\n';
-        width = height = -1;
+// The worker threads that decode image files.
+graphics101::ThreadPool& decode_pool() {
+    static graphics101::ThreadPool pool;
+    return pool;
+}
+
+// Where decoded images are saved. Empty means nowhere.
+std::string& disk_cache_directory() {
+    static std::string directory;
+    return directory;
+}
+
+// Whether the driver supports the extension `name`.
+bool has_extension( const std::string& name ) {
+    static const graphics101::StringSet extensions = []() {
+        graphics101::StringSet result;
+        GLint num_extensions = 0;
+        glGetIntegerv( GL_NUM_EXTENSIONS, &num_extensions );
+        for( GLint i = 0; i < num_extensions; ++i ) {
+            result.insert( reinterpret_cast< const char* >( glGetStringi( GL_EXTENSIONS, i ) ) );
+        }
+        return result;
+    }();
+    return extensions.count( name ) > 0;
+}
+
+// The block compression to use for an image with `settings` whose file has `file_channels` channels.
+// Returns Raw if the driver can't decode the compression.
+graphics101::ImageEncoding texture_encoding( const graphics101::TextureSettings& settings, int file_channels ) {
+    using graphics101::TextureSettings;
+    using graphics101::ImageEncoding;
+    
+    ImageEncoding encoding = ImageEncoding::Raw;
+    switch( settings.compression ) {
+        case TextureSettings::NoCompression: encoding = ImageEncoding::Raw; break;
+        case TextureSettings::BC1Compression: encoding = ImageEncoding::BC1; break;
+        case TextureSettings::BC3Compression: encoding = ImageEncoding::BC3; break;
+        case TextureSettings::BC5Compression: encoding = ImageEncoding::BC5; break;
+        case TextureSettings::AutoCompression:
+            // Not BC5 for normal maps, because the shaders read their Z from blue,
+            // which BC5 doesn't store. BC1 would be too blocky for normals.
+            if( settings.content == graphics101::ImageContent::NormalMap ) encoding = ImageEncoding::Raw;
+            else if( file_channels == 2 || file_channels == 4 ) encoding = ImageEncoding::BC3;
+            else encoding = ImageEncoding::BC1;
+            break;
+    }
+    
+    // RGTC (BC5) is core since OpenGL 3.0. S3TC (BC1 and BC3) is an extension.
+    if( ( encoding == ImageEncoding::BC1 || encoding == ImageEncoding::BC3 ) && !has_extension( "GL_EXT_texture_compression_s3tc" ) ) {
+        static bool warned = false;
+        if( !warned ) cerr << "WARNING: The OpenGL driver doesn't support S3TC. Textures will be uncompressed.\n";
+        warned = true;
+        encoding = ImageEncoding::Raw;
+    }
+    // The sRGB versions need GL_EXT_texture_sRGB, too.
+    if( ( encoding == ImageEncoding::BC1 || encoding == ImageEncoding::BC3 ) && settings.srgb && !has_extension( "GL_EXT_texture_sRGB" ) ) {
+        static bool warned = false;
+        if( !warned ) cerr << "WARNING: The OpenGL driver doesn't support sRGB S3TC. sRGB textures will be uncompressed.\n";
+        warned = true;
+        encoding = ImageEncoding::Raw;
+    }
+    
+    return encoding;
+}
+
+// The options for loading an image with `settings` whose file has `file_channels` channels.
+graphics101::ImageLoadOptions load_options( const graphics101::TextureSettings& settings, int file_channels ) {
+    using graphics101::TextureSettings;
+    
+    graphics101::ImageLoadOptions options;
+    options.mipmaps = settings.mipmaps == TextureSettings::CPUMipmaps;
+    options.content = settings.content;
+    options.encoding = texture_encoding( settings, file_channels );
+    // glGenerateMipmap() can't make mipmaps for compressed textures.
+    if( options.encoding != graphics101::ImageEncoding::Raw && settings.mipmaps == TextureSettings::GPUMipmaps ) options.mipmaps = true;
+    return options;
+}
+
+// Loads the image on a decode_pool() thread.
+std::future< graphics101::Image > load_image_async( const std::string& path, const graphics101::ImageLoadOptions& options ) {
+    // Copy the directory now so that the worker doesn't read it while someone changes it.
+    const std::string cache_directory = disk_cache_directory();
+    return decode_pool().submit( [=]() { return graphics101::load_image( path, options, cache_directory, &decode_pool() ); } );
+}
+
+// The number of channels in the image file at `path`, or 0 if it can't be read.
+// This only reads the header.
+int file_channels( const std::string& path ) {
+    int width, height, channels = 0;
+    if( !stbi_info( path.c_str(), &width, &height, &channels ) ) return 0;
+    return channels;
+}
+
+// The largest anisotropy the driver supports, or 1 if it doesn't support anisotropic filtering.
+float max_supported_anisotropy() {
+    static const float result = []() {
+        // It's core in OpenGL 4.6 and an extension before that.
+        GLint major = 0, minor = 0;
+        glGetIntegerv( GL_MAJOR_VERSION, &major );
+        glGetIntegerv( GL_MINOR_VERSION, &minor );
+        const bool supported = major > 4 || ( major == 4 && minor >= 6 )
+            || has_extension( "GL_EXT_texture_filter_anisotropic" ) || has_extension( "GL_ARB_texture_filter_anisotropic" );
+        if( !supported ) return 1.f;
+        
+        // The EXT and core enums have the same value.
+        GLfloat max_anisotropy = 1;
+        glGetFloatv( GL_MAX_TEXTURE_MAX_ANISOTROPY, &max_anisotropy );
+        return max_anisotropy;
+    }();
+    return result;
+}
+
+// Sets the filtering parameters for the texture bound to `target`,
+// which has `num_levels` levels uploaded. Call this after uploading.
+void set_filtering( GLenum target, const graphics101::TextureSettings& settings, const graphics101::ImageLoadOptions& options, int num_levels ) {
+    using graphics101::TextureSettings;
+    
+    const bool mipmapped = settings.mipmaps != TextureSettings::NoMipmaps;
+    glTexParameteri( target, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameteri( target, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR );
+    glTexParameteri( target, GL_TEXTURE_BASE_LEVEL, 0 );
+    
+    if( mipmapped && !options.mipmaps ) {
+        // 1000 is the default, which means all of them.
+        glTexParameteri( target, GL_TEXTURE_MAX_LEVEL, 1000 );
+        glGenerateMipmap( target );
     } else {
-        glTexImage2D( target, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data );
+        // Without mipmaps, we have 1 level.
+        // From: https://www.khronos.org/opengl/wiki/Common_Mistakes#Creating_a_complete_texture
+        glTexParameteri( target, GL_TEXTURE_MAX_LEVEL, std::max( 0, num_levels - 1 ) );
+    }
+    
+    const float max_anisotropy = max_supported_anisotropy();
+    if( max_anisotropy > 1 ) {
+        glTexParameterf( target, GL_TEXTURE_MAX_ANISOTROPY, std::min( std::max( settings.anisotropy, 1.f ), max_anisotropy ) );
+    }
+}
+
+// The glTexImage2D() formats for an image.
+struct UploadFormat {
+    GLenum internal_format;
+    GLenum format;
+    GLenum type;
+};
+UploadFormat upload_format( const graphics101::Image& image, bool srgb ) {
+    static const GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    static const GLenum internal_formats_8[4] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+    // There are no one- or two-channel sRGB formats in core OpenGL.
+    static const GLenum internal_formats_srgb[4] = { GL_R8, GL_RG8, GL_SRGB8, GL_SRGB8_ALPHA8 };
+    static const GLenum internal_formats_float[4] = { GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F };
+    
+    const int index = std::min( std::max( image.channels, 1 ), 4 ) - 1;
+    
+    UploadFormat result;
+    result.format = formats[ index ];
+    if( image.is_float ) {
+        result.internal_format = internal_formats_float[ index ];
+        result.type = GL_FLOAT;
+    } else {
+        result.internal_format = srgb ? internal_formats_srgb[ index ] : internal_formats_8[ index ];
+        result.type = GL_UNSIGNED_BYTE;
+    }
+    return result;
+}
+
+// Makes shaders see gray images as gray rather than red (and red-green),
+// the same as they did when everything was uploaded as RGBA.
+void set_swizzle( GLenum target, const graphics101::Image& image ) {
+    // Compressed images are RGB(A), except BC5, which is meant to be read as red-green.
+    const int channels = image.encoding == graphics101::ImageEncoding::Raw ? image.channels : 4;
+    const GLint gray[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+    const GLint gray_alpha[4] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+    const GLint identity[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+    
+    const GLint* swizzle = identity;
+    if( channels == 1 ) swizzle = gray;
+    else if( channels == 2 ) swizzle = gray_alpha;
+    glTexParameteriv( target, GL_TEXTURE_SWIZZLE_RGBA, swizzle );
+}
+
+void upload_raw_image( GLenum target, const graphics101::Image& image, bool srgb );
+// Uploads the decoded image to `target`. Call this on the OpenGL thread.
+void upload_image( GLenum target, const graphics101::Image& image, bool srgb ) {
+    if( !image.valid() ) {
+        cerr << "ERROR: Could not load texture: " << image.path << '\n';
+        return;
+    }
+    
+    if( image.encoding != graphics101::ImageEncoding::Raw ) {
+        // BC5 holds two linear channels, so it has no sRGB version.
+        GLenum internal_format = GL_COMPRESSED_RG_RGTC2;
+        if( image.encoding == graphics101::ImageEncoding::BC1 ) internal_format = srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        else if( image.encoding == graphics101::ImageEncoding::BC3 ) internal_format = srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        
+        for( int level = 0; level < image.levels.size(); ++level ) {
+            const auto& data = image.levels[level];
+            glCompressedTexImage2D( target, level, internal_format, data.width, data.height, 0, data.size, data.texels );
+        }
+    }
+    else {
+        upload_raw_image( target, image, srgb );
+    }
+    
+    cerr << ( image.from_disk_cache ? "Loaded decoded image from the cache" : "Decoded image" )
+         << " in " << image.load_milliseconds << " ms: " << image.path << '\n';
+}
+
+void upload_raw_image( GLenum target, const graphics101::Image& image, bool srgb ) {
+    const UploadFormat format = upload_format( image, srgb );
+    
+    // Rows of one- and three-channel images needn't be a multiple of 4 bytes.
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    for( int level = 0; level < image.levels.size(); ++level ) {
+        const auto& data = image.levels[level];
+        glTexImage2D( target, level, format.internal_format, data.width, data.height, 0, format.format, format.type, data.texels );
+    }
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+}
+
+// The number of bytes the texture takes on the GPU (ignoring padding), and
+// the number it would take as RGBA8, which is what we used to upload everything as.
+void report_memory( const std::string& name, const graphics101::Image& image, int num_images, bool gpu_mipmaps ) {
+    if( !image.valid() ) return;
+    
+    std::size_t texels = 0;
+    std::size_t compressed_bytes = 0;
+    for( const auto& level : image.levels ) {
+        texels += std::size_t( level.width )*level.height;
+        compressed_bytes += level.size;
+    }
+    compressed_bytes *= num_images;
+    // A full mip chain adds a third.
+    if( gpu_mipmaps && image.levels.size() == 1 ) texels += texels/3;
+    texels *= num_images;
+    
+    if( image.encoding != graphics101::ImageEncoding::Raw ) {
+        cerr << "Texture memory for " << name << ": " << compressed_bytes/1024 << " KB block compressed ("
+             << texels*4/1024 << " KB as RGBA8).\n";
+        return;
+    }
+    
+    // Float images are stored as half floats.
+    const std::size_t bytes_per_texel = image.channels*( image.is_float ? 2 : 1 );
+    cerr << "Texture memory for " << name << ": " << texels*bytes_per_texel/1024 << " KB with "
+         << image.channels << ( image.is_float ? " half-float" : " 8-bit" ) << " channels ("
+         << texels*4/1024 << " KB as RGBA8).\n";
+}
+
+double milliseconds_since( const std::chrono::steady_clock::time_point& start ) {
+    return std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+}
+
+// Whether Texture2D::reload() streams.
+bool& streaming_enabled() {
+    static bool enabled = false;
+    return enabled;
+}
+
+// The textures that are streaming, which update_streaming_textures() moves along.
+std::vector< graphics101::Texture2D* >& streaming_textures() {
+    static std::vector< graphics101::Texture2D* > textures;
+    return textures;
+}
+void stop_tracking( graphics101::Texture2D* texture ) {
+    auto& textures = streaming_textures();
+    textures.erase( std::remove( textures.begin(), textures.end(), texture ), textures.end() );
+}
+
+// Totals for a batch of streaming textures, reported once they are all done.
+struct StreamingStats {
+    int num_textures = 0;
+    std::chrono::steady_clock::time_point start;
+    // Time spent inside reload() and updateStreaming(), which is time the main thread can't draw.
+    double main_thread_milliseconds = 0;
+};
+StreamingStats& streaming_stats() {
+    static StreamingStats stats;
+    return stats;
+}
+
+// Where each level goes in a pixel buffer object holding all of `image`'s levels.
+// Returns the total size. Level offsets are 16-byte aligned, which is plenty for floats.
+std::size_t pixel_buffer_layout( const graphics101::Image& image, std::vector< std::size_t >& offsets ) {
+    offsets.clear();
+    std::size_t size = 0;
+    for( const auto& level : image.levels ) {
+        offsets.push_back( size );
+        size += ( level.size + 15 ) & ~std::size_t(15);
+    }
+    return size;
+}
+
+// Whether a worker thread has finished `future`, without waiting.
+template< typename T >
+bool is_ready( const std::future< T >& future ) {
+    return future.wait_for( std::chrono::seconds(0) ) == std::future_status::ready;
+}
+}
+
+namespace graphics101 {
+
+void set_texture_decode_threads( int num_threads ) {
+    if( num_threads <= 0 ) num_threads = std::max( 1, int( std::thread::hardware_concurrency() ) );
+    if( num_threads == decode_pool().size() ) return;
+    
+    decode_pool().resize( num_threads );
+    cerr << "Decoding images with " << num_threads << " threads.\n";
+}
+
+float max_texture_anisotropy() {
+    return max_supported_anisotropy();
+}
+
+ThreadPool& texture_decode_pool() {
+    return decode_pool();
+}
+
+void set_texture_streaming( bool stream ) {
+    streaming_enabled() = stream;
+}
+
+bool update_streaming_textures() {
+    auto& textures = streaming_textures();
+    if( textures.empty() ) return false;
+    
+    // Iterate over a copy, since finished textures remove themselves.
+    const std::vector< Texture2D* > in_flight = textures;
+    for( Texture2D* texture : in_flight ) {
+        if( texture->updateStreaming() ) stop_tracking( texture );
     }
-    stbi_image_free( data );
     
-    return std::make_pair( width, height );
+    if( !textures.empty() ) return true;
+    
+    StreamingStats& stats = streaming_stats();
+    cerr << "Streamed " << stats.num_textures << " textures in " << milliseconds_since( stats.start )
+         << " ms. The main thread spent " << stats.main_thread_milliseconds << " ms on them.\n";
+    stats = StreamingStats();
+    return false;
 }
+
+void set_texture_cache_directory( const std::string& directory ) {
+    disk_cache_directory() = directory;
+    if( directory.empty() ) return;
+    
+    if( !make_directory( directory ) ) {
+        cerr << "ERROR: Unable to create decoded image cache directory: " << directory << '\n';
+        disk_cache_directory().clear();
+    }
+}
+
 }
 
 namespace graphics101 {
 
-Texture2D::Texture2D( const std::string& image_path )
-    : m_image_path( image_path )
+// An upload in progress. It goes through these steps:
+// 1. `decoded` is pending while a decode thread loads the image.
+// 2. `copied` is pending while a decode thread copies the image into the mapped `pixel_buffer`.
+// 3. `fence` is unsignaled while the GPU uploads from `pixel_buffer` into `texture`.
+// Then `texture` replaces m_textureName.
+struct Texture2D::Streaming {
+    std::chrono::steady_clock::time_point start;
+    ImageLoadOptions options;
+    
+    std::future< Image > decoded;
+    Image image;
+    
+    GLuint pixel_buffer = 0;
+    void* mapped = nullptr;
+    std::vector< std::size_t > offsets;
+    std::future< void > copied;
+    
+    GLuint texture = 0;
+    GLsync fence = 0;
+};
+
+Texture2D::Texture2D( const std::string& image_path, const TextureSettings& settings )
+    : m_image_path( image_path ), m_settings( settings )
 {
     reload();
 }
+Texture2D::~Texture2D()
+{
+    cancelStreaming();
+}
 void Texture2D::reload()
 {
-    glBindTexture( GL_TEXTURE_2D, m_textureName );
+    if( streaming_enabled() ) {
+        const auto start = std::chrono::steady_clock::now();
+        cancelStreaming();
+        
+        m_streaming.reset( new Streaming );
+        m_streaming->start = start;
+        m_streaming->options = load_options( m_settings, file_channels( m_image_path ) );
+        m_streaming->options.flip = true;
+        m_streaming->decoded = load_image_async( m_image_path, m_streaming->options );
+        
+        // Until the image arrives, show a gray texel. When reloading, keep showing the old image.
+        if( width < 0 ) {
+            const GLubyte gray[4] = { 128, 128, 128, 255 };
+            glstate::editTexture( GL_TEXTURE_2D, m_textureName );
+            glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gray );
+            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0 );
+        }
+        
+        StreamingStats& stats = streaming_stats();
+        if( streaming_textures().empty() ) {
+            stats = StreamingStats();
+            stats.start = start;
+        }
+        stats.num_textures += 1;
+        stats.main_thread_milliseconds += milliseconds_since( start );
+        streaming_textures().push_back( this );
+        return;
+    }
     
-    // Set common parameters. We're not using mip-mapping.
-    // From: https://www.khronos.org/opengl/wiki/Common_Mistakes#Creating_a_complete_texture
+    cancelStreaming();
+    
+    glstate::editTexture( GL_TEXTURE_2D, m_textureName );
     
     // Set common parameters.
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0 );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,  0 );
     
     // Upload data.
     // TODO: If we know that the new and old data are the same size, we could use glTexSubImage2D();
-    const auto width_height = upload_image( GL_TEXTURE_2D, m_image_path, true );
-    width = width_height.first;
-    height = width_height.second;
+    ImageLoadOptions options = load_options( m_settings, file_channels( m_image_path ) );
+    options.flip = true;
+    const Image image = load_image_async( m_image_path, options ).get();
+    upload_image( GL_TEXTURE_2D, image, m_settings.srgb );
+    width = image.width();
+    height = image.height();
+    
+    set_filtering( GL_TEXTURE_2D, m_settings, options, image.levels.size() );
+    set_swizzle( GL_TEXTURE_2D, image );
+    report_memory( m_image_path, image, 1, m_settings.mipmaps != TextureSettings::NoMipmaps && !options.mipmaps );
 }
 void Texture2D::bind()
 {
-    glBindTexture( GL_TEXTURE_2D, m_textureName );
+    glstate::bindTexture( GL_TEXTURE_2D, m_textureName );
+}
+bool Texture2D::updateStreaming()
+{
+    if( !m_streaming ) return true;
+    
+    Streaming& streaming = *m_streaming;
+    const auto start = std::chrono::steady_clock::now();
+    bool done = false;
+    
+    if( streaming.decoded.valid() ) {
+        // 1. Wait for the decode threads to load the image.
+        if( !is_ready( streaming.decoded ) ) return false;
+        streaming.image = streaming.decoded.get();
+        if( !streaming.image.valid() ) {
+            cerr << "ERROR: Could not load texture: " << m_image_path << '\n';
+            done = true;
+        } else {
+            // Make a pixel buffer object big enough for every level and map it,
+            // so that a decode thread can copy into it.
+            const std::size_t size = pixel_buffer_layout( streaming.image, streaming.offsets );
+            glGenBuffers( 1, &streaming.pixel_buffer );
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, streaming.pixel_buffer );
+            glBufferData( GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW );
+            streaming.mapped = glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+            
+            if( !streaming.mapped ) {
+                cerr << "ERROR: Unable to map a pixel buffer for texture: " << m_image_path << '\n';
+                done = true;
+            } else {
+                // The lambda's copy of the image keeps its texels alive.
+                const Image image = streaming.image;
+                const std::vector< std::size_t > offsets = streaming.offsets;
+                unsigned char* const mapped = static_cast< unsigned char* >( streaming.mapped );
+                streaming.copied = decode_pool().submit( [=]() {
+                    for( int level = 0; level < image.levels.size(); ++level ) {
+                        std::memcpy( mapped + offsets[level], image.levels[level].texels, image.levels[level].size );
+                    }
+                } );
+            }
+        }
+    }
+    else if( streaming.copied.valid() ) {
+        // 2. Wait for the copy into the pixel buffer, then have the GPU upload from it.
+        if( !is_ready( streaming.copied ) ) return false;
+        streaming.copied.get();
+        
+        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, streaming.pixel_buffer );
+        const bool unmapped = glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER ) == GL_TRUE;
+        streaming.mapped = nullptr;
+        if( !unmapped ) {
+            // The contents were lost (this can happen when the screen mode changes).
+            cerr << "ERROR: A pixel buffer was corrupted while streaming texture: " << m_image_path << '\n';
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+            done = true;
+        } else {
+            // Upload into a new texture, so the old one can be drawn with in the meantime.
+            // While a pixel buffer is bound, the texel pointers are offsets into it.
+            Image in_buffer = streaming.image;
+            for( int level = 0; level < in_buffer.levels.size(); ++level ) {
+                in_buffer.levels[level].texels = reinterpret_cast< const unsigned char* >( streaming.offsets[level] );
+            }
+            
+            glGenTextures( 1, &streaming.texture );
+            glstate::editTexture( GL_TEXTURE_2D, streaming.texture );
+            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+            upload_image( GL_TEXTURE_2D, in_buffer, m_settings.srgb );
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+            set_filtering( GL_TEXTURE_2D, m_settings, streaming.options, in_buffer.levels.size() );
+            set_swizzle( GL_TEXTURE_2D, in_buffer );
+            
+            streaming.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+        }
+    }
+    else if( streaming.fence ) {
+        // 3. Wait for the GPU to finish uploading, then swap in the new texture.
+        const GLenum status = glClientWaitSync( streaming.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0 );
+        if( status == GL_TIMEOUT_EXPIRED ) return false;
+        
+        std::swap( m_textureName, streaming.texture );
+        width = streaming.image.width();
+        height = streaming.image.height();
+        report_memory( m_image_path, streaming.image, 1, m_settings.mipmaps != TextureSettings::NoMipmaps && !streaming.options.mipmaps );
+        cerr << "Streamed texture in " << milliseconds_since( streaming.start ) << " ms: " << m_image_path << '\n';
+        done = true;
+    }
+    
+    streaming_stats().main_thread_milliseconds += milliseconds_since( start );
+    
+    if( done ) cancelStreaming();
+    return done;
+}
+void Texture2D::cancelStreaming()
+{
+    if( !m_streaming ) return;
+    
+    Streaming& streaming = *m_streaming;
+    // The copy must finish before the buffer is unmapped.
+    if( streaming.copied.valid() ) streaming.copied.wait();
+    if( streaming.pixel_buffer ) {
+        if( streaming.mapped ) {
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, streaming.pixel_buffer );
+            glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+        }
+        glDeleteBuffers( 1, &streaming.pixel_buffer );
+    }
+    if( streaming.texture ) {
+        glstate::forgetTexture( streaming.texture );
+        glDeleteTextures( 1, &streaming.texture );
+    }
+    if( streaming.fence ) glDeleteSync( streaming.fence );
+    
+    m_streaming.reset();
+    stop_tracking( this );
+}
+
+ImageTexture2D::ImageTexture2D( const Image& image, const TextureSettings& settings )
+    : m_image( image ), m_settings( settings )
+{
+    reload();
+}
+void ImageTexture2D::reload()
+{
+    glstate::editTexture( GL_TEXTURE_2D, m_textureName );
+    
+    // Set common parameters.
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    
+    // The image's levels are its mipmaps.
+    ImageLoadOptions options;
+    options.mipmaps = m_image.levels.size() > 1;
+    upload_image( GL_TEXTURE_2D, m_image, m_settings.srgb );
+    set_filtering( GL_TEXTURE_2D, m_settings, options, m_image.levels.size() );
+    set_swizzle( GL_TEXTURE_2D, m_image );
+    report_memory( m_image.path, m_image, 1, m_settings.mipmaps != TextureSettings::NoMipmaps && !options.mipmaps );
+}
+void ImageTexture2D::bind()
+{
+    glstate::bindTexture( GL_TEXTURE_2D, m_textureName );
 }
 
 TextureCube::TextureCube(
     const std::string& image_path_x_plus, const std::string& image_path_x_minus,
     const std::string& image_path_y_plus, const std::string& image_path_y_minus,
-    const std::string& image_path_z_plus, const std::string& image_path_z_minus
+    const std::string& image_path_z_plus, const std::string& image_path_z_minus,
+    const TextureSettings& settings
     )
     : m_image_path_x_plus( image_path_x_plus ), m_image_path_x_minus( image_path_x_minus ),
     m_image_path_y_plus( image_path_y_plus ), m_image_path_y_minus( image_path_y_minus ),
-    m_image_path_z_plus( image_path_z_plus ), m_image_path_z_minus( image_path_z_minus )
+    m_image_path_z_plus( image_path_z_plus ), m_image_path_z_minus( image_path_z_minus ),
+    m_settings( settings )
 {
     reload();
 }
 void TextureCube::reload()
 {
     // From: https://www.khronos.org/opengl/wiki/Common_Mistakes#Creating_a_Cubemap_Texture
-    glBindTexture( GL_TEXTURE_CUBE_MAP, m_textureName );
+    glstate::editTexture( GL_TEXTURE_CUBE_MAP, m_textureName );
     
     // Set common parameters.
     glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
     glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
     glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE );
-    glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0 );
-    glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL,  0 );
+    
+    // The faces must all have the same format.
+    // Use the most channels any face has. Reading that from the headers is quick.
+    int channels = 1;
+    for( int face = 0; face < 6; ++face ) channels = std::max( channels, file_channels( facePath( face ) ) );
+    ImageLoadOptions options = load_options( m_settings, channels );
+    options.channels = channels;
+    
+    // Decode the six faces at the same time on the decode threads.
+    const auto start = std::chrono::steady_clock::now();
+    std::future< Image > faces[6];
+    for( int face = 0; face < 6; ++face ) {
+        faces[face] = load_image_async( facePath( face ), options );
+    }
     
     // Upload data for the six faces.
     // TODO: If we know that the new and old data are the same size, we could use glTexSubImage2D();
-    upload_image( GL_TEXTURE_CUBE_MAP_POSITIVE_X, m_image_path_x_plus );
-    upload_image( GL_TEXTURE_CUBE_MAP_NEGATIVE_X, m_image_path_x_minus );
-    upload_image( GL_TEXTURE_CUBE_MAP_POSITIVE_Y, m_image_path_y_plus );
-    upload_image( GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, m_image_path_y_minus );
-    upload_image( GL_TEXTURE_CUBE_MAP_POSITIVE_Z, m_image_path_z_plus );
-    upload_image( GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, m_image_path_z_minus );
+    // The faces should all have the same number of levels.
+    int num_levels = 0;
+    Image first_face;
+    for( int face = 0; face < 6; ++face ) {
+        const Image image = faces[face].get();
+        upload_image( GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, image, m_settings.srgb );
+        num_levels = face == 0 ? int( image.levels.size() ) : std::min( num_levels, int( image.levels.size() ) );
+        if( face == 0 ) first_face = image;
+    }
+    set_filtering( GL_TEXTURE_CUBE_MAP, m_settings, options, num_levels );
+    set_swizzle( GL_TEXTURE_CUBE_MAP, first_face );
+    cerr << "Loaded cube map in " << milliseconds_since( start ) << " ms with " << decode_pool().size() << " decode threads.\n";
+    report_memory( m_image_path_x_plus + " (cube map)", first_face, 6, m_settings.mipmaps != TextureSettings::NoMipmaps && !options.mipmaps );
+    
+    // Remember the format, but not the texels.
+    m_options = options;
+    m_num_levels = num_levels;
+    m_face_format = first_face;
+    m_face_format.levels.resize( std::min( std::size_t( 1 ), m_face_format.levels.size() ) );
+    for( auto& level : m_face_format.levels ) level.texels = nullptr;
+    m_face_format.storage.reset();
+}
+void TextureCube::reloadPath( const std::string& path )
+{
+    // A face with more channels than the others changes all of their formats.
+    if( !m_face_format.valid() || file_channels( path ) > m_options.channels ) {
+        reload();
+        return;
+    }
+    
+    const auto start = std::chrono::steady_clock::now();
+    std::future< Image > faces[6];
+    int num_changed = 0;
+    for( int face = 0; face < 6; ++face ) {
+        if( facePath( face ) != path ) continue;
+        faces[face] = load_image_async( path, m_options );
+        num_changed += 1;
+    }
+    if( num_changed == 0 ) return;
+    
+    // Every face must have the same size and format, or the cube map is incomplete.
+    Image images[6];
+    for( int face = 0; face < 6; ++face ) {
+        if( !faces[face].valid() ) continue;
+        images[face] = faces[face].get();
+        const Image& image = images[face];
+        const bool fits = image.valid()
+            && image.width() == m_face_format.width() && image.height() == m_face_format.height()
+            && image.channels == m_face_format.channels && image.is_float == m_face_format.is_float
+            && image.encoding == m_face_format.encoding && int( image.levels.size() ) >= m_num_levels;
+        if( !fits ) {
+            reload();
+            return;
+        }
+    }
+    
+    glstate::editTexture( GL_TEXTURE_CUBE_MAP, m_textureName );
+    for( int face = 0; face < 6; ++face ) {
+        if( images[face].valid() ) upload_image( GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, images[face], m_settings.srgb );
+    }
+    // Regenerates GPU mipmaps, if there are any.
+    set_filtering( GL_TEXTURE_CUBE_MAP, m_settings, m_options, m_num_levels );
+    cerr << "Reloaded " << num_changed << " cube map face(s) in " << milliseconds_since( start ) << " ms.\n";
+}
+const std::string& TextureCube::facePath( int face ) const
+{
+    const std::string* paths[6] = {
+        &m_image_path_x_plus, &m_image_path_x_minus,
+        &m_image_path_y_plus, &m_image_path_y_minus,
+        &m_image_path_z_plus, &m_image_path_z_minus
+        };
+    assert( face >= 0 && face < 6 );
+    return *paths[face];
 }
 void TextureCube::bind()
 {
-    glBindTexture( GL_TEXTURE_CUBE_MAP, m_textureName );
+    glstate::bindTexture( GL_TEXTURE_CUBE_MAP, m_textureName );
 }
 
-Texture::TexturePtr Texture2D::makePtr( const std::string& image_path )
+Texture::TexturePtr Texture2D::makePtr( const std::string& image_path, const TextureSettings& settings )
 {
-    return std::make_shared< Texture2D >( image_path );
+    return std::make_shared< Texture2D >( image_path, settings );
+}
+Texture::TexturePtr ImageTexture2D::makePtr( const Image& image, const TextureSettings& settings )
+{
+    return std::make_shared< ImageTexture2D >( image, settings );
 }
 Texture::TexturePtr TextureCube::makePtr(
         const std::string& image_path_x_plus, const std::string& image_path_x_minus,
         const std::string& image_path_y_plus, const std::string& image_path_y_minus,
-        const std::string& image_path_z_plus, const std::string& image_path_z_minus
+        const std::string& image_path_z_plus, const std::string& image_path_z_minus,
+        const TextureSettings& settings
         )
 {
     return std::make_shared< TextureCube >(
         image_path_x_plus, image_path_x_minus,
         image_path_y_plus, image_path_y_minus,
-        image_path_z_plus, image_path_z_minus
+        image_path_z_plus, image_path_z_minus,
+        settings
         );
 }
 
+std::string TextureSettings::key() const
+{
+    std::ostringstream result;
+    result << "mipmaps " << int( mipmaps ) << " content " << int( content ) << " anisotropy " << anisotropy
+           << " srgb " << srgb << " compression " << int( compression );
+    return result.str();
+}
+
 }
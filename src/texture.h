@@ -2,6 +2,7 @@
 #define __texture_h__
 
 #include "types.h"
+#include "image.h" // ImageContent
 
 #include <unordered_map>
 #include <string>
@@ -10,6 +11,8 @@
 
 namespace graphics101 {
 
+class ThreadPool;
+
 class Texture {
 public:
     typedef std::shared_ptr< Texture > TexturePtr;
@@ -23,6 +26,9 @@ public:
     
     // Reload image data from paths.
     virtual void reload() = 0;
+    // Reload only the image data that comes from `path`, which changed.
+    // By default, this reloads everything.
+    virtual void reloadPath( const std::string& /*path*/ ) { reload(); }
     
     // This class cannot be copied. Use a TexturePtr.
     Texture( const Texture& ) = delete;
@@ -39,13 +45,81 @@ typedef std::unordered_map< std::string, Texture::TexturePtr > TextureSet;
 typedef std::vector< Texture::TexturePtr > TextureVec;
 TextureVec bindable_textures( const TextureSet& textures, const std::vector< std::string >& names_in_bind_order );
 void bind_textures( const TextureVec& textures );
+// The same, but also binds sampler object `samplers[i]` to unit i.
+// Units without one (0 or past the end of `samplers`) use the texture's own filtering.
+void bind_textures( const TextureVec& textures, const std::vector< GLuint >& samplers );
+
+// How a texture is filtered. Set per texture in the scene JSON.
+struct TextureSettings {
+    enum Mipmaps {
+        // Sample only the full-size image.
+        NoMipmaps,
+        // Generate mipmaps with glGenerateMipmap().
+        GPUMipmaps,
+        // Generate mipmaps on the decode threads, taking `content` into account.
+        // These are saved in the decoded image cache.
+        CPUMipmaps
+    };
+    Mipmaps mipmaps = GPUMipmaps;
+    // Whether the texels are sRGB colors, linear data, or normals.
+    // Only CPUMipmaps uses this.
+    ImageContent content = ImageContent::Color;
+    // The maximum anisotropy. 1 turns anisotropic filtering off.
+    // Values above what the driver supports are clamped.
+    float anisotropy = 1;
+    // Store 8-bit RGB(A) images in an sRGB format, so that shaders read linear colors.
+    // Off by default, because the shaders expect the values as they are in the file.
+    bool srgb = false;
+    // Block compress 8-bit images on the decode threads (once; the result is saved in
+    // the decoded image cache). Auto leaves normal maps uncompressed and picks BC3 for
+    // images with alpha and BC1 otherwise. BC5 stores only X and Y, so shaders must
+    // reconstruct Z; auto never picks it. BC1 and BC3 use sRGB formats when `srgb` is on.
+    // Falls back to uncompressed if the driver doesn't support it.
+    // Compressed textures always use CPU mipmaps.
+    enum Compression {
+        NoCompression,
+        AutoCompression,
+        BC1Compression,
+        BC3Compression,
+        BC5Compression
+    };
+    Compression compression = NoCompression;
+    
+    // A string that is different for different settings.
+    std::string key() const;
+};
+
+// Sets how many threads decode image files. Cube maps decode their faces in parallel.
+// Passing 0 uses one thread per hardware thread, which is the default.
+void set_texture_decode_threads( int num_threads );
+// Sets the directory in which to save decoded images, so that loading them again
+// (even in a later run) doesn't decompress the PNG or JPEG again.
+// The empty string (the default) turns this off.
+void set_texture_cache_directory( const std::string& directory );
+// The largest anisotropy the driver supports, or 1 if it doesn't support anisotropic filtering.
+float max_texture_anisotropy();
+// The threads that decode image files, for other image work (like building atlases) to share.
+ThreadPool& texture_decode_pool();
+// Turns texture streaming on or off. When it's on, 2D textures show a gray
+// placeholder (or their previous image, when reloading) until their image has been
+// decoded, copied into a pixel buffer object on a decode thread, and uploaded by the GPU.
+// Off by default, so that the first frame is complete (which screenshots need).
+void set_texture_streaming( bool stream );
+// Moves streaming textures along. Call this once per frame on the OpenGL thread.
+// Returns whether any textures are still streaming.
+bool update_streaming_textures();
 
 class Texture2D : public Texture {
 public:
-    Texture2D( const std::string& image_path );
-    static TexturePtr makePtr( const std::string& image_path );
+    Texture2D( const std::string& image_path, const TextureSettings& settings = TextureSettings() );
+    ~Texture2D();
+    static TexturePtr makePtr( const std::string& image_path, const TextureSettings& settings = TextureSettings() );
 
     void reload() override;
+    
+    // Takes the next streaming step, if the previous one is done.
+    // Returns true once the texture has its image. update_streaming_textures() calls this.
+    bool updateStreaming();
 
     void bind() override;
     
@@ -55,6 +129,29 @@ public:
 
 private:
     std::string m_image_path;
+    TextureSettings m_settings;
+    
+    // The state of an upload in progress. Null when not streaming.
+    struct Streaming;
+    std::unique_ptr< Streaming > m_streaming;
+    void cancelStreaming();
+};
+
+// A 2D texture made from an image in memory, such as a texture atlas page.
+// If the image has more than one level, they are its mipmaps.
+class ImageTexture2D : public Texture {
+public:
+    ImageTexture2D( const Image& image, const TextureSettings& settings = TextureSettings() );
+    static TexturePtr makePtr( const Image& image, const TextureSettings& settings = TextureSettings() );
+    
+    // There is no file to reload from. This uploads the image again.
+    void reload() override;
+    
+    void bind() override;
+    
+private:
+    Image m_image;
+    TextureSettings m_settings;
 };
 
 class TextureCube : public Texture {
@@ -62,25 +159,39 @@ public:
     TextureCube(
         const std::string& image_path_x_plus, const std::string& image_path_x_minus,
         const std::string& image_path_y_plus, const std::string& image_path_y_minus,
-        const std::string& image_path_z_plus, const std::string& image_path_z_minus
+        const std::string& image_path_z_plus, const std::string& image_path_z_minus,
+        const TextureSettings& settings = TextureSettings()
         );
     static TexturePtr makePtr(
         const std::string& image_path_x_plus, const std::string& image_path_x_minus,
         const std::string& image_path_y_plus, const std::string& image_path_y_minus,
-        const std::string& image_path_z_plus, const std::string& image_path_z_minus
+        const std::string& image_path_z_plus, const std::string& image_path_z_minus,
+        const TextureSettings& settings = TextureSettings()
         );
     
     void bind() override;
     
     void reload() override;
-    
+    // Decodes and uploads only the faces whose image is at `path`,
+    // unless the new image doesn't match the other faces.
+    void reloadPath( const std::string& path ) override;
+
 private:
+    // The path of face `face`, in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X + face.
+    const std::string& facePath( int face ) const;
+    
     std::string m_image_path_x_plus;
     std::string m_image_path_x_minus;
     std::string m_image_path_y_plus;
     std::string m_image_path_y_minus;
     std::string m_image_path_z_plus;
     std::string m_image_path_z_minus;
+    TextureSettings m_settings;
+    
+    // How the faces were last loaded, so that reloadPath() can check that a new face fits.
+    ImageLoadOptions m_options;
+    Image m_face_format;
+    int m_num_levels = 0;
 };
 
 }
@@ -0,0 +1,243 @@
+#include "textureatlas.h"
+
+#include "threadpool.h"
+
+#include "stb_image.h" // stbi_info()
+
+#include <algorithm> // sort(), find(), min(), max()
+#include <chrono> // Measuring build times.
+#include <cstring> // memcpy()
+#include <iostream>
+#include <limits>
+using std::cerr;
+
+namespace {
+int next_power_of_two( int value ) {
+    int result = 1;
+    while( result < value ) result *= 2;
+    return result;
+}
+
+int round_up( int value, int multiple ) {
+    return ( ( value + multiple - 1 )/multiple )*multiple;
+}
+
+// Copies the RGBA `image` into the RGBA texels of a `page_width`-wide page with its
+// bottom-left corner at ( x, y ), surrounded by `padding` texels copied from its nearest edge.
+void blit_padded( const graphics101::Image& image, int padding, int x, int y, int page_width, unsigned char* page_texels ) {
+    const int width = image.width();
+    const int height = image.height();
+    const unsigned char* texels = image.levels.front().texels;
+    
+    for( int row = -padding; row < height + padding; ++row ) {
+        const int source_row = std::min( std::max( row, 0 ), height - 1 );
+        const unsigned char* source = texels + std::size_t( source_row )*width*4;
+        unsigned char* destination = page_texels + ( std::size_t( y + row )*page_width + x )*4;
+        
+        // The left border, the row itself, and the right border.
+        for( int column = -padding; column < 0; ++column ) std::memcpy( destination + column*4, source, 4 );
+        std::memcpy( destination, source, std::size_t( width )*4 );
+        for( int column = width; column < width + padding; ++column ) std::memcpy( destination + column*4, source + ( width - 1 )*4, 4 );
+    }
+}
+}
+
+namespace graphics101 {
+
+SkylinePacker::SkylinePacker( int width, int height )
+    : m_width( width ), m_height( height )
+{
+    m_skyline.push_back( Segment{ 0, 0, width } );
+}
+
+int SkylinePacker::fit( int index, int width, int height ) const {
+    const int x = m_skyline[index].x;
+    if( x + width > m_width ) return -1;
+    
+    // The rectangle rests on the highest segment beneath it.
+    int y = 0;
+    int remaining = width;
+    for( int i = index; remaining > 0; ++i ) {
+        assert( i < m_skyline.size() );
+        y = std::max( y, m_skyline[i].y );
+        if( y + height > m_height ) return -1;
+        remaining -= m_skyline[i].width;
+    }
+    return y;
+}
+
+bool SkylinePacker::insert( int width, int height, int& x_out, int& y_out ) {
+    // Find the lowest place for the rectangle's top.
+    // Break ties by the narrowest segment, which wastes the least space beside it.
+    int best = -1;
+    int best_top = std::numeric_limits< int >::max();
+    int best_width = std::numeric_limits< int >::max();
+    for( int i = 0; i < m_skyline.size(); ++i ) {
+        const int y = fit( i, width, height );
+        if( y < 0 ) continue;
+        
+        if( y + height < best_top || ( y + height == best_top && m_skyline[i].width < best_width ) ) {
+            best = i;
+            best_top = y + height;
+            best_width = m_skyline[i].width;
+        }
+    }
+    if( best < 0 ) return false;
+    
+    x_out = m_skyline[best].x;
+    y_out = best_top - height;
+    
+    // The rectangle's top becomes a new segment.
+    m_skyline.insert( m_skyline.begin() + best, Segment{ x_out, best_top, width } );
+    
+    // Trim the segments it covers.
+    for( int i = best + 1; i < m_skyline.size(); ) {
+        const Segment& previous = m_skyline[i-1];
+        Segment& segment = m_skyline[i];
+        const int overlap = previous.x + previous.width - segment.x;
+        if( overlap <= 0 ) break;
+        
+        segment.x += overlap;
+        segment.width -= overlap;
+        if( segment.width > 0 ) break;
+        m_skyline.erase( m_skyline.begin() + i );
+    }
+    
+    // Merge neighbors at the same height.
+    for( int i = 0; i + 1 < m_skyline.size(); ) {
+        if( m_skyline[i].y == m_skyline[i+1].y ) {
+            m_skyline[i].width += m_skyline[i+1].width;
+            m_skyline.erase( m_skyline.begin() + i + 1 );
+        } else {
+            ++i;
+        }
+    }
+    
+    return true;
+}
+
+TextureAtlas pack_texture_atlas( const std::vector< Image >& images, const TextureAtlasOptions& options ) {
+    const int page_size = next_power_of_two( std::max( options.page_size, 1 ) );
+    const int padding = std::min( next_power_of_two( std::max( options.padding, 1 ) ), page_size );
+    
+    // Pack the tallest first, which leaves the most even skyline.
+    std::vector< int > order;
+    for( int i = 0; i < images.size(); ++i ) {
+        const Image& image = images[i];
+        if( !image.valid() || image.is_float || image.channels != 4 ) continue;
+        if( image.width() > options.max_texture_size || image.height() > options.max_texture_size ) continue;
+        order.push_back( i );
+    }
+    std::sort( order.begin(), order.end(), [&]( int a, int b ) { return images[a].height() > images[b].height(); } );
+    
+    // Every packed rectangle's position and size are multiples of `padding`, so that
+    // the first log2( padding ) mip levels never average two textures together.
+    TextureAtlas atlas;
+    std::vector< SkylinePacker > packers;
+    std::vector< std::shared_ptr< std::vector< unsigned char > > > page_texels;
+    for( int i : order ) {
+        const Image& image = images[i];
+        const int padded_width = round_up( image.width() + 2*padding, padding );
+        const int padded_height = round_up( image.height() + 2*padding, padding );
+        if( padded_width > page_size || padded_height > page_size ) continue;
+        
+        int page = 0;
+        int x = 0, y = 0;
+        for( ; page < packers.size(); ++page ) {
+            if( packers[page].insert( padded_width, padded_height, x, y ) ) break;
+        }
+        if( page == packers.size() ) {
+            packers.push_back( SkylinePacker( page_size, page_size ) );
+            const bool inserted = packers.back().insert( padded_width, padded_height, x, y );
+            assert( inserted );
+            
+            // Start the page transparent black.
+            auto texels = std::make_shared< std::vector< unsigned char > >( std::size_t( page_size )*page_size*4, 0 );
+            Image page_image;
+            page_image.path = "texture atlas page " + std::to_string( page );
+            page_image.channels = 4;
+            Image::Level level;
+            level.width = page_size;
+            level.height = page_size;
+            level.texels = texels->data();
+            level.size = texels->size();
+            page_image.levels.push_back( level );
+            page_image.storage = texels;
+            atlas.pages.push_back( page_image );
+            page_texels.push_back( texels );
+        }
+        
+        blit_padded( image, padding, x + padding, y + padding, page_size, page_texels[page]->data() );
+        
+        AtlasPlacement placement;
+        placement.page = page;
+        placement.uv_scale_offset = vec4(
+            real( image.width() )/page_size, real( image.height() )/page_size,
+            real( x + padding )/page_size, real( y + padding )/page_size
+            );
+        atlas.placements[ image.path ] = placement;
+    }
+    
+    // Only keep the mip levels the padding protects.
+    int num_levels = 1;
+    while( ( 1 << ( num_levels - 1 ) ) < padding ) ++num_levels;
+    for( Image& page : atlas.pages ) {
+        if( num_levels == 1 ) break;
+        page = generate_mipmaps( page, ImageContent::Color );
+        if( page.levels.size() > num_levels ) page.levels.resize( num_levels );
+    }
+    
+    return atlas;
+}
+
+TextureAtlas TextureAtlasBuilder::build( const std::vector< std::string >& paths, const TextureAtlasOptions& options, ThreadPool* pool ) {
+    const auto start = std::chrono::steady_clock::now();
+    
+    // Two textures may share a file.
+    std::vector< std::string > unique_paths;
+    for( const auto& path : paths ) {
+        if( std::find( unique_paths.begin(), unique_paths.end(), path ) == unique_paths.end() ) unique_paths.push_back( path );
+    }
+    
+    // Images that were too large may fit now.
+    if( options.max_texture_size != m_max_texture_size ) m_images.clear();
+    m_max_texture_size = options.max_texture_size;
+    
+    // Forget the images that are no longer wanted, and decode the ones we don't have.
+    std::unordered_map< std::string, Image > kept;
+    std::vector< std::string > missing;
+    for( const auto& path : unique_paths ) {
+        const auto found = m_images.find( path );
+        if( found != m_images.end() ) kept.insert( *found );
+        else missing.push_back( path );
+    }
+    m_images.swap( kept );
+    
+    std::vector< Image > decoded( missing.size() );
+    const auto decode = [&]( int i ) {
+        // Don't decode images that are too large to pack. Remember them as invalid.
+        int width = 0, height = 0, channels = 0;
+        if( stbi_info( missing[i].c_str(), &width, &height, &channels ) && ( width > options.max_texture_size || height > options.max_texture_size ) ) {
+            decoded[i].path = missing[i];
+            return;
+        }
+        decoded[i] = decode_image( missing[i], true, 4 );
+    };
+    if( pool ) pool->parallelFor( int( missing.size() ), decode );
+    else for( int i = 0; i < missing.size(); ++i ) decode( i );
+    for( int i = 0; i < missing.size(); ++i ) m_images[ missing[i] ] = decoded[i];
+    m_files_read += int( missing.size() );
+    
+    std::vector< Image > images;
+    for( const auto& path : unique_paths ) images.push_back( m_images[ path ] );
+    const TextureAtlas atlas = pack_texture_atlas( images, options );
+    
+    cerr << "Packed " << atlas.placements.size() << " of " << unique_paths.size() << " textures into "
+         << atlas.pages.size() << " atlas pages in "
+         << std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count() << " ms ("
+         << missing.size() << " files read).\n";
+    
+    return atlas;
+}
+
+}
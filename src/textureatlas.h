@@ -0,0 +1,109 @@
+#ifndef __textureatlas_h__
+#define __textureatlas_h__
+
+#include "types.h"
+#include "image.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace graphics101 {
+
+class ThreadPool;
+
+/*
+Packs rectangles into a fixed-size page, bottom to top.
+It keeps the "skyline", the top edge of everything packed so far,
+and puts each new rectangle where its top ends up lowest.
+*/
+class SkylinePacker {
+public:
+    SkylinePacker( int width, int height );
+    
+    // Finds room for a `width` by `height` rectangle and sets its bottom-left corner.
+    // Returns false if it doesn't fit.
+    bool insert( int width, int height, int& x_out, int& y_out );
+
+private:
+    // Returns the y at which a `width` by `height` rectangle whose left edge is the
+    // start of skyline segment `index` would sit, or -1 if it doesn't fit there.
+    int fit( int index, int width, int height ) const;
+    
+    struct Segment {
+        int x;
+        int y;
+        int width;
+    };
+    std::vector< Segment > m_skyline;
+    int m_width;
+    int m_height;
+};
+
+struct TextureAtlasOptions {
+    // The width and height of each page. Rounded up to a power of two.
+    int page_size = 1024;
+    // Texels of border around each texture, copied from its edges, so that
+    // filtering doesn't pick up the neighbors. Rounded up to a power of two.
+    // Pages get log2( padding ) mip levels, since smaller levels would mix neighbors.
+    int padding = 4;
+    // Textures wider or taller than this aren't packed.
+    int max_texture_size = 256;
+};
+
+// Where a texture ended up in an atlas.
+struct AtlasPlacement {
+    int page = -1;
+    // Maps the texture's UVs to the page's:
+    //     page_uv = uv*uv_scale_offset.xy + uv_scale_offset.zw
+    vec4 uv_scale_offset = vec4( 1, 1, 0, 0 );
+};
+
+struct TextureAtlas {
+    // 8-bit RGBA images with their mip levels.
+    std::vector< Image > pages;
+    // Keyed by path. Paths that weren't packed are missing.
+    std::unordered_map< std::string, AtlasPlacement > placements;
+};
+
+// Packs the 8-bit RGBA `images` into pages, tallest first.
+// Their placements are keyed by Image::path.
+// Images that are too large, have float texels, or are invalid are left out.
+TextureAtlas pack_texture_atlas( const std::vector< Image >& images, const TextureAtlasOptions& options );
+
+/*
+Builds atlases from image files. It keeps the decoded images, so that
+building again after one file changes decodes only that file.
+*/
+class TextureAtlasBuilder {
+public:
+    // Decodes the files at `paths` that it doesn't have yet (on `pool`'s threads
+    // if it isn't null) and packs them with pack_texture_atlas().
+    // The images are flipped vertically, as Texture2D does.
+    // Images of paths not in `paths` are dropped.
+    TextureAtlas build( const std::vector< std::string >& paths, const TextureAtlasOptions& options, ThreadPool* pool = nullptr );
+    
+    // Makes the next build() decode `path` again.
+    void invalidate( const std::string& path ) { m_images.erase( path ); }
+    
+    // The number of image files read so far.
+    int filesRead() const { return m_files_read; }
+
+private:
+    // Images too large to pack are kept as invalid images.
+    std::unordered_map< std::string, Image > m_images;
+    // The TextureAtlasOptions::max_texture_size those were too large for.
+    int m_max_texture_size = 0;
+    int m_files_read = 0;
+};
+
+// How parseUniforms() redirects a texture name to an atlas page.
+struct AtlasedTexture {
+    // The name of the page texture, which is bound in the texture's place.
+    std::string page_name;
+    vec4 uv_scale_offset = vec4( 1, 1, 0, 0 );
+};
+
+}
+
+#endif /* __textureatlas_h__ */
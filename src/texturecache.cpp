@@ -0,0 +1,92 @@
+#include "texturecache.h"
+
+#include <algorithm> // find(), count()
+#include <cassert>
+
+namespace graphics101 {
+
+TextureCache& TextureCache::shared() {
+    static TextureCache cache;
+    return cache;
+}
+
+Texture::TexturePtr TextureCache::find( const std::vector< std::string >& key ) {
+    auto found = m_entries.find( key );
+    if( found == m_entries.end() ) return nullptr;
+    
+    Texture::TexturePtr texture = found->second.texture.lock();
+    if( !texture ) {
+        // Nobody is using it anymore.
+        m_entries.erase( found );
+        return nullptr;
+    }
+    
+    auto& stale_paths = found->second.stale_paths;
+    if( !stale_paths.empty() ) {
+        for( const auto& path : stale_paths ) {
+            texture->reloadPath( path );
+            // The last entry in the key is the settings.
+            m_images_decoded += std::count( key.begin(), key.end() - 1, path );
+        }
+        stale_paths.clear();
+    } else {
+        m_hits += 1;
+    }
+    
+    return texture;
+}
+
+void TextureCache::insert( const std::vector< std::string >& key, const Texture::TexturePtr& texture ) {
+    for( auto it = m_entries.begin(); it != m_entries.end(); ) {
+        if( it->second.texture.expired() ) it = m_entries.erase( it );
+        else ++it;
+    }
+    
+    Entry& entry = m_entries[ key ];
+    entry.texture = texture;
+    entry.stale_paths.clear();
+}
+
+Texture::TexturePtr TextureCache::get2D( const std::string& image_path, const TextureSettings& settings ) {
+    const std::vector< std::string > key{ image_path, settings.key() };
+    
+    Texture::TexturePtr texture = find( key );
+    if( texture ) return texture;
+    
+    texture = Texture2D::makePtr( image_path, settings );
+    m_images_decoded += 1;
+    insert( key, texture );
+    return texture;
+}
+
+Texture::TexturePtr TextureCache::getCube( const std::vector< std::string >& image_paths, const TextureSettings& settings ) {
+    assert( image_paths.size() == 6 );
+    std::vector< std::string > key = image_paths;
+    key.push_back( settings.key() );
+    
+    Texture::TexturePtr texture = find( key );
+    if( texture ) return texture;
+    
+    texture = TextureCube::makePtr(
+        image_paths[0], image_paths[1],
+        image_paths[2], image_paths[3],
+        image_paths[4], image_paths[5],
+        settings
+        );
+    m_images_decoded += 6;
+    insert( key, texture );
+    return texture;
+}
+
+void TextureCache::invalidate( const std::string& path ) {
+    for( auto& entry : m_entries ) {
+        const auto& key = entry.first;
+        auto& stale_paths = entry.second.stale_paths;
+        if( std::find( key.begin(), key.end(), path ) != key.end()
+            && std::find( stale_paths.begin(), stale_paths.end(), path ) == stale_paths.end() ) {
+            stale_paths.push_back( path );
+        }
+    }
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef __texturecache_h__
+#define __texturecache_h__
+
+#include "texture.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace graphics101 {
+
+/*
+A process-wide cache of textures keyed by their image paths.
+Every drawable and scene that asks for the same image(s) shares one texture,
+so an image is only decoded and uploaded once.
+
+The cache only holds weak references. A texture is freed as usual once
+nothing else uses it. Keep the old textures alive until the new ones
+have been fetched if you want to reuse them.
+*/
+class TextureCache {
+public:
+    // The cache shared by the whole process.
+    static TextureCache& shared();
+    
+    // Returns the texture for the image at `image_path` with `settings`,
+    // loading it if it isn't already loaded.
+    Texture::TexturePtr get2D( const std::string& image_path, const TextureSettings& settings = TextureSettings() );
+    // Returns the cube map for the six image paths, in the order TextureCube takes them,
+    // loading it if it isn't already loaded.
+    Texture::TexturePtr getCube( const std::vector< std::string >& image_paths, const TextureSettings& settings = TextureSettings() );
+    
+    // Call this when the file at `path` changes. Textures that use it
+    // are reloaded (in place, so every user sees the new image) the next
+    // time they are asked for. Cube maps only reload the faces that use it.
+    void invalidate( const std::string& path );
+    
+    // The number of textures the cache knows about, including ones nobody uses
+    // anymore that haven't been pruned yet.
+    int size() const { return int( m_entries.size() ); }
+    
+    // How many textures were found in the cache and how many image
+    // files were decoded because they weren't.
+    int hits() const { return m_hits; }
+    int imagesDecoded() const { return m_images_decoded; }
+    
+private:
+    struct Entry {
+        std::weak_ptr< Texture > texture;
+        // The paths that changed since it was loaded.
+        std::vector< std::string > stale_paths;
+    };
+    // Returns the live texture for `key`, reloading whatever is stale.
+    // Returns nullptr if it isn't loaded.
+    Texture::TexturePtr find( const std::vector< std::string >& key );
+    // Adds `texture` under `key`, first forgetting textures nobody uses anymore.
+    void insert( const std::vector< std::string >& key, const Texture::TexturePtr& texture );
+    
+    // Keyed by the image path(s) followed by TextureSettings::key().
+    std::map< std::vector< std::string >, Entry > m_entries;
+    
+    int m_hits = 0;
+    int m_images_decoded = 0;
+};
+
+}
+
+#endif /* __texturecache_h__ */
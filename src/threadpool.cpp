@@ -0,0 +1,102 @@
+#include "threadpool.h"
+
+#include <algorithm> // max(), min()
+#include <atomic>
+#include <cassert>
+
+namespace graphics101 {
+
+ThreadPool::ThreadPool( int num_threads ) {
+    start( num_threads );
+}
+ThreadPool::~ThreadPool() {
+    stop();
+}
+
+void ThreadPool::resize( int num_threads ) {
+    stop();
+    start( num_threads );
+}
+
+void ThreadPool::start( int num_threads ) {
+    assert( m_threads.empty() );
+    
+    if( num_threads <= 0 ) {
+        // hardware_concurrency() returns 0 if it doesn't know.
+        num_threads = std::max( 1, int( std::thread::hardware_concurrency() ) );
+    }
+    
+    m_stopping = false;
+    for( int i = 0; i < num_threads; ++i ) {
+        m_threads.emplace_back( [this]() { this->workerLoop(); } );
+    }
+}
+void ThreadPool::stop() {
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for( auto& thread : m_threads ) thread.join();
+    m_threads.clear();
+}
+
+void ThreadPool::enqueue( std::function< void() > task ) {
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        m_tasks.push_back( std::move( task ) );
+    }
+    m_wake.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+    while( true ) {
+        std::function< void() > task;
+        {
+            std::unique_lock< std::mutex > lock( m_mutex );
+            m_wake.wait( lock, [this]() { return m_stopping || !m_tasks.empty(); } );
+            // Finish the queue before stopping.
+            if( m_tasks.empty() ) return;
+            task = std::move( m_tasks.front() );
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallelFor( int count, const std::function< void( int ) >& body ) {
+    if( count <= 0 ) return;
+    
+    // Every participating thread takes the next index until there are none left.
+    // Helpers that start after the work is gone just return, so we never wait
+    // for a helper that is stuck behind us in the queue.
+    struct Shared {
+        std::atomic< int > next{ 0 };
+        std::atomic< int > finished{ 0 };
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    auto shared = std::make_shared< Shared >();
+    
+    // `body` is only used while indices remain, and we don't return until they are all finished.
+    const std::function< void( int ) >* body_pointer = &body;
+    auto work = [shared, count, body_pointer]() {
+        int index;
+        while( ( index = shared->next++ ) < count ) {
+            (*body_pointer)( index );
+            if( ++shared->finished == count ) {
+                std::lock_guard< std::mutex > lock( shared->mutex );
+                shared->done.notify_all();
+            }
+        }
+    };
+    
+    const int num_helpers = std::min( size(), count - 1 );
+    for( int i = 0; i < num_helpers; ++i ) enqueue( work );
+    work();
+    
+    std::unique_lock< std::mutex > lock( shared->mutex );
+    shared->done.wait( lock, [&]() { return shared->finished == count; } );
+}
+
+}
@@ -0,0 +1,67 @@
+#ifndef __threadpool_h__
+#define __threadpool_h__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory> // shared_ptr
+#include <mutex>
+#include <thread>
+#include <type_traits> // result_of
+#include <vector>
+
+namespace graphics101 {
+
+/*
+A fixed set of worker threads that run tasks in the order they were submitted.
+*/
+class ThreadPool {
+public:
+    // Passing 0 uses one thread per hardware thread.
+    explicit ThreadPool( int num_threads = 0 );
+    // Finishes the queued tasks and joins the threads.
+    ~ThreadPool();
+    
+    // The number of worker threads.
+    int size() const { return int( m_threads.size() ); }
+    // Finishes the queued tasks and restarts with `num_threads` threads.
+    // Passing 0 uses one thread per hardware thread.
+    void resize( int num_threads );
+    
+    // Runs `task` on a worker thread. The future holds its result.
+    template< typename Task >
+    std::future< typename std::result_of< Task() >::type > submit( Task task ) {
+        typedef typename std::result_of< Task() >::type Result;
+        // std::function<> must be copyable, and packaged_task isn't.
+        auto packaged = std::make_shared< std::packaged_task< Result() > >( std::move( task ) );
+        std::future< Result > result = packaged->get_future();
+        enqueue( [packaged]() { (*packaged)(); } );
+        return result;
+    }
+    
+    // Calls body( i ) for every i in [0,count) and returns once they have all finished.
+    // The calling thread does its share of the work, so this is safe to call
+    // from a task running on the pool.
+    void parallelFor( int count, const std::function< void( int ) >& body );
+    
+    // This class cannot be copied.
+    ThreadPool( const ThreadPool& ) = delete;
+    void operator=( const ThreadPool& ) = delete;
+    
+private:
+    void enqueue( std::function< void() > task );
+    void start( int num_threads );
+    void stop();
+    void workerLoop();
+    
+    std::vector< std::thread > m_threads;
+    std::deque< std::function< void() > > m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+};
+
+}
+
+#endif /* __threadpool_h__ */
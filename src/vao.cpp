@@ -6,6 +6,7 @@
 #include <glm/gtc/type_ptr.hpp> // value_ptr()
 
 #include "mesh.h" // makeFromOBJPath, makeFromMesh
+#include "glstate.h"
 
 #include <iostream>
 
@@ -23,7 +24,7 @@ void upload_attribute( GLuint VAO, GLint dimension, const GLfloat* data, int num
     assert( data );
     
     // Bind the Vertex Array Object
-	glBindVertexArray( VAO );
+	graphics101::glstate::bindVertexArray( VAO );
 	
     // Generate a GPU buffer
 	GLuint VBO;
@@ -44,7 +45,8 @@ void upload_attribute( GLuint VAO, GLint dimension, const GLfloat* data, int num
     glEnableVertexAttribArray( location );
     
     // Unbind so we can delete the attribute buffer.
-    glBindVertexArray( 0 );
+    // Deleting a buffer detaches it from the bound VAO, so the VAO must be unbound first.
+    graphics101::glstate::bindVertexArray( 0 );
     glBindBuffer( GL_ARRAY_BUFFER, 0 );
     // Delete the attribute buffer. This won't actually delete it until we delete the VAO.
     glDeleteBuffers( 1, &VBO );
@@ -61,7 +63,7 @@ void upload_attribute( GLuint VAO, GLint dimension, const GLint* data, int num_v
     assert( data );
     
     // Bind the Vertex Array Object
-	glBindVertexArray( VAO );
+	graphics101::glstate::bindVertexArray( VAO );
 	
     // Generate a GPU buffer
 	GLuint VBO;
@@ -82,7 +84,8 @@ void upload_attribute( GLuint VAO, GLint dimension, const GLint* data, int num_v
     glEnableVertexAttribArray( location );
     
     // Unbind so we can delete the attribute buffer.
-    glBindVertexArray( 0 );
+    // Deleting a buffer detaches it from the bound VAO, so the VAO must be unbound first.
+    graphics101::glstate::bindVertexArray( 0 );
     glBindBuffer( GL_ARRAY_BUFFER, 0 );
     // Delete the attribute buffer. This won't actually delete it until we delete the VAO.
     glDeleteBuffers( 1, &VBO );
@@ -112,8 +115,8 @@ VertexAndFaceArrays::VertexAndFaceArrays()
 }
 VertexAndFaceArrays::~VertexAndFaceArrays()
 {
-    // Unbind the VAO
-    glBindVertexArray( 0 );
+    // Deleting the VAO unbinds it.
+    glstate::forgetVertexArray( m_VAO );
     // Delete the VAO
     glDeleteVertexArrays( 1, &m_VAO );
     // The call to glDeleteVertexArrays() doesn't actually
@@ -130,7 +133,7 @@ void VertexAndFaceArrays::draw()
         return;
     }
     
-    glBindVertexArray( m_VAO );
+    glstate::bindVertexArray( m_VAO );
     glDrawElements( m_mode, m_num_face_indices, GL_UNSIGNED_INT, 0 );
 }
 
@@ -180,7 +183,7 @@ void VertexAndFaceArrays::uploadFaces( const GLint* face_indices, int num_face_i
     m_num_face_indices = num_face_indices;
     
     // Bind the Vertex Array Object
-	glBindVertexArray( m_VAO );
+	glstate::bindVertexArray( m_VAO );
 	
     // Generate a GPU buffer
 	GLuint FBO;
@@ -197,9 +200,10 @@ void VertexAndFaceArrays::uploadFaces( const GLint* face_indices, int num_face_i
 	
 	// Unlike attributes, the last bound face data is stored with the VAO.
 	// We don't need to call anything else.
-	
+
 	// Unbind the VAO so we can delete the face buffer.
-    glBindVertexArray( 0 );
+	// Deleting it while the VAO is bound would detach it from the VAO.
+    glstate::bindVertexArray( 0 );
     
     // Delete the face buffer. This won't actually delete it until we delete the VAO.
     glDeleteBuffers( 1, &FBO );
@@ -0,0 +1,40 @@
+#include "allocationcounter.h"
+
+#ifdef GRAPHICS101_COUNT_ALLOCATIONS
+
+#include <cstdlib> // malloc(), free()
+#include <new>
+
+namespace {
+// Each thread counts its own, so that worker threads don't show up in other threads' counts.
+thread_local std::uint64_t allocation_count = 0;
+
+void* counted_allocate( std::size_t size ) {
+    ++allocation_count;
+    // malloc( 0 ) may return null.
+    void* result = std::malloc( size > 0 ? size : 1 );
+    if( !result ) throw std::bad_alloc();
+    return result;
+}
+}
+
+void* operator new( std::size_t size ) { return counted_allocate( size ); }
+void* operator new[]( std::size_t size ) { return counted_allocate( size ); }
+void operator delete( void* pointer ) noexcept { std::free( pointer ); }
+void operator delete[]( void* pointer ) noexcept { std::free( pointer ); }
+void operator delete( void* pointer, std::size_t ) noexcept { std::free( pointer ); }
+void operator delete[]( void* pointer, std::size_t ) noexcept { std::free( pointer ); }
+
+namespace graphics101 {
+bool counting_allocations() { return true; }
+std::uint64_t allocations_on_this_thread() { return allocation_count; }
+}
+
+#else
+
+namespace graphics101 {
+bool counting_allocations() { return false; }
+std::uint64_t allocations_on_this_thread() { return 0; }
+}
+
+#endif
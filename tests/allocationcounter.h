@@ -0,0 +1,20 @@
+#ifndef __allocationcounter_h__
+#define __allocationcounter_h__
+
+#include <cstdint>
+
+namespace graphics101 {
+
+/*
+When built with GRAPHICS101_COUNT_ALLOCATIONS defined (as test_frame_allocations.cpp is),
+this replaces the global operator new to count how many times each thread allocates,
+so that we can check that code which shouldn't touch the heap doesn't.
+Otherwise, nothing is counted.
+*/
+bool counting_allocations();
+// The number of heap allocations made by the calling thread so far, or 0 if they aren't counted.
+std::uint64_t allocations_on_this_thread();
+
+}
+
+#endif /* __allocationcounter_h__ */
@@ -0,0 +1,13 @@
+#include "matrix_kinematics.h"
+
+namespace graphics101 {
+
+void forward_kinematics_with_matrices( const Skeleton& skeleton, const mat4* bone2parent, mat4* bone2world ) {
+    // Parents come first, so their bone2world is always ready.
+    for( int bone = 0; bone < skeleton.size(); ++bone ) {
+        const int parent = skeleton[bone].parent_index;
+        bone2world[bone] = parent < 0 ? bone2parent[bone] : bone2world[parent]*bone2parent[bone];
+    }
+}
+
+}
@@ -0,0 +1,15 @@
+#ifndef __matrix_kinematics_h__
+#define __matrix_kinematics_h__
+
+#include "kinematics.h"
+
+namespace graphics101 {
+
+// Forward kinematics as a chain of mat4 products, visiting the bones in Skeleton order.
+// The tests check CompiledSkeleton and IncrementalKinematics against it, and pipeline_bench times both.
+// Like forward_kinematics(), but `bone2parent` and `bone2world` may be the same array.
+void forward_kinematics_with_matrices( const Skeleton& skeleton, const mat4* bone2parent, mat4* bone2world );
+
+}
+
+#endif /* __matrix_kinematics_h__ */
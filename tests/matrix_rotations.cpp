@@ -0,0 +1,44 @@
+#include "matrix_rotations.h"
+#include "quaternion.h"
+
+// glm wants us to opt in to its experimental extensions.
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/matrix_interpolation.hpp> // axisAngleMatrix(), axisAngle()
+
+namespace graphics101 {
+
+vec3 compose_rotations_with_matrices( const vec3& second, const vec3& first ) {
+    const mat4 Mfirst = glm::axisAngleMatrix( first, length(first) );
+    const mat4 Msecond = glm::axisAngleMatrix( second, length(second) );
+    const mat4 composed = Msecond*Mfirst;
+    vec3 result_axis;
+    real result_angle;
+    glm::axisAngle( composed, result_axis, result_angle );
+    return result_angle*result_axis;
+}
+
+vec3 slerp_with_matrices( const vec3& a, const vec3& b, real t ) {
+    const vec3 d = compose_rotations_with_matrices( b, -a );
+    return compose_rotations_with_matrices( t*d, a );
+}
+
+vec3 average_rotation_with_matrices( const std::vector< vec3 >& rotations, const std::vector< real >& weights ) {
+    vec3 mean = rotations.front();
+    vec3 mean_last;
+    int iterations = 0;
+    do {
+        mean_last = mean;
+        mean = vec3(0);
+        for( int i = 0; i < rotations.size(); ++i ) {
+            mean += weights[i]*compose_rotations_with_matrices( rotations[i], -mean_last );
+        }
+        mean = compose_rotations_with_matrices( mean, mean_last );
+    } while( distance( mean, mean_last ) > 1e-5 && ++iterations < 1000 );
+    return mean;
+}
+
+real radians_between( const vec3& a, const vec3& b ) {
+    return glm::length( axis_angle_from_quat( quat_from_axis_angle( b )*glm::conjugate( quat_from_axis_angle( a ) ) ) );
+}
+
+}
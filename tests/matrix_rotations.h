@@ -0,0 +1,22 @@
+#ifndef __matrix_rotations_h__
+#define __matrix_rotations_h__
+
+#include "types.h"
+
+namespace graphics101 {
+
+// The matrix-based rotation blending that slerp() and average_rotation() used to do.
+// The tests check the quaternion versions against these, and pipeline_bench times both.
+
+// Returns the axis*radians rotation that rotates by `first` and then by `second`.
+vec3 compose_rotations_with_matrices( const vec3& second, const vec3& first );
+vec3 slerp_with_matrices( const vec3& a, const vec3& b, real t );
+// `weights` must sum to 1.
+vec3 average_rotation_with_matrices( const std::vector< vec3 >& rotations, const std::vector< real >& weights );
+
+// How many radians apart two axis*radians rotations are.
+real radians_between( const vec3& a, const vec3& b );
+
+}
+
+#endif /* __matrix_rotations_h__ */
@@ -0,0 +1,169 @@
+// Poses a skeleton each frame the way FancyScene::timerEvent() does, from each form of
+// animation it can sample, and checks that once the FrameArena has grown, no frame allocates.
+// Also reports how long a frame takes, compared to returning a new array at every step.
+// It must be built with GRAPHICS101_COUNT_ALLOCATIONS and allocationcounter.cpp,
+// or it can't count allocations and fails.
+
+#include "allocationcounter.h"
+#include "animation.h"
+#include "animationcompression.h"
+#include "compiledanimation.h"
+#include "framearena.h"
+#include "shaderprogram.h" // UniformSet
+
+#include <chrono>
+#include <cmath> // sin(), cos()
+#include <iostream>
+
+using namespace graphics101;
+
+namespace {
+const int kNumBones = 60;
+const int kNumFrames = 240;
+// How many frames to pose with each form of the animation.
+const int kCount = 2000;
+
+// A chain of bones swaying back and forth, walking away from the origin.
+void make_animation( Skeleton& skeleton, BoneAnimation& animation ) {
+    skeleton.resize( kNumBones );
+    for( int bone = 0; bone < kNumBones; ++bone ) {
+        skeleton[bone].name = "bone" + std::to_string( bone );
+        skeleton[bone].parent_index = bone - 1;
+        skeleton[bone].end = vec3( 0, bone + 1, 0 );
+    }
+    
+    animation.seconds_per_frame = 1./30.;
+    animation.frames.assign( kNumFrames, TRSPose( kNumBones ) );
+    for( int frame = 0; frame < kNumFrames; ++frame ) {
+        for( int bone = 0; bone < kNumBones; ++bone ) {
+            TRS& trs = animation.frames[ frame ][ bone ];
+            const real phase = frame*real(0.1) + bone*real(0.3);
+            trs.translation = bone == 0 ? vec3( 0, 0, frame*real(0.01) ) : vec3( 0, 1, 0 );
+            trs.rotation = vec3( real(0.3)*std::sin( phase ), real(0.2)*std::cos( phase ), real(0.1)*std::sin( 2*phase ) );
+        }
+    }
+}
+
+// Calls frame( i ) for i in [1,count] after calling frame( 0 ) to warm up, so that anything
+// that grows has grown. Stores the average microseconds and allocations per call.
+template< typename Frame >
+void time_frames( int count, Frame frame, double& microseconds_out, double& allocations_out ) {
+    // Twice, since a FrameArena grows in the reset() after the frame that didn't fit.
+    frame( 0 );
+    frame( 0 );
+    const std::uint64_t allocations_before = allocations_on_this_thread();
+    const auto start = std::chrono::steady_clock::now();
+    for( int i = 1; i <= count; ++i ) frame( i );
+    microseconds_out = std::chrono::duration< double, std::micro >( std::chrono::steady_clock::now() - start ).count()/count;
+    allocations_out = double( allocations_on_this_thread() - allocations_before )/count;
+}
+
+/*
+Given:
+    name: What to call this form of the animation
+    skeleton: The Skeleton to pose
+    seconds_per_step: How far apart in time to pose the frames
+    sample: A function such that sample( arena, t, bone2parent ) stores the bone-to-parent
+            matrices at time `t` in `bone2parent`, using `arena` for any scratch memory
+Returns:
+    False if posing the skeleton allocated after the first frames.
+*/
+template< typename Sample >
+bool check_frames( const char* name, const Skeleton& skeleton, real seconds_per_step, Sample sample ) {
+    const int num_bones = int( skeleton.size() );
+    FrameArena arena;
+    UniformSet uniforms;
+    double microseconds = 0, allocations = 0;
+    time_frames( kCount, [&]( int i ) {
+        arena.reset();
+        mat4* bone2parent = arena.allocate< mat4 >( num_bones );
+        sample( arena, i*seconds_per_step, bone2parent );
+        mat4* bone2world = arena.allocate< mat4 >( num_bones );
+        forward_kinematics( skeleton, bone2parent, bone2world );
+        uniforms.storeUniform( "uBoneToWorld", bone2world, num_bones );
+    }, microseconds, allocations );
+    
+    std::cout << "    " << name << ": " << microseconds << " us per frame\n";
+    if( allocations > 0 ) {
+        std::cerr << "ERROR: Posing the skeleton from the " << name << " allocated " << allocations << " times per frame.\n";
+        return false;
+    }
+    return true;
+}
+}
+
+int main() {
+    if( !counting_allocations() ) {
+        std::cerr << "ERROR: Allocations aren't being counted. Build with GRAPHICS101_COUNT_ALLOCATIONS.\n";
+        return 1;
+    }
+    
+    Skeleton skeleton;
+    BoneAnimation animation;
+    make_animation( skeleton, animation );
+    const CompiledAnimation compiled = compile_animation( animation );
+    const CompressedAnimation compressed = compress_animation( skeleton, compiled );
+    if( compiled.empty() || compressed.empty() ) {
+        std::cerr << "ERROR: Could not compile and compress the animation.\n";
+        return 1;
+    }
+    
+    const int num_bones = kNumBones;
+    // Step by a fraction of a frame, so that most samples fall between frames.
+    const real step = 0.37*animation.seconds_per_frame;
+    
+    // For comparison, what every step returning a new array costs.
+    double returning_microseconds = 0, returning_allocations = 0;
+    UniformSet uniforms;
+    time_frames( kCount, [&]( int i ) {
+        const MatrixPose bone2parent = MatrixPoseFromTRSPose( interpolate( animation, i*step ) );
+        const MatrixPose bone2world = forward_kinematics( skeleton, bone2parent );
+        uniforms.storeUniform( "uBoneToWorld", bone2world );
+    }, returning_microseconds, returning_allocations );
+    
+    std::cout << "Posing " << num_bones << " bones:\n"
+              << "    returning arrays: " << returning_microseconds << " us and " << returning_allocations << " allocations per frame\n";
+    
+    bool passed = true;
+    passed = check_frames( "BoneAnimation", skeleton, step, [&]( FrameArena& arena, real t, mat4* bone2parent ) {
+        TRS* pose = arena.allocate< TRS >( num_bones );
+        interpolate( animation, t, pose );
+        matrices_from_pose( pose, num_bones, bone2parent );
+    } ) && passed;
+    // Blending two moments of the animation, as when crossfading between clips.
+    const std::vector< real > blend_weights = { 0.7, 0.3 };
+    passed = check_frames( "blended BoneAnimation", skeleton, step, [&]( FrameArena& arena, real t, mat4* bone2parent ) {
+        TRS* pose = arena.allocate< TRS >( num_bones );
+        TRS* other = arena.allocate< TRS >( num_bones );
+        interpolate( animation, t, pose );
+        interpolate( animation, t + 0.5, other );
+        vec3* rotations = arena.allocate< vec3 >( 2*num_bones );
+        for( int bone = 0; bone < num_bones; ++bone ) {
+            rotations[ bone ] = pose[ bone ].rotation;
+            rotations[ num_bones + bone ] = other[ bone ].rotation;
+        }
+        vec3* blended = arena.allocate< vec3 >( num_bones );
+        average_rotations( rotations, blend_weights, num_bones, arena, blended );
+        for( int bone = 0; bone < num_bones; ++bone ) pose[ bone ].rotation = blended[ bone ];
+        matrices_from_pose( pose, num_bones, bone2parent );
+    } ) && passed;
+    passed = check_frames( "CompiledAnimation with nlerp", skeleton, step, [&]( FrameArena& arena, real t, mat4* bone2parent ) {
+        QuatTRS* pose = arena.allocate< QuatTRS >( num_bones );
+        sample_animation( compiled, t, pose, RotationInterpolation::Nlerp );
+        matrices_from_pose( pose, num_bones, bone2parent );
+    } ) && passed;
+    passed = check_frames( "CompiledAnimation with slerp", skeleton, step, [&]( FrameArena& arena, real t, mat4* bone2parent ) {
+        QuatTRS* pose = arena.allocate< QuatTRS >( num_bones );
+        sample_animation( compiled, t, pose, RotationInterpolation::Slerp );
+        matrices_from_pose( pose, num_bones, bone2parent );
+    } ) && passed;
+    passed = check_frames( "CompressedAnimation", skeleton, step, [&]( FrameArena& arena, real t, mat4* bone2parent ) {
+        QuatTRS* pose = arena.allocate< QuatTRS >( num_bones );
+        sample_animation( compressed, t, pose );
+        matrices_from_pose( pose, num_bones, bone2parent );
+    } ) && passed;
+    
+    if( !passed ) return 1;
+    std::cout << "No frame allocated.\n";
+    return 0;
+}
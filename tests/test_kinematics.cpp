@@ -0,0 +1,102 @@
+// Checks that CompiledSkeleton's level-by-level forward kinematics and IncrementalKinematics
+// pose random skeletons the same as a chain of mat4 products.
+// Prints what failed and returns non-zero if anything did.
+
+#include "compiledanimation.h" // QuatTRS
+#include "compiledskeleton.h"
+#include "matrix_kinematics.h"
+
+#include <iostream>
+#include <random>
+
+using namespace graphics101;
+
+namespace {
+// Products of float matrices down a deep chain drift apart a little.
+const real kTolerance = 1e-3;
+
+int failures = 0;
+
+void check_pose( const char* what, const Skeleton& skeleton, const std::vector< Affine3x4 >& result, const MatrixPose& expected ) {
+    for( int bone = 0; bone < skeleton.size(); ++bone ) {
+        const mat4 M = result[bone];
+        for( int column = 0; column < 4; ++column ) {
+            if( glm::distance( M[column], expected[bone][column] ) > kTolerance ) {
+                std::cerr << "ERROR: " << what << " posed bone " << bone << " of " << skeleton.size() << " wrong.\n";
+                ++failures;
+                return;
+            }
+        }
+    }
+}
+
+// A skeleton of `num_bones` bones whose parents are random earlier bones,
+// or, if `chains` is true, mostly the bone just before, like limbs and fingers.
+Skeleton random_skeleton( int num_bones, bool chains, std::mt19937& random ) {
+    Skeleton skeleton( num_bones );
+    for( int i = 1; i < num_bones; ++i ) {
+        skeleton[i].parent_index = chains && i % 4 != 0 ? i - 1 : int( random() % i );
+    }
+    // A second root.
+    if( num_bones > 2 ) skeleton[ num_bones/2 ].parent_index = -1;
+    return skeleton;
+}
+
+void test_skeleton( const Skeleton& skeleton, std::mt19937& random ) {
+    const int num_bones = int( skeleton.size() );
+    std::uniform_real_distribution< real > uniform( -1, 1 );
+    
+    MatrixPose bone2parent( num_bones );
+    std::vector< Affine3x4 > affine_bone2parent( num_bones );
+    for( int i = 0; i < num_bones; ++i ) {
+        QuatTRS trs;
+        trs.translation = vec3( uniform( random ), uniform( random ), uniform( random ) );
+        trs.rotation = glm::normalize( quat( uniform( random ), uniform( random ), uniform( random ), uniform( random ) ) );
+        bone2parent[i] = mat4( trs );
+        affine_bone2parent[i] = Affine3x4( trs );
+    }
+    
+    MatrixPose expected( num_bones );
+    forward_kinematics_with_matrices( skeleton, bone2parent.data(), expected.data() );
+    
+    const CompiledSkeleton compiled( skeleton );
+    std::vector< Affine3x4 > bone2world( num_bones );
+    compiled.forwardKinematics( affine_bone2parent.data(), bone2world.data() );
+    check_pose( "CompiledSkeleton", skeleton, bone2world, expected );
+    
+    // In place.
+    bone2world = affine_bone2parent;
+    compiled.forwardKinematics( bone2world.data(), bone2world.data() );
+    check_pose( "CompiledSkeleton in place", skeleton, bone2world, expected );
+    
+    // Move one bone and check that updating its subtree catches up.
+    IncrementalKinematics incremental( skeleton );
+    incremental.setPose( affine_bone2parent.data() );
+    incremental.update();
+    check_pose( "IncrementalKinematics", skeleton, incremental.bone2world(), expected );
+    
+    const int moved = int( random() % num_bones );
+    QuatTRS trs;
+    trs.rotation = glm::normalize( quat( 4, uniform( random ), uniform( random ), uniform( random ) ) );
+    bone2parent[ moved ] = mat4( trs );
+    forward_kinematics_with_matrices( skeleton, bone2parent.data(), expected.data() );
+    incremental.setBone2Parent( moved, Affine3x4( trs ) );
+    incremental.update();
+    check_pose( "IncrementalKinematics after moving one bone", skeleton, incremental.bone2world(), expected );
+}
+}
+
+int main() {
+    std::mt19937 random( 101 );
+    for( const int num_bones : { 1, 2, 30, 150, 1000 } ) {
+        test_skeleton( random_skeleton( num_bones, true, random ), random );
+        test_skeleton( random_skeleton( num_bones, false, random ), random );
+    }
+    
+    if( failures > 0 ) {
+        std::cerr << failures << " forward kinematics checks failed.\n";
+        return 1;
+    }
+    std::cout << "All forward kinematics checks passed.\n";
+    return 0;
+}
@@ -0,0 +1,111 @@
+// Checks that slerp() and average_rotation(), which blend with quaternions,
+// agree with the matrix-based blending they replaced.
+// Prints what failed and returns non-zero if anything did.
+
+#include "animation.h"
+#include "framearena.h"
+#include "matrix_rotations.h"
+
+#include <iostream>
+#include <random>
+
+using namespace graphics101;
+
+namespace {
+// Converting through float matrices loses a little accuracy, so allow this much.
+const real kMatrixTolerance = 5e-3;
+// Blending with quaternions alone should be this close to exact.
+const real kTolerance = 1e-4;
+
+int failures = 0;
+
+void check_close( const char* what, const vec3& result, const vec3& expected, real tolerance ) {
+    const real radians = radians_between( result, expected );
+    if( radians <= tolerance ) return;
+    
+    std::cerr << "ERROR: " << what << " is off by " << radians << " radians: ("
+              << result.x << ", " << result.y << ", " << result.z << ") instead of ("
+              << expected.x << ", " << expected.y << ", " << expected.z << ")\n";
+    ++failures;
+}
+
+// A rotation by up to `max_radians` around a random axis.
+vec3 random_rotation( std::mt19937& random, real max_radians ) {
+    std::uniform_real_distribution< real > component( -1, 1 );
+    std::uniform_real_distribution< real > radians( 0.1, max_radians );
+    vec3 axis;
+    do {
+        axis = vec3( component( random ), component( random ), component( random ) );
+    } while( glm::length( axis ) < 0.1 || glm::length( axis ) > 1 );
+    return glm::normalize( axis )*radians( random );
+}
+
+void test_slerp( std::mt19937& random ) {
+    // Keep the rotations less than pi apart, where the short way around is unambiguous.
+    for( int trial = 0; trial < 200; ++trial ) {
+        const vec3 a = random_rotation( random, 1.5 );
+        const vec3 b = random_rotation( random, 1.5 );
+        
+        check_close( "slerp( a, b, 0 )", slerp( a, b, 0 ), a, kTolerance );
+        check_close( "slerp( a, b, 1 )", slerp( a, b, 1 ), b, kTolerance );
+        for( const real t : { 0.1, 0.5, 0.9 } ) {
+            check_close( "slerp()", slerp( a, b, t ), slerp_with_matrices( a, b, t ), kMatrixTolerance );
+        }
+    }
+    
+    // The batched version must match the single one.
+    const int count = 16;
+    std::vector< vec3 > a( count ), b( count ), batched( count );
+    for( int i = 0; i < count; ++i ) {
+        a[i] = random_rotation( random, 1.5 );
+        b[i] = random_rotation( random, 1.5 );
+    }
+    slerp( a.data(), b.data(), 0.3, count, batched.data() );
+    for( int i = 0; i < count; ++i ) check_close( "batched slerp()", batched[i], slerp( a[i], b[i], 0.3 ), kTolerance );
+}
+
+void test_average_rotation( std::mt19937& random ) {
+    const std::vector< real > weights = { 0.4, 0.3, 0.2, 0.1 };
+    
+    // Rotations near each other, like the same bone in blended clips.
+    for( int trial = 0; trial < 200; ++trial ) {
+        const vec3 center = random_rotation( random, 1.5 );
+        std::vector< vec3 > rotations( weights.size() );
+        for( auto& rotation : rotations ) rotation = compose_rotations_with_matrices( random_rotation( random, 0.6 ), center );
+        
+        check_close( "average_rotation()", average_rotation( rotations, weights ), average_rotation_with_matrices( rotations, weights ), kMatrixTolerance );
+    }
+    
+    // Averaging one rotation gives it back, and averaging two evenly is halfway between them.
+    const vec3 a = random_rotation( random, 1.5 );
+    const vec3 b = random_rotation( random, 1.5 );
+    check_close( "average_rotation() of one rotation", average_rotation( { a }, { 1 } ), a, kTolerance );
+    check_close( "average_rotation() of two rotations", average_rotation( { a, b }, { 0.5, 0.5 } ), slerp( a, b, 0.5 ), kTolerance );
+    
+    // The batched version reads rotations[ i*count + set ] and must match the single one.
+    const int count = 8;
+    std::vector< vec3 > sets( weights.size()*count );
+    for( auto& rotation : sets ) rotation = random_rotation( random, 1.5 );
+    std::vector< vec3 > batched( count );
+    FrameArena arena;
+    average_rotations( sets.data(), weights, count, arena, batched.data() );
+    for( int set = 0; set < count; ++set ) {
+        std::vector< vec3 > rotations( weights.size() );
+        for( int i = 0; i < weights.size(); ++i ) rotations[i] = sets[ i*count + set ];
+        check_close( "batched average_rotations()", batched[ set ], average_rotation( rotations, weights ), kTolerance );
+    }
+}
+}
+
+int main() {
+    std::mt19937 random( 101 );
+    test_slerp( random );
+    test_average_rotation( random );
+    
+    if( failures > 0 ) {
+        std::cerr << failures << " rotation checks failed.\n";
+        return 1;
+    }
+    std::cout << "All rotation checks passed.\n";
+    return 0;
+}